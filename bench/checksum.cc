@@ -0,0 +1,127 @@
+/**
+ * @file checksum.cc
+ * @brief checksum throughput of 64 bytes, mtu and 64 KiB super frame buffers
+ *
+ * word loop is the routine stack used before checksum kernel, kept here as reference:
+ *     checksum [seconds per case]
+ *
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "checksum.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <arpa/inet.h>
+
+/// buffer sizes measured, smallest frame, mtu and largest super frame
+const std::array<size_t, 3> buffer_sizes = { 64, def::default_mtu, 65536 };
+/// buffers are walked round robin so large case is not only cache hot
+const size_t buffer_pool_size = 4 << 20;
+/// calls between clock reads
+const uint32_t check_interval = 64;
+
+/// keep result alive so loop is not optimized out
+volatile uint16_t sink;
+
+// word loop of stack before checksum kernel, one ntohs and carry branch per 16 bits
+uint16_t compute_checksum_words(const char* buf, size_t len) {
+    auto div = len / def::checksum_div_base;
+    uint16_t sum = 0;
+    for (size_t index = 0; index < div; index++) {
+        auto num = ntohs(*reinterpret_cast<const uint16_t*>(buf + index * def::checksum_div_base));
+        if (def::checksum_max_num - sum > num)
+            sum += num;
+        else
+            sum += num + 1;
+    }
+    return (~sum & def::checksum_max_num);
+}
+
+// current stack routine
+uint16_t compute_checksum_stack(const char* buf, size_t len) {
+    return flow::compute_checksum(buf, len);
+}
+
+// scalar kernel, complemented to match stack routine
+uint16_t compute_checksum_scalar(const char* buf, size_t len) {
+    return (~ntohs(flow::checksum_engine::sum_scalar(buf, len)) & def::checksum_max_num);
+}
+
+typedef uint16_t (*checksum_routine)(const char*, size_t);
+
+struct routine {
+    const char* name;
+    checksum_routine sum;
+};
+
+// run routine over pool for seconds, return bytes per second
+double measure(checksum_routine sum, const std::vector<char>& pool, size_t size, double seconds, double& ns_per_call) {
+    size_t count = pool.size() / size;
+    uint64_t calls = 0;
+    auto begin = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        for (uint32_t index = 0; index < check_interval; index++, calls++)
+            sink = sum(pool.data() + (calls % count) * size, size);
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    ns_per_call = elapsed * 1e9 / calls;
+    return double(calls) * size / elapsed;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1;
+    if (seconds <= 0) {
+        std::cerr << "usage: " << argv[0] << " [seconds per case]" << std::endl;
+        return 1;
+    }
+    std::vector<char> pool(buffer_pool_size);
+    srand(1);
+    for (auto& byte : pool)
+        byte = char(rand());
+
+    const std::array<routine, 3> routines = {{
+        { "word loop", compute_checksum_words },
+        { "scalar", compute_checksum_scalar },
+        { flow::checksum_engine::get_kernel_name(), compute_checksum_stack },
+    }};
+
+    // all routines must agree before they are timed
+    for (auto size : buffer_sizes) {
+        for (size_t offset = 0; offset + size <= pool.size(); offset += size * 7 + 2) {
+            auto expect = compute_checksum_words(pool.data() + offset, size);
+            for (auto& entry : routines) {
+                if (entry.sum(pool.data() + offset, size) != expect) {
+                    std::cerr << entry.name << " differ from word loop, size: " << size << ", offset: " << offset << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    std::cout << std::left << std::setw(10) << "size" << std::setw(12) << "routine"
+        << std::right << std::setw(12) << "ns/call" << std::setw(12) << "GB/s" << std::setw(10) << "speedup" << std::endl;
+    for (auto size : buffer_sizes) {
+        double base = 0;
+        for (auto& entry : routines) {
+            double ns_per_call = 0;
+            double rate = measure(entry.sum, pool, size, seconds, ns_per_call);
+            if (base == 0)
+                base = rate;
+            std::cout << std::left << std::setw(10) << size << std::setw(12) << entry.name
+                << std::right << std::fixed << std::setprecision(1) << std::setw(12) << ns_per_call
+                << std::setprecision(2) << std::setw(12) << rate / 1e9 << std::setw(9) << rate / base << "x" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file rx_pps.cc
+ * @brief receive packet rate of raw_stack, udp frames are fed to device and counted at sock
+ *
+ * pair mode need no privilege, frames are written to peer of stack device in memory:
+ *     rx_pps pair [queues] [seconds]
+ *
+ * macvlan mode compare receive modes of macvlan_device, kernel udp socket send to stack over veth:
+ *     ip link add bench0 type veth peer name bench1
+ *     ip addr add 10.77.0.1/24 dev bench1
+ *     ip link set bench0 up && ip link set bench1 up
+ *     ip neigh replace 10.77.0.2 lladdr 02:00:00:00:77:02 dev bench1
+ *     rx_pps macvlan bench0 <socket|packet_ring|mmsg|io_uring> [fanout] [seconds]
+ *
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "checksum.hpp"
+#include "macvlan.hpp"
+#include "pair.hpp"
+#include "raw_stack.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const char* stack_ip = "10.77.0.2";
+const char* stack_mac = "02:00:00:00:77:02";
+const char* peer_ip = "10.77.0.1";
+const char* peer_mac = "02:00:00:00:77:01";
+const uint16_t sink_port = 9000;
+const uint16_t source_port = 9001;
+/// udp payload of 60 bytes frame, smallest ether frame without fcs
+const uint16_t payload_size = 18;
+/// frames sent per syscall or per device write
+const uint32_t send_batch = 32;
+/// rate is measured after stack threads are warm
+const auto warmup_time = std::chrono::milliseconds(500);
+
+/// udp datagrams read from sink sock
+std::atomic<uint64_t> sink_count {0};
+/// stop generator
+std::atomic<bool> stop {false};
+
+// read sink sock until process exit
+void run_sink(const stack::raw_stack::ptr& stack) {
+    uint32_t fd = stack->sock_create(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(sink_port);
+    if (!stack->bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))) {
+        std::cerr << "bind sink sock failed" << std::endl;
+        _exit(1);
+    }
+    std::thread([stack, fd] {
+        char buf[def::default_mtu];
+        while (true) {
+            struct sockaddr_in remote;
+            socklen_t len = sizeof(remote);
+            stack->readfrom(fd, buf, sizeof(buf), reinterpret_cast<struct sockaddr*>(&remote), &len);
+            sink_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }).detach();
+}
+
+// make udp frame start at ip header, device push ether header
+flow::sk_buff::ptr make_frame(const uint8_t* dst_mac, uint32_t src_ip, uint32_t dst_ip) {
+    size_t ip_size = sizeof(struct flow::ip_hdr) + sizeof(struct flow::udp_hdr) + payload_size;
+    auto buffer = flow::sk_buff::alloc(def::max_ether_header + ip_size);
+    if (buffer == nullptr)
+        return nullptr;
+    buffer->data_len = def::max_ether_header + ip_size;
+    flow::skb_reserve(buffer, def::max_ether_header);
+    flow::skb_put(buffer, ip_size);
+    auto ip = reinterpret_cast<struct flow::ip_hdr*>(buffer->get_data());
+    memset(ip, 0, ip_size);
+    ip->version_and_head_len = 0x45;
+    ip->total_len = htons(ip_size);
+    ip->time_to_live = def::ip_time_to_live;
+    ip->protocol = uint8_t(def::transport_protocol::udp);
+    ip->src_ip = htonl(src_ip);
+    ip->dst_ip = htonl(dst_ip);
+    ip->head_checksum = htons(flow::compute_checksum(reinterpret_cast<char*>(ip), sizeof(struct flow::ip_hdr)));
+    // udp checksum 0 means not computed
+    auto udp = reinterpret_cast<struct flow::udp_hdr*>(ip + 1);
+    udp->src_port = htons(source_port);
+    udp->dst_port = htons(sink_port);
+    udp->total_len = htons(sizeof(struct flow::udp_hdr) + payload_size);
+    buffer->protocol = uint16_t(def::network_protocol::ip);
+    std::array<uint8_t, def::mac_len> mac;
+    memcpy(mac.data(), dst_mac, def::mac_len);
+    buffer->dst = mac;
+    return buffer;
+}
+
+// write frames to peer of stack device, pair copy them to rx buffer of stack device
+void run_pair_source(const driver::pair_device::ptr& source, const driver::pair_device::ptr& target) {
+    uint32_t src_ip = source->get_device_ip();
+    uint32_t dst_ip = target->get_device_ip();
+    flow::skb_batch batch;
+    uint64_t drops = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        batch.clear();
+        for (uint32_t index = 0; index < send_batch; index++) {
+            auto frame = make_frame(target->get_device_mac(), src_ip, dst_ip);
+            if (frame != nullptr)
+                batch.push(std::move(frame));
+        }
+        source->write_to_device(batch);
+        // wire ring is full, let rx side drain
+        auto stats = source->get_stats();
+        if (stats.drops != drops) {
+            drops = stats.drops;
+            std::this_thread::yield();
+        }
+    }
+}
+
+// send udp datagrams from kernel socket to stack
+void run_kernel_source() {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in dst;
+    memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(sink_port);
+    inet_pton(AF_INET, stack_ip, &dst.sin_addr);
+    char payload[payload_size] = {};
+    struct iovec iov = { payload, payload_size };
+    struct mmsghdr msgs[send_batch];
+    memset(msgs, 0, sizeof(msgs));
+    for (auto& msg : msgs) {
+        msg.msg_hdr.msg_name = &dst;
+        msg.msg_hdr.msg_namelen = sizeof(dst);
+        msg.msg_hdr.msg_iov = &iov;
+        msg.msg_hdr.msg_iovlen = 1;
+    }
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (sendmmsg(fd, msgs, send_batch, 0) < 0) {
+            std::cerr << "send to stack failed, err: " << std::strerror(errno) << std::endl;
+            break;
+        }
+    }
+    close(fd);
+}
+
+// parse macvlan receive mode
+bool parse_rx_mode(const std::string& name, def::device_rx_mode& mode) {
+    if (name == "socket")
+        mode = def::device_rx_mode::socket;
+    else if (name == "packet_ring")
+        mode = def::device_rx_mode::packet_ring;
+    else if (name == "mmsg")
+        mode = def::device_rx_mode::mmsg;
+    else if (name == "io_uring")
+        mode = def::device_rx_mode::io_uring;
+    else
+        return false;
+    return true;
+}
+
+// count sink datagrams over measure window
+double measure(int seconds) {
+    std::this_thread::sleep_for(warmup_time);
+    uint64_t begin_count = sink_count.load();
+    auto begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    uint64_t end_count = sink_count.load();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return (end_count - begin_count) / elapsed;
+}
+
+int main(int argc, char** argv) {
+    std::string device = argc > 1 ? argv[1] : "pair";
+    // stack log every packet, it would be measured instead of stack
+    auto log = std::cout.rdbuf(nullptr);
+    auto stack = stack::raw_stack::create();
+    std::thread source;
+    driver::pair_device::ptr target;
+    int seconds = 3;
+    if (device == "pair") {
+        driver::pair_device_config config;
+        config.queue_count = argc > 2 ? atoi(argv[2]) : 1;
+        seconds = argc > 3 ? atoi(argv[3]) : seconds;
+        target = std::make_shared<driver::pair_device>("bench0", 201, stack_ip, stack_mac, def::default_mtu, def::skb_rx_headroom, config);
+        auto peer = std::make_shared<driver::pair_device>("bench1", 202, peer_ip, peer_mac, def::default_mtu, def::skb_rx_headroom, config);
+        driver::pair_device::connect(target, peer);
+        // only stack device read, peer is driven by source thread
+        peer->up();
+        stack->register_device(target);
+        stack->register_handlers();
+        stack->run();
+        run_sink(stack);
+        source = std::thread(run_pair_source, peer, target);
+    } else if (device == "macvlan" && argc > 3) {
+        driver::macvlan_rx_config rx_config;
+        if (!parse_rx_mode(argv[3], rx_config.mode)) {
+            std::cerr << "unknown rx mode: " << argv[3] << std::endl;
+            return 1;
+        }
+        rx_config.fanout_count = argc > 4 ? atoi(argv[4]) : 1;
+        seconds = argc > 5 ? atoi(argv[5]) : seconds;
+        auto macvlan = std::make_shared<driver::macvlan_device>(argv[2], stack_ip, stack_mac, def::default_mtu,
+            def::skb_rx_headroom, rx_config);
+        stack->register_device(macvlan);
+        stack->register_handlers();
+        stack->run();
+        run_sink(stack);
+        source = std::thread(run_kernel_source);
+    } else {
+        std::cerr << "usage: " << argv[0] << " pair [queues] [seconds]" << std::endl;
+        std::cerr << "       " << argv[0] << " macvlan <dev> <socket|packet_ring|mmsg|io_uring> [fanout] [seconds]" << std::endl;
+        return 1;
+    }
+    double pps = measure(seconds);
+    stop.store(true);
+    source.join();
+    std::cout.rdbuf(log);
+    std::cout << device << (device == "macvlan" ? std::string(" ") + argv[3] : "") << " rx: "
+        << uint64_t(pps) << " pps" << std::endl;
+    if (target != nullptr) {
+        auto stats = target->get_stats();
+        std::cout << "device rx: " << stats.rx << ", drops: " << stats.drops << std::endl;
+    }
+    // stack threads run forever, skip their destructors
+    _exit(0);
+}
@@ -29,12 +29,12 @@ def::network_protocol arp::get_protocol() {
     return def::network_protocol::arp;
 }
 
-bool arp::pack_flow(flow::sk_buff::ptr buffer) {
+bool arp::pack_flow(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
 // unpack flow
-bool arp::unpack_flow(flow::sk_buff::ptr buffer) {
+bool arp::unpack_flow(flow::sk_buff::ptr& buffer) {
     // get arp header
     auto hdr = reinterpret_cast<const flow::arp_hdr*>(buffer->get_data());
     if (hdr == nullptr) 
@@ -53,7 +53,7 @@ bool arp::unpack_flow(flow::sk_buff::ptr buffer) {
 }
 
 // handle arp request
-bool arp::handle_arp_request(flow::sk_buff::ptr buffer) {
+bool arp::handle_arp_request(const flow::sk_buff::ptr& buffer) {
     auto req_hdr = reinterpret_cast<const flow::arp_hdr*>(buffer->get_data());
     // check target ip 
     if (ntohl(req_hdr->dst_ip) != def::global_def_ip) {
@@ -74,13 +74,19 @@ bool arp::handle_arp_request(flow::sk_buff::ptr buffer) {
     resp_hdr->protocol = req_hdr->protocol;
     resp_hdr->protocol_len = req_hdr->protocol_len;
     resp_hdr->operator_code = htons(uint16_t(def::arp_op_code::reply));
-    // check if device has expired
-    if (buffer->dev.expired()) {
-        std::cout << "device has expired" << std::endl;
+    // check if stack has expired
+    if (stack_.expired()) {
+        std::cout << "stack has expired" << std::endl;
+        return false;
+    }
+    // get stack
+    auto stack = stack_.lock();
+    // check if device exist
+    auto dev = stack->get_device(buffer->dev_index);
+    if (dev == nullptr) {
+        std::cout << "device not exist" << std::endl;
         return false;
     }
-    // get device
-    auto dev = buffer->dev.lock();
     // copy source device info
     resp_hdr->src_ip = htonl(dev->get_device_ip());
     memcpy(resp_hdr->src_mac, dev->get_device_mac(), def::mac_len);
@@ -93,22 +99,15 @@ bool arp::handle_arp_request(flow::sk_buff::ptr buffer) {
     std::array<uint8_t, def::mac_len> mac_address;
     memcpy(mac_address.data(), req_hdr->src_mac, def::mac_len);
     resp_buffer->dst = mac_address;
-    
-    // check if stack has expired
-    if (buffer->stack.expired()) {
-        std::cout << "stack has expired" << std::endl;
-        return false;
-    }
-    // get stack
-    auto stack = buffer->stack.lock();
-    stack->update_neighbor(req_hdr, dev);
+    resp_buffer->dev_index = buffer->dev_index;
+    stack->update_neighbor(req_hdr, dev.get());
     stack->write_to_device(resp_buffer);
 
     return false;
 }
 
 // handle arp response
-bool arp::handle_arp_response(flow::sk_buff::ptr buffer) {
+bool arp::handle_arp_response(const flow::sk_buff::ptr& buffer) {
     auto resp_hdr = reinterpret_cast<const flow::arp_hdr*>(buffer->get_data());
     // check target ip
     if (ntohl(resp_hdr->dst_ip) != def::global_def_ip) {
@@ -117,13 +116,13 @@ bool arp::handle_arp_response(flow::sk_buff::ptr buffer) {
     std::cout << "handle arp response, src: " << utils::generic::format_ip_address(ntohl(resp_hdr->src_ip))
         << ", dst: " << utils::generic::format_ip_address(ntohl(resp_hdr->dst_ip)) << std::endl;
     // check if stack has expired
-    if (buffer->stack.expired()) {
+    if (stack_.expired()) {
         std::cout << "stack has expired" << std::endl;
         return false;
     }
     // get stack
-    auto stack = buffer->stack.lock();
-    stack->update_neighbor(resp_hdr, buffer->dev.lock());
+    auto stack = stack_.lock();
+    stack->update_neighbor(resp_hdr, stack->get_device(buffer->dev_index).get());
     return false;
 }
 
@@ -155,7 +154,7 @@ bool arp::send_arp_request(uint32_t ip, interface::net_device::ptr dev) {
     memcpy(mac_address.data(), def::broadcast_mac, def::mac_len);
     buffer->dst = mac_address;
     // store device
-    buffer->dev = dev;
+    buffer->dev_index = dev->get_device_ifindex();
     // check if stack has expired
     if (stack_.expired()) {
         std::cout << "stack has expired" << std::endl;
@@ -51,14 +51,14 @@ public:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr buffer);
+    virtual bool pack_flow(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief package flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool unpack_flow(flow::sk_buff::ptr buffer);
+    virtual bool unpack_flow(flow::sk_buff::ptr& buffer);
 
 private:
     /**
@@ -73,14 +73,14 @@ private:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool handle_arp_request(flow::sk_buff::ptr buffer);
+    bool handle_arp_request(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle arp response
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool handle_arp_response(flow::sk_buff::ptr buffer);
+    bool handle_arp_response(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief send arp request
@@ -108,7 +108,7 @@ public:
      */
     neighbor() = delete;
 
-    static neighbor::ptr create(uint32_t ip, const uint8_t* mac, interface::net_device::ptr dev) {
+    static neighbor::ptr create(uint32_t ip, const uint8_t* mac, interface::net_device* dev) {
         auto neigh = neighbor::ptr(new neighbor(ip, mac, dev));
         return neigh;
     }
@@ -122,7 +122,7 @@ public:
 
 private:
     // create 
-    neighbor(uint32_t ip, const uint8_t* mac, interface::net_device::ptr dev) {
+    neighbor(uint32_t ip, const uint8_t* mac, interface::net_device* dev) {
         ip_address = ip;
         memcpy(mac_address, mac, def::mac_len);
         device = dev;
@@ -133,8 +133,8 @@ public:
     uint32_t ip_address;
     /// store neigh mac
     uint8_t mac_address[def::mac_len];
-    /// output device 
-    interface::net_device::ptr device;
+    /// output device, owned by stack
+    interface::net_device* device;
 };
 
 /**
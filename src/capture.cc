@@ -0,0 +1,165 @@
+#include "capture.hpp"
+#include "def.hpp"
+#include "flow.hpp"
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <variant>
+
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+namespace driver {
+
+capture_device::capture_device(interface::net_device::ptr device, pcap_writer::ptr writer, const capture_device_config& config)
+    : device_(device), writer_(writer), config_(config) {
+}
+
+bool capture_device::up() {
+    return device_->up();
+}
+
+bool capture_device::down() {
+    bool result = device_->down();
+    writer_->flush();
+    return result;
+}
+
+// read buffer from wrapped device
+flow::sk_buff::ptr capture_device::read_from_device() {
+    auto buffer = device_->read_from_device();
+    if (config_.rx && buffer != nullptr)
+        capture_rx(buffer);
+    return buffer;
+}
+
+// write buffer to wrapped device
+int capture_device::write_to_device(const flow::sk_buff::ptr& buffer) {
+    if (config_.tx)
+        capture_tx(buffer);
+    return device_->write_to_device(buffer);
+}
+
+// read buffer batch from wrapped device
+size_t capture_device::read_from_device(flow::skb_batch& batch) {
+    size_t begin = batch.size();
+    size_t count = device_->read_from_device(batch);
+    if (config_.rx) {
+        for (size_t index = begin; index < batch.size(); index++)
+            capture_rx(batch[index]);
+    }
+    return count;
+}
+
+// write buffer batch to wrapped device
+int capture_device::write_to_device(flow::skb_batch& batch) {
+    if (config_.tx) {
+        for (auto& buffer : batch)
+            capture_tx(buffer);
+    }
+    return device_->write_to_device(batch);
+}
+
+// get wrapped device mac
+uint8_t* capture_device::get_device_mac() {
+    return device_->get_device_mac();
+}
+
+// get wrapped device ip
+uint32_t capture_device::get_device_ip() {
+    return device_->get_device_ip();
+}
+
+// get wrapped device index
+uint8_t capture_device::get_device_ifindex() {
+    return device_->get_device_ifindex();
+}
+
+// get wrapped device queue count
+uint32_t capture_device::get_queue_count() {
+    return device_->get_queue_count();
+}
+
+// read buffer batch from one queue of wrapped device
+size_t capture_device::read_from_queue(uint32_t queue, flow::skb_batch& batch) {
+    size_t begin = batch.size();
+    size_t count = device_->read_from_queue(queue, batch);
+    if (config_.rx) {
+        for (size_t index = begin; index < batch.size(); index++)
+            capture_rx(batch[index]);
+    }
+    return count;
+}
+
+// get wrapped device gso size
+uint32_t capture_device::get_device_gso_size() {
+    return device_->get_device_gso_size();
+}
+
+void capture_device::read_thread() {
+    device_->read_thread();
+}
+
+void capture_device::write_thread() {
+    device_->write_thread();
+}
+
+void capture_device::read_queue_thread(uint32_t queue) {
+    device_->read_queue_thread(queue);
+}
+
+void capture_device::write_queue_thread(uint32_t queue) {
+    device_->write_queue_thread(queue);
+}
+
+bool capture_device::kernel_device_status() {
+    return device_->kernel_device_status();
+}
+
+bool capture_device::user_device_status() {
+    return device_->user_device_status();
+}
+
+// capture rx buffer
+void capture_device::capture_rx(const flow::sk_buff::ptr& buffer) {
+    // device pull ether header only, it is still in front of network header
+    if (buffer->data_begin < buffer->network_offset || buffer->network_offset < flow::get_ether_offset())
+        return;
+    auto hdr = reinterpret_cast<const flow::ether_hdr*>(buffer->data + buffer->network_offset - flow::get_ether_offset());
+    write_frame(hdr, buffer);
+}
+
+// capture tx buffer
+void capture_device::capture_tx(const flow::sk_buff::ptr& buffer) {
+    // neighbor is resolved before stack write to device
+    if (!std::holds_alternative<std::array<uint8_t, def::mac_len>>(buffer->dst))
+        return;
+    struct flow::ether_hdr hdr;
+    hdr.protocol = htons(buffer->protocol);
+    memcpy(hdr.src, device_->get_device_mac(), def::mac_len);
+    memcpy(hdr.dst, std::get<std::array<uint8_t, def::mac_len>>(buffer->dst).data(), def::mac_len);
+    write_frame(&hdr, buffer);
+}
+
+// write frame to pcap file
+void capture_device::write_frame(const struct flow::ether_hdr* hdr, const flow::sk_buff::ptr& buffer) {
+    struct iovec iov[def::max_skb_frags + 2];
+    int iov_count = 0;
+    iov[iov_count].iov_base = const_cast<flow::ether_hdr*>(hdr);
+    iov[iov_count++].iov_len = sizeof(struct flow::ether_hdr);
+    iov[iov_count].iov_base = buffer->get_data();
+    iov[iov_count++].iov_len = buffer->get_data_len();
+    if (flow::skb_is_nonlinear(buffer)) {
+        for (auto& frag : buffer->ext->frags) {
+            if (iov_count > def::max_skb_frags + 1)
+                break;
+            iov[iov_count].iov_base = frag.page->data + frag.offset;
+            iov[iov_count++].iov_len = frag.len;
+        }
+    }
+    if (!writer_->write_frame(iov, iov_count))
+        std::cout << "write capture frame failed, ifindex: " << (int)device_->get_device_ifindex() << std::endl;
+}
+
+}
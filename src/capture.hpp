@@ -0,0 +1,194 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "interface.hpp"
+#include "pcap.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace driver {
+
+/**
+ * @file capture.hpp
+ * @brief capture device config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct capture_device_config {
+    /// capture frames read by stack
+    bool rx = true;
+    /// capture frames written by stack
+    bool tx = true;
+};
+
+/**
+ * @file capture.hpp
+ * @brief wrap any device and write its rx and tx frames to pcap file, register it instead of wrapped device
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class capture_device: public interface::net_device, public std::enable_shared_from_this<capture_device> {
+public:
+    typedef std::shared_ptr<capture_device> ptr;
+
+    /**
+     * @brief Construct a new capture device object
+     * @param[in] device wrapped device
+     * @param[in] writer pcap file, may be shared by devices
+     * @param[in] config capture direction
+     */
+    capture_device(interface::net_device::ptr device, pcap_writer::ptr writer, const capture_device_config& config = {});
+
+    /**
+     * @brief Destroy the capture device object
+     */
+    virtual ~capture_device() = default;
+
+    /**
+     * @brief up wrapped device
+     * @return true if success
+     */
+    virtual bool up();
+
+    /**
+     * @brief down wrapped device and flush file
+     * @return true if success
+     */
+    virtual bool down();
+
+    /**
+     * @brief read from wrapped device and capture buffer
+     * @return read buffer
+     */
+    virtual flow::sk_buff::ptr read_from_device();
+
+    /**
+     * @brief capture buffer and write to wrapped device
+     * @param[in] buffer write buffer
+     * @return result of wrapped device
+     */
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief read batch from wrapped device and capture buffers
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch);
+
+    /**
+     * @brief capture buffers and write batch to wrapped device
+     * @param[in] batch write buffers
+     * @return result of wrapped device
+     */
+    virtual int write_to_device(flow::skb_batch& batch);
+
+    /**
+     * @brief get net_device mac
+     * @return device mac
+     */
+    virtual uint8_t* get_device_mac();
+
+    /**
+     * @brief get net_device ip
+     * @return device ip
+     */
+    virtual uint32_t get_device_ip();
+
+    /**
+     * @brief get net_device ifindex
+     * @return device ifindex
+     */
+    virtual uint8_t get_device_ifindex();
+
+    /**
+     * @brief get queue count of wrapped device
+     * @return queue count
+     */
+    virtual uint32_t get_queue_count();
+
+    /**
+     * @brief read batch from one queue of wrapped device and capture buffers
+     * @param[in] queue queue index
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_queue(uint32_t queue, flow::skb_batch& batch);
+
+    /**
+     * @brief get max super frame of wrapped device, super frame is captured unsegmented
+     * @return max frame size
+     */
+    virtual uint32_t get_device_gso_size();
+
+public:
+    /**
+     * @brief run read thread of wrapped device
+     */
+    virtual void read_thread();
+
+    /**
+     * @brief run write thread of wrapped device
+     */
+    virtual void write_thread();
+
+    /**
+     * @brief run read thread of one queue of wrapped device
+     * @param[in] queue queue index
+     */
+    virtual void read_queue_thread(uint32_t queue);
+
+    /**
+     * @brief run write thread of one queue of wrapped device
+     * @param[in] queue queue index
+     */
+    virtual void write_queue_thread(uint32_t queue);
+
+    /**
+     * @brief get wrapped device status from kernel status
+     * @return bool device status
+     */
+    virtual bool kernel_device_status();
+
+    /**
+     * @brief get wrapped device status from user status
+     * @return bool device status
+     */
+    virtual bool user_device_status();
+
+private:
+    /**
+     * @brief write rx buffer, ether header still lie before network header
+     * @param[in] buffer buffer, start at network header
+     */
+    void capture_rx(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief write tx buffer with ether header built from buffer info, wrapped device push its own later
+     * @param[in] buffer buffer, start at network header
+     */
+    void capture_tx(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief write ether header, linear data and payload segments as one frame
+     * @param[in] hdr ether header
+     * @param[in] buffer buffer, start at network header
+     */
+    void write_frame(const struct flow::ether_hdr* hdr, const flow::sk_buff::ptr& buffer);
+
+private:
+    /// wrapped device
+    interface::net_device::ptr device_;
+    /// pcap file
+    pcap_writer::ptr writer_;
+    /// capture direction
+    capture_device_config config_;
+};
+
+
+}
+
+#endif // __CAPTURE_H__
@@ -0,0 +1,162 @@
+#include "census.hpp"
+#include "def.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace flow {
+
+namespace {
+
+// owner name used in report
+const char* owner_name[def::skb_owner_count] = { "none", "device_rx", "device_tx", "stack",
+    "ip_defrag", "sock_read", "sock_write", "tcp_retransmit", "shared" };
+
+/**
+ * @file census.cc
+ * @brief per thread counters, only owner thread write, never deleted so late reader stays valid
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct thread_census {
+    /// buffer count of each owner
+    std::atomic<int64_t> count[def::skb_owner_count] = {};
+    /// buffer bytes of each owner
+    std::atomic<int64_t> bytes[def::skb_owner_count] = {};
+};
+
+/// registry mutex
+std::mutex registry_mutex;
+/// all thread counters, used for census
+std::vector<thread_census*> registry;
+
+/// live list mutex, only taken in tracking mode
+std::mutex live_mutex;
+/// live list head
+skb_census_node* live_head = nullptr;
+/// age in ms reported as leak
+uint32_t leak_age = def::skb_leak_age;
+
+/**
+ * @brief get current thread counters
+ * @return thread counters
+ */
+thread_census* local_census() {
+    static thread_local thread_census* census = [] {
+        auto census = new thread_census();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(census);
+        return census;
+    }();
+    return census;
+}
+
+/**
+ * @brief get monotonic time
+ * @return time in ms
+ */
+uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+std::atomic<bool> skb_census::tracking_ { false };
+
+// account buffer to owner
+void skb_census::account(def::skb_owner owner, int64_t count, int64_t bytes) {
+    auto census = local_census();
+    auto index = uint8_t(owner);
+    // single writer, skip atomic rmw
+    census->count[index].store(census->count[index].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    census->bytes[index].store(census->bytes[index].load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+// enable tracking mode
+void skb_census::enable_tracking(uint32_t max_age) {
+    std::lock_guard<std::mutex> lock(live_mutex);
+    leak_age = max_age;
+    tracking_.store(true, std::memory_order_relaxed);
+}
+
+// disable tracking mode
+void skb_census::disable_tracking() {
+    tracking_.store(false, std::memory_order_relaxed);
+}
+
+// link buffer to live list
+void skb_census::track(skb_census_node* node, const void* buffer, const uint8_t* owner, size_t size) {
+    node->buffer = buffer;
+    node->owner = owner;
+    node->size = size;
+    node->alloc_time = now_ms();
+    node->pre = nullptr;
+    std::lock_guard<std::mutex> lock(live_mutex);
+    node->next = live_head;
+    if (live_head != nullptr)
+        live_head->pre = node;
+    live_head = node;
+    node->linked = true;
+}
+
+// unlink buffer from live list
+void skb_census::untrack(skb_census_node* node) {
+    std::lock_guard<std::mutex> lock(live_mutex);
+    if (!node->linked)
+        return;
+    if (node->pre != nullptr)
+        node->pre->next = node->next;
+    else
+        live_head = node->next;
+    if (node->next != nullptr)
+        node->next->pre = node->pre;
+    node->linked = false;
+}
+
+// get census of all threads
+skb_census_stats skb_census::get_stats() {
+    skb_census_stats stats = {};
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto census : registry) {
+            for (uint8_t index = 0; index < def::skb_owner_count; index++) {
+                stats[index].count += census->count[index].load(std::memory_order_relaxed);
+                stats[index].bytes += census->bytes[index].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    // buffers are pushed at head, oldest one of each owner is the last seen
+    auto now = now_ms();
+    std::lock_guard<std::mutex> lock(live_mutex);
+    for (auto node = live_head; node != nullptr; node = node->next) {
+        auto index = std::min<uint8_t>(*node->owner, def::skb_owner_count - 1);
+        stats[index].oldest_age = now - node->alloc_time;
+    }
+    return stats;
+}
+
+// print leaked buffers
+size_t skb_census::report_leaks() {
+    size_t leaks = 0;
+    auto now = now_ms();
+    std::lock_guard<std::mutex> lock(live_mutex);
+    for (auto node = live_head; node != nullptr; node = node->next) {
+        auto age = now - node->alloc_time;
+        if (age < leak_age)
+            continue;
+        auto index = std::min<uint8_t>(*node->owner, def::skb_owner_count - 1);
+        std::cout << "skb leak, buffer: " << node->buffer << ", owner: " << owner_name[index]
+            << ", size: " << std::dec << node->size << ", age: " << age << "ms" << std::endl;
+        leaks++;
+    }
+    return leaks;
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef __CENSUS_H__
+#define __CENSUS_H__
+
+#include "def.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace flow {
+
+/**
+ * @file census.hpp
+ * @brief live buffer link, stored in sk buff cold fields when tracking enabled
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_census_node {
+    /// pre tracked buffer
+    skb_census_node* pre;
+    /// next tracked buffer
+    skb_census_node* next;
+    /// tracked buffer
+    const void* buffer;
+    /// owner tag in tracked buffer
+    const uint8_t* owner;
+    /// buffer footprint
+    size_t size;
+    /// alloc time in ms
+    uint64_t alloc_time;
+    /// node is in live list
+    bool linked;
+};
+
+/**
+ * @file census.hpp
+ * @brief in flight buffers of one owner
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_owner_stats {
+    /// live buffer count
+    int64_t count;
+    /// live buffer footprint
+    int64_t bytes;
+    /// age in ms of oldest tracked buffer, 0 if tracking disabled
+    uint64_t oldest_age;
+};
+
+/// in flight buffers of all owners, index by def::skb_owner
+typedef std::array<skb_owner_stats, def::skb_owner_count> skb_census_stats;
+
+/**
+ * @file census.hpp
+ * @brief in flight buffer accounting, count and bytes are always kept per thread,
+ *  buffer age is only kept in tracking mode
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class skb_census {
+public:
+    /**
+     * @brief account buffer to owner in current thread
+     * @param[in] owner buffer owner
+     * @param[in] count buffer count delta
+     * @param[in] bytes buffer footprint delta
+     */
+    static void account(def::skb_owner owner, int64_t count, int64_t bytes);
+
+    /**
+     * @brief buffers allocated from now on are tracked in live list
+     * @param[in] max_age age in ms of live buffer reported as leak
+     */
+    static void enable_tracking(uint32_t max_age = def::skb_leak_age);
+
+    /**
+     * @brief stop tracking new buffers, tracked buffers are unlinked when freed
+     */
+    static void disable_tracking();
+
+    /**
+     * @brief check if tracking mode is enabled
+     * @return true if enabled
+     */
+    static bool tracking() {
+        return tracking_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief link buffer to live list
+     * @param[in] node census node of buffer
+     * @param[in] buffer sk buffer
+     * @param[in] owner owner tag of buffer
+     * @param[in] size buffer footprint
+     */
+    static void track(skb_census_node* node, const void* buffer, const uint8_t* owner, size_t size);
+
+    /**
+     * @brief unlink buffer from live list
+     * @param[in] node census node of buffer
+     */
+    static void untrack(skb_census_node* node);
+
+    /**
+     * @brief get in flight buffers of all threads
+     * @return census of each owner
+     */
+    static skb_census_stats get_stats();
+
+    /**
+     * @brief print tracked buffers older than max age
+     * @return leaked buffer count
+     */
+    static size_t report_leaks();
+
+private:
+    /**
+     * @brief not allow to create census obj
+     */
+    skb_census() = delete;
+
+private:
+    /// tracking mode
+    static std::atomic<bool> tracking_;
+};
+
+}
+
+#endif // __CENSUS_H__
@@ -0,0 +1,362 @@
+#include "checksum.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+namespace flow {
+
+namespace {
+
+/**
+ * @brief add with end around carry
+ * @param[in] sum sum
+ * @param[in] value value
+ * @return sum
+ */
+inline uint64_t add_carry(uint64_t sum, uint64_t value) {
+    sum += value;
+    return sum + (sum < value);
+}
+
+/**
+ * @brief fold 64 bits sum into 16 bits
+ * @param[in] sum unfolded sum
+ * @return folded sum
+ */
+inline uint16_t fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+/**
+ * @brief sum tail in native order, odd byte is padded with 0
+ * @param[in] bytes data
+ * @param[in] len data len
+ * @param[in] sum last sum
+ * @return unfolded sum
+ */
+inline uint64_t sum_tail(const uint8_t* bytes, size_t len, uint64_t sum) {
+    // 64 bits words, carry is added back
+    while (len >= 8) {
+        uint64_t value;
+        memcpy(&value, bytes, sizeof(value));
+        sum = add_carry(sum, value);
+        bytes += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        sum = add_carry(sum, value);
+        bytes += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t value;
+        memcpy(&value, bytes, sizeof(value));
+        sum = add_carry(sum, value);
+        bytes += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        // pad byte keep memory order
+        uint8_t pad[2] = { bytes[0], 0 };
+        uint16_t value;
+        memcpy(&value, pad, sizeof(value));
+        sum = add_carry(sum, value);
+    }
+    return sum;
+}
+
+/**
+ * @brief copy and sum in native order
+ * @param[in] dst copy dst
+ * @param[in] src copy src
+ * @param[in] len data len
+ * @param[in] sum last sum
+ * @return unfolded sum
+ */
+inline uint64_t copy_sum_tail(uint8_t* dst, const uint8_t* src, size_t len, uint64_t sum) {
+    while (len >= 8) {
+        uint64_t value;
+        memcpy(&value, src, sizeof(value));
+        memcpy(dst, &value, sizeof(value));
+        sum = add_carry(sum, value);
+        src += 8;
+        dst += 8;
+        len -= 8;
+    }
+    // short tail is summed from dst after copy
+    memcpy(dst, src, len);
+    return sum_tail(dst, len, sum);
+}
+
+#ifdef CHECKSUM_X86
+
+// sse2 kernel, 32 bits words are widen to 64 bits lanes so lanes never overflow
+__attribute__((target("sse2")))
+uint16_t sum_sse2(const char* buf, size_t len) {
+    auto bytes = reinterpret_cast<const uint8_t*>(buf);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    while (len >= 32) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(first, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(first, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(second, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(second, zero));
+        bytes += 32;
+        len -= 32;
+    }
+    uint64_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 2), acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(sum_tail(bytes, len, sum));
+}
+
+// avx2 kernel
+__attribute__((target("avx2")))
+uint16_t sum_avx2(const char* buf, size_t len) {
+    auto bytes = reinterpret_cast<const uint8_t*>(buf);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    while (len >= 64) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(first, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(first, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(second, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(second, zero));
+        bytes += 64;
+        len -= 64;
+    }
+    uint64_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 4), acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(sum_tail(bytes, len, sum));
+}
+
+// full lane mask, maskz forms zero fill instead of reading undefined register gcc warn about
+const __mmask8 avx512_full_mask = 0xff;
+
+// widen low 8 words of avx512 register to 64 bits lanes
+__attribute__((target("avx512f")))
+inline __m512i widen_low_avx512(__m512i value) {
+    return _mm512_maskz_cvtepu32_epi64(avx512_full_mask, _mm512_maskz_extracti64x4_epi64(avx512_full_mask, value, 0));
+}
+
+// widen high 8 words of avx512 register to 64 bits lanes
+__attribute__((target("avx512f")))
+inline __m512i widen_high_avx512(__m512i value) {
+    return _mm512_maskz_cvtepu32_epi64(avx512_full_mask, _mm512_maskz_extracti64x4_epi64(avx512_full_mask, value, 1));
+}
+
+// avx512 kernel
+__attribute__((target("avx512f")))
+uint16_t sum_avx512(const char* buf, size_t len) {
+    auto bytes = reinterpret_cast<const uint8_t*>(buf);
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    while (len >= 128) {
+        __m512i first = _mm512_loadu_si512(bytes);
+        __m512i second = _mm512_loadu_si512(bytes + 64);
+        acc0 = _mm512_add_epi64(acc0, widen_low_avx512(first));
+        acc1 = _mm512_add_epi64(acc1, widen_high_avx512(first));
+        acc0 = _mm512_add_epi64(acc0, widen_low_avx512(second));
+        acc1 = _mm512_add_epi64(acc1, widen_high_avx512(second));
+        bytes += 128;
+        len -= 128;
+    }
+    uint64_t lanes[16];
+    _mm512_storeu_si512(lanes, acc0);
+    _mm512_storeu_si512(lanes + 8, acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(sum_tail(bytes, len, sum));
+}
+
+// sse2 copy kernel
+__attribute__((target("sse2")))
+uint16_t copy_sum_sse2(char* dst, const char* src, size_t len) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    while (len >= 32) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), first);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), second);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(first, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(first, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(second, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(second, zero));
+        in += 32;
+        out += 32;
+        len -= 32;
+    }
+    uint64_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 2), acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(copy_sum_tail(out, in, len, sum));
+}
+
+// avx2 copy kernel
+__attribute__((target("avx2")))
+uint16_t copy_sum_avx2(char* dst, const char* src, size_t len) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    while (len >= 64) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), first);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), second);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(first, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(first, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(second, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(second, zero));
+        in += 64;
+        out += 64;
+        len -= 64;
+    }
+    uint64_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 4), acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(copy_sum_tail(out, in, len, sum));
+}
+
+// avx512 copy kernel
+__attribute__((target("avx512f")))
+uint16_t copy_sum_avx512(char* dst, const char* src, size_t len) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    while (len >= 128) {
+        __m512i first = _mm512_loadu_si512(in);
+        __m512i second = _mm512_loadu_si512(in + 64);
+        _mm512_storeu_si512(out, first);
+        _mm512_storeu_si512(out + 64, second);
+        acc0 = _mm512_add_epi64(acc0, widen_low_avx512(first));
+        acc1 = _mm512_add_epi64(acc1, widen_high_avx512(first));
+        acc0 = _mm512_add_epi64(acc0, widen_low_avx512(second));
+        acc1 = _mm512_add_epi64(acc1, widen_high_avx512(second));
+        in += 128;
+        out += 128;
+        len -= 128;
+    }
+    uint64_t lanes[16];
+    _mm512_storeu_si512(lanes, acc0);
+    _mm512_storeu_si512(lanes + 8, acc1);
+    uint64_t sum = 0;
+    for (auto lane : lanes)
+        sum = add_carry(sum, lane);
+    return fold(copy_sum_tail(out, in, len, sum));
+}
+
+#endif
+
+/**
+ * @file checksum.cc
+ * @brief kernels of one instruction set
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct kernel_set {
+    /// sum kernel
+    uint16_t (*sum)(const char*, size_t);
+    /// copy and sum kernel
+    uint16_t (*copy_sum)(char*, const char*, size_t);
+    /// instruction set name
+    const char* name;
+};
+
+/**
+ * @brief select kernels by cpu feature
+ * @return kernels
+ */
+kernel_set select_kernel() {
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return { sum_avx512, copy_sum_avx512, "avx512" };
+    if (__builtin_cpu_supports("avx2"))
+        return { sum_avx2, copy_sum_avx2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { sum_sse2, copy_sum_sse2, "sse2" };
+#endif
+    return { checksum_engine::sum_scalar, checksum_engine::copy_sum_scalar, "scalar" };
+}
+
+}
+
+std::atomic<uint16_t (*)(const char*, size_t)> checksum_engine::kernel_ { checksum_engine::resolve };
+
+std::atomic<uint16_t (*)(char*, const char*, size_t)> checksum_engine::copy_kernel_ { checksum_engine::resolve_copy };
+
+std::atomic<const char*> checksum_engine::kernel_name_ { nullptr };
+
+// select kernel
+uint16_t checksum_engine::resolve(const char* buf, size_t len) {
+    auto kernel = select_kernel();
+    kernel_name_.store(kernel.name, std::memory_order_relaxed);
+    kernel_.store(kernel.sum, std::memory_order_relaxed);
+    copy_kernel_.store(kernel.copy_sum, std::memory_order_relaxed);
+    return kernel.sum(buf, len);
+}
+
+// select copy kernel
+uint16_t checksum_engine::resolve_copy(char* dst, const char* src, size_t len) {
+    resolve(nullptr, 0);
+    return copy_kernel_.load(std::memory_order_relaxed)(dst, src, len);
+}
+
+// sum with scalar kernel
+uint16_t checksum_engine::sum_scalar(const char* buf, size_t len) {
+    return fold(sum_tail(reinterpret_cast<const uint8_t*>(buf), len, 0));
+}
+
+// copy and sum with scalar kernel
+uint16_t checksum_engine::copy_sum_scalar(char* dst, const char* src, size_t len) {
+    return fold(copy_sum_tail(reinterpret_cast<uint8_t*>(dst), reinterpret_cast<const uint8_t*>(src), len, 0));
+}
+
+// get selected kernel name
+const char* checksum_engine::get_kernel_name() {
+    if (kernel_name_.load(std::memory_order_relaxed) == nullptr)
+        resolve(nullptr, 0);
+    return kernel_name_.load(std::memory_order_relaxed);
+}
+
+}
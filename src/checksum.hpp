@@ -0,0 +1,104 @@
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include "def.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace flow {
+
+/**
+ * @file checksum.hpp
+ * @brief one's complement sum kernel, selected by cpu feature on first use
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ * @link https://datatracker.ietf.org/doc/html/rfc1071
+ */
+class checksum_engine {
+public:
+    /**
+     * @brief add data as 16 bits words, odd tail is padded with 0
+     * @param[in] buf data
+     * @param[in] len data len
+     * @return folded sum in native byte order, swap to get host order
+     */
+    static uint16_t sum(const char* buf, size_t len) {
+        // vector setup cost more than it save on short data, like headers
+        if (len < def::checksum_vector_min_len)
+            return sum_scalar(buf, len);
+        return kernel_.load(std::memory_order_relaxed)(buf, len);
+    }
+
+    /**
+     * @brief copy data and sum it in the same pass
+     * @param[in] dst copy dst
+     * @param[in] src copy src
+     * @param[in] len data len
+     * @return folded sum of copied data in native byte order
+     */
+    static uint16_t copy_sum(char* dst, const char* src, size_t len) {
+        if (len < def::checksum_vector_min_len)
+            return copy_sum_scalar(dst, src, len);
+        return copy_kernel_.load(std::memory_order_relaxed)(dst, src, len);
+    }
+
+    /**
+     * @brief get selected kernel name
+     * @return kernel name, like avx2
+     */
+    static const char* get_kernel_name();
+
+    /**
+     * @brief sum data with scalar kernel, used as reference and fallback
+     * @param[in] buf data
+     * @param[in] len data len
+     * @return folded sum in native byte order
+     */
+    static uint16_t sum_scalar(const char* buf, size_t len);
+
+    /**
+     * @brief copy and sum data with scalar kernel
+     * @param[in] dst copy dst
+     * @param[in] src copy src
+     * @param[in] len data len
+     * @return folded sum of copied data in native byte order
+     */
+    static uint16_t copy_sum_scalar(char* dst, const char* src, size_t len);
+
+private:
+    /**
+     * @brief not allow to create engine obj
+     */
+    checksum_engine() = delete;
+
+    /**
+     * @brief select kernel on first call, then forward
+     * @param[in] buf data
+     * @param[in] len data len
+     * @return folded sum in native byte order
+     */
+    static uint16_t resolve(const char* buf, size_t len);
+
+    /**
+     * @brief select copy kernel on first call, then forward
+     * @param[in] dst copy dst
+     * @param[in] src copy src
+     * @param[in] len data len
+     * @return folded sum of copied data in native byte order
+     */
+    static uint16_t resolve_copy(char* dst, const char* src, size_t len);
+
+private:
+    /// selected kernel, resolved on first call
+    static std::atomic<uint16_t (*)(const char* buf, size_t len)> kernel_;
+    /// selected copy kernel, resolved on first call
+    static std::atomic<uint16_t (*)(char* dst, const char* src, size_t len)> copy_kernel_;
+    /// selected kernel name
+    static std::atomic<const char*> kernel_name_;
+};
+
+}
+
+#endif // __CHECKSUM_H__
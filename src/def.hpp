@@ -34,6 +34,126 @@ enum class device_type {
     unknown = 10
 };
 
+/**
+ * @file def.h
+ * @brief device receive mode
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class device_rx_mode : uint8_t {
+    // one syscall per frame
+    socket,
+    // mmapped TPACKET_V3 ring, kernel fill blocks of frames
+    packet_ring,
+    // one recvmmsg per batch, for kernel not allow ring
+    mmsg,
+    // multishot recvmsg into pool buffers posted to io_uring, one thread reap rx and tx
+    io_uring,
+};
+
+/**
+ * @file def.h
+ * @brief af_xdp socket bind mode
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class xdp_bind_mode : uint8_t {
+    // kernel copy frame to umem, work on any device
+    copy,
+    // driver dma to umem, fall back to copy if not supported
+    zero_copy,
+};
+
+/**
+ * @file def.h
+ * @brief device transmit mode
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class device_tx_mode : uint8_t {
+    // one syscall per frame
+    socket,
+    // one sendmmsg per batch
+    mmsg,
+    // mmapped TPACKET_V2 ring, kernel is kicked once per batch
+    packet_ring,
+    // sendmsg queued to io_uring of rx thread, need io_uring rx mode
+    io_uring,
+};
+
+/**
+ * @file def.h
+ * @brief how kernel spread frames over sockets of one fanout group
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class fanout_mode : uint8_t {
+    // kernel flow hash, flow stay on one socket but hash differ from stack
+    hash,
+    // cpu frame is received on
+    cpu,
+    // bundled program, same hash as stack flow hash
+    ebpf,
+};
+
+/**
+ * @file def.h
+ * @brief how pcap device pace replayed frames
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class replay_mode : uint8_t {
+    // as fast as stack take them
+    fast,
+    // keep gap between frames of capture
+    timed,
+};
+
+/**
+ * @file def.h
+ * @brief traffic class of replayed frame, pps is counted per class
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class traffic_class : uint8_t {
+    arp,
+    // any fragment of ip package
+    ip_fragment,
+    // syn without ack
+    tcp_syn,
+    tcp,
+    udp,
+    icmp,
+    other,
+    max
+};
+
+/**
+ * @file def.h
+ * @brief virtio net header flags, exchanged with tap before frame
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class vnet_hdr_flag : uint8_t {
+    // checksum from csum start is not filled, field hold pseudo header sum
+    needs_csum = 1,
+    // checksum is verified by kernel
+    data_valid = 2,
+};
+
+/**
+ * @file def.h
+ * @brief virtio net header segmentation type
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class vnet_gso_type : uint8_t {
+    // frame fit in mtu
+    none = 0,
+    // tcp over ipv4 super frame
+    tcpv4 = 1,
+};
+
 /**
  * @file def.h
  * @brief hardware type
@@ -126,6 +246,40 @@ enum class sock_op_flag : uint8_t {
     non_block
 };
 
+/**
+ * @file def.h
+ * @brief checksum state of sk buff
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class checksum_state : uint8_t {
+    // nothing is summed
+    none,
+    // payload is summed on copy, header is not included
+    partial,
+    // transport checksum is verified by kernel or device
+    unnecessary,
+};
+
+/**
+ * @file def.h
+ * @brief layer or queue hold sk buff, used by buffer census
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+enum class skb_owner : uint8_t {
+    none,
+    device_rx,
+    device_tx,
+    stack,
+    ip_defrag,
+    sock_read,
+    sock_write,
+    tcp_retransmit,
+    shared,
+    max
+};
+
 struct netlink_request {
     struct nlmsghdr hdr;
     struct ifinfomsg info;
@@ -147,12 +301,87 @@ const uint8_t ip_time_to_live = 64;
 // ip flag offset
 const uint8_t ip_flag_offset = 13;
 
+// cpu cache line size
+const uint8_t cache_line_size = 64;
+
 // ether package size
 const uint32_t flow_buffer_size = 65535;
 
+// max payload segments gathered in one device write
+const uint8_t max_skb_frags = 48;
+
+// payload segments kept in cold fields before spill to heap, clone and segment use one or two
+const uint8_t skb_inline_frags = 4;
+
+// initial slots of growable buffer queue, it double when full and never shrink
+const uint16_t skb_queue_init_size = 64;
+
+// default device mtu
+const uint16_t default_mtu = 1500;
+
+// headroom reserved before ether header of rx buffer, used by in place reply
+const uint16_t skb_rx_headroom = 64;
+
+// max buffers passed between layers in one call
+const uint8_t max_skb_batch = 32;
+
+// sk buff pool size class count
+const uint8_t skb_pool_class_count = 6;
+
+// hugepage size used by packet buffer arena
+const uint32_t hugepage_size = 2 << 20;
+
+// headroom of clone, enough for all headers
+const uint16_t skb_clone_headroom = 14 + 60 + 60;
+
+// af_xdp umem chunk, equal to pool block class so one buffer fill one chunk
+const uint32_t xdp_chunk_size = 2048;
+
+// max super frame passed to device with segmentation offload, bound by ip total length
+const uint32_t max_gso_size = 65535;
+
+// io_uring buffer group of rx buffers
+const uint16_t uring_rx_buffer_group = 0;
+
+// pcap file magic, usec and nsec timestamp
+const uint32_t pcap_magic_usec = 0xa1b2c3d4;
+const uint32_t pcap_magic_nsec = 0xa1b23c4d;
+
+// pcapng section header block type, also the first word of file
+const uint32_t pcapng_section_block = 0x0a0d0d0a;
+
+// pcapng byte order magic in section header
+const uint32_t pcapng_byte_order_magic = 0x1a2b3c4d;
+
+// pcapng interface, simple packet and enhanced packet block type
+const uint32_t pcapng_interface_block = 1;
+const uint32_t pcapng_simple_block = 3;
+const uint32_t pcapng_enhanced_block = 6;
+
+// pcap link type of ether frame
+const uint16_t pcap_linktype_ether = 1;
+
+// pcap snap len, large enough for tso super frame
+const uint32_t pcap_snap_len = 262144;
+
+// traffic class count
+const uint8_t traffic_class_count = uint8_t(traffic_class::max);
+
+// sk buff owner count
+const uint8_t skb_owner_count = uint8_t(skb_owner::max);
+
+// default age in ms of live sk buff reported as leak
+const uint32_t skb_leak_age = 5000;
+
 // ether broadcast mac address
 const uint8_t broadcast_mac[mac_len] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 
+// limited broadcast ip address
+const uint32_t broadcast_ip = 0xffffffff;
+
+// multicast ip prefix, top 4 bits of 224.0.0.0/4
+const uint8_t multicast_ip_prefix = 0xe;
+
 // global def ip
 // const uint32_t global_def_ip = 0xc0a879fd;
 const uint32_t global_def_ip = 0xac1100fd;
@@ -169,6 +398,9 @@ const uint8_t ip_frag_offset_base = 8;
 // checksum max num
 const uint16_t checksum_max_num = 0xffff;
 
+// min data len summed by vector checksum kernel
+const uint16_t checksum_vector_min_len = 256;
+
 // max arp header
 const uint8_t max_arp_header = 28;
 
@@ -181,8 +413,8 @@ const uint8_t max_ether_header = 14;
 // max tcp header
 const uint8_t max_tcp_header = 60;
 
-// max udp header should include fake header
-const uint8_t max_udp_header = 8 + 12;
+// max udp header
+const uint8_t max_udp_header = 8;
 
 // max transport wait time
 const uint8_t max_transport_wait_time = 10;
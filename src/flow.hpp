@@ -1,12 +1,15 @@
 #ifndef __FLOW_H__
 #define __FLOW_H__
 
+#include "census.hpp"
+#include "checksum.hpp"
 #include "def.hpp"
+#include "pool.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
-#include <any>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -17,6 +20,7 @@
 #include <vector>
 
 #include <netinet/in.h>
+#include <sys/uio.h>
 
 // pre define interface
 namespace interface {
@@ -31,68 +35,289 @@ namespace flow_table {
 
 namespace flow {
 
+struct sk_buff;
+
 /**
  * @file flow.hpp
- * @brief sk buff to store flow
+ * @brief intrusive sk buff handle, refcount is stored in sk buff
  * @author ArisAachen
  * @copyright Copyright (c) 2024 aris All rights reserved
  */
-struct sk_buff {
-    // weak pointer
-    typedef std::weak_ptr<sk_buff> weak_ptr;
-    // share pointer
-    typedef std::shared_ptr<sk_buff> ptr;
+class skb_ptr {
+public:
+    skb_ptr() : buffer_(nullptr) {}
+    skb_ptr(std::nullptr_t) : buffer_(nullptr) {}
+
+    /**
+     * @brief hold new reference of buffer
+     * @param[in] buffer sk buffer
+     */
+    explicit skb_ptr(sk_buff* buffer);
+
+    skb_ptr(const skb_ptr& other);
+    skb_ptr(skb_ptr&& other) noexcept : buffer_(other.buffer_) { other.buffer_ = nullptr; }
+
+    /**
+     * @brief drop reference, free buffer if is the last one
+     */
+    ~skb_ptr();
+
+    skb_ptr& operator=(const skb_ptr& other) {
+        skb_ptr(other).swap(*this);
+        return *this;
+    }
+
+    skb_ptr& operator=(skb_ptr&& other) noexcept {
+        skb_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    skb_ptr& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    sk_buff* operator->() const { return buffer_; }
+    sk_buff& operator*() const { return *buffer_; }
+    sk_buff* get() const { return buffer_; }
+    explicit operator bool() const { return buffer_ != nullptr; }
+
+    bool operator==(const skb_ptr& other) const { return buffer_ == other.buffer_; }
+    bool operator!=(const skb_ptr& other) const { return buffer_ != other.buffer_; }
+    bool operator==(std::nullptr_t) const { return buffer_ == nullptr; }
+    bool operator!=(std::nullptr_t) const { return buffer_ != nullptr; }
+
+    /**
+     * @brief drop reference
+     */
+    void reset() { skb_ptr().swap(*this); }
+
+    /**
+     * @brief swap handle
+     * @param[in] other other handle
+     */
+    void swap(skb_ptr& other) noexcept { std::swap(buffer_, other.buffer_); }
+
+    /**
+     * @brief give up reference without drop
+     * @return sk buffer
+     */
+    sk_buff* detach() {
+        auto buffer = buffer_;
+        buffer_ = nullptr;
+        return buffer;
+    }
+
+private:
+    /// sk buffer
+    sk_buff* buffer_;
+};
 
-    /// include header len and data len
-    uint64_t total_len;
+/**
+ * @file flow.hpp
+ * @brief payload segment refer to shared data page, page is refcounted sk buff
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_frag {
+    /// buffer own the data
+    skb_ptr page;
+    /// data offset in page
+    uint16_t offset;
     /// data len
-    uint64_t data_len;
+    uint16_t len;
+};
 
-    /// block head
-    uint16_t block_head;
-    // block end
-    uint16_t block_end;
+/**
+ * @file flow.hpp
+ * @brief payload segments, first segments live in place so clone and segment dont touch heap
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class skb_frag_vec {
+public:
+    skb_frag_vec() : data_(inline_.data()), size_(0), capacity_(def::skb_inline_frags) {}
+    skb_frag_vec(const skb_frag_vec&) = delete;
+    skb_frag_vec& operator=(const skb_frag_vec&) = delete;
 
-    /// data begin
-    uint16_t data_begin;
-    /// data tail
-    uint16_t data_tail;
+    /**
+     * @brief append segment, segments move to heap when inline slots are used up
+     * @param[in] frag segment
+     */
+    void push_back(skb_frag frag) {
+        if (size_ == capacity_)
+            grow();
+        data_[size_++] = std::move(frag);
+    }
 
-    /// pre buffer elem
-    sk_buff::weak_ptr pre;
+    /**
+     * @brief remove segments in range, order is kept
+     * @param[in] first first segment
+     * @param[in] last segment after range
+     * @return segment after removed range
+     */
+    skb_frag* erase(skb_frag* first, skb_frag* last) {
+        auto tail = std::move(last, end(), first);
+        // drop page references of moved out slots
+        for (auto iter = tail; iter != end(); iter++)
+            iter->page.reset();
+        size_ = tail - data_;
+        return first;
+    }
+
+    skb_frag* erase(skb_frag* pos) { return erase(pos, pos + 1); }
+    void clear() { erase(begin(), end()); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    skb_frag& front() { return data_[0]; }
+    skb_frag& operator[](size_t index) { return data_[index]; }
+    skb_frag* begin() { return data_; }
+    skb_frag* end() { return data_ + size_; }
+    const skb_frag* begin() const { return data_; }
+    const skb_frag* end() const { return data_ + size_; }
+
+private:
+    /**
+     * @brief double capacity, only reassembled or merged buffer get here
+     */
+    void grow() {
+        size_t capacity = capacity_ * 2;
+        std::unique_ptr<skb_frag[]> heap(new skb_frag[capacity]);
+        std::move(begin(), end(), heap.get());
+        heap_ = std::move(heap);
+        data_ = heap_.get();
+        capacity_ = capacity;
+    }
+
+private:
+    /// inline segments
+    std::array<skb_frag, def::skb_inline_frags> inline_;
+    /// spilled segments
+    std::unique_ptr<skb_frag[]> heap_;
+    /// segments in use, inline or spilled
+    skb_frag* data_;
+    /// segment count
+    uint16_t size_;
+    /// slot count of data
+    uint16_t capacity_;
+};
+
+/**
+ * @file flow.hpp
+ * @brief packed flow identity, built on stack to look up sock without alloc
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct flow_key {
+    /// local ip
+    uint32_t local_ip;
+    /// remote ip
+    uint32_t remote_ip;
+    /// local port
+    uint16_t local_port;
+    /// remote port
+    uint16_t remote_port;
+    /// transport protocol
+    def::transport_protocol protocol;
+
+    bool operator==(const flow_key& other) const {
+        return local_ip == other.local_ip && remote_ip == other.remote_ip && local_port == other.local_port
+            && remote_port == other.remote_port && protocol == other.protocol;
+    }
+    bool operator!=(const flow_key& other) const { return !(*this == other); }
+};
+
+/**
+ * @file flow.hpp
+ * @brief sk buff cold fields, only alloc when needed
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct sk_buff_ext {
+    /// pre buffer elem, owned by list
+    sk_buff* pre;
     /// next buffer elem
-    sk_buff::ptr next;
-    
+    skb_ptr next;
+
+    /// sock key
+    std::shared_ptr<flow_table::sock_key> key;
+    /// rx flow identity, set by transport layer
+    flow_key flow;
+
+    /// ip fragment
+    sk_buff* parent_frag;
+    /// children fragments
+    std::vector<skb_ptr> child_frags;
+
+    /// payload segments after linear data
+    skb_frag_vec frags;
+
+    /// segment size device split payload by, 0 if buffer is sent as one frame
+    uint16_t gso_size;
+
+    /// linear data is referenced by clones, must not be written
+    bool cloned;
+
+    /// live list link, only linked in census tracking mode
+    skb_census_node census;
+};
+
+/**
+ * @file flow.hpp
+ * @brief sk buff to store flow, rx fast path fields fit in one cache line
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct alignas(def::cache_line_size) sk_buff {
+    friend class skb_ptr;
+    // intrusive pointer
+    typedef skb_ptr ptr;
+
+    /// reference count
+    std::atomic<uint32_t> refcnt;
     /// next layer protocol
     uint16_t protocol;
+    /// recv device index
+    uint8_t dev_index;
+    /// refcount only touched by one thread, skip atomic op
+    bool ref_local;
 
+    /// data begin
+    uint16_t data_begin;
+    /// data tail
+    uint16_t data_tail;
+    // block end
+    uint16_t block_end;
     /// device mtu and path mtu
     uint16_t mtu;
-    
-    /// other info
-    std::any info;
 
-    /// write dst 
-    std::variant<uint32_t, std::array<uint8_t, def::mac_len>> dst;
+    /// network header offset
+    uint16_t network_offset;
+    /// transport header offset
+    uint16_t transport_offset;
+    /// flow hash
+    uint32_t hash;
+
+    /// data len
+    uint32_t data_len;
 
     /// recv src 
     std::variant<uint32_t, std::array<uint8_t, def::mac_len>> src;
 
-    /// sock key
-    std::shared_ptr<flow_table::sock_key> key;
+    /// write dst 
+    std::variant<uint32_t, std::array<uint8_t, def::mac_len>> dst;
 
-    /// recv netdevice 
-    std::weak_ptr<interface::net_device> dev;
+    /// layer or queue hold buffer, see def::skb_owner
+    uint8_t owner;
+    /// checksum state, see def::checksum_state
+    uint8_t ip_summed;
+    /// payload sum in host order, valid if checksum state is partial
+    uint16_t csum;
 
-    /// stack 
-    std::weak_ptr<interface::stack> stack;
+    /// cold fields
+    sk_buff_ext* ext;
 
-    /// ip fragment
-    std::weak_ptr<sk_buff> parent_frag;
-    /// children fragments
-    std::vector<sk_buff::ptr> child_frags;
-
-    /// data 
+    /// data, start at cache line
     char data[0];
 
     /**
@@ -100,13 +325,23 @@ struct sk_buff {
      * @return sk_buff::ptr sk buff ptr
      */    
     static sk_buff::ptr alloc(size_t size) {
-        sk_buff::ptr buffer = sk_buff::ptr(new (size) sk_buff);
+        // only header is zeroed, data is left to protocol
+        auto memory = skb_pool::alloc(sizeof(struct sk_buff) + size);
+        if (memory == nullptr)
+            return nullptr;
+        sk_buff::ptr buffer = sk_buff::ptr(::new (memory) sk_buff());
         buffer->data_begin = 0;
         buffer->data_tail = 0;
         buffer->data_len = 0;
-        buffer->block_head = 0;
         buffer->block_end = size;
-        buffer->total_len = sizeof(struct sk_buff) + size;
+        // count in flight buffer, age is only kept in tracking mode
+        skb_census::account(def::skb_owner::none, 1, buffer->get_footprint());
+        if (skb_census::tracking()) {
+            auto ext = buffer->get_ext();
+            if (ext == nullptr)
+                return nullptr;
+            skb_census::track(&ext->census, buffer.get(), &buffer->owner, buffer->get_footprint());
+        }
         return buffer;
     }
 
@@ -120,6 +355,17 @@ struct sk_buff {
         data_len += size;
     }
 
+    /**
+     * @brief store data and sum it in the same pass, transport layer only sum header later
+     * @param[in] buf data
+     * @param[in] size data size
+     */
+    void store_data_checksum(const char* buf, size_t size) {
+        csum = ntohs(checksum_engine::copy_sum(data + data_begin, buf, size));
+        ip_summed = uint8_t(def::checksum_state::partial);
+        data_len += size;
+    }
+
     /**
      * @brief store data
      * @param[in] buf data
@@ -150,23 +396,99 @@ struct sk_buff {
         return data_tail - data_begin;
     }
 
+    /**
+     * @brief get buffer footprint
+     * @return header and data block size
+     */
+    size_t get_footprint() const {
+        return sizeof(struct sk_buff) + block_end;
+    }
+
+    /**
+     * @brief get cold fields, alloc if not exist
+     * @return cold fields, nullptr if out of memory
+     */
+    sk_buff_ext* get_ext() {
+        if (ext != nullptr)
+            return ext;
+        auto memory = skb_pool::alloc(sizeof(struct sk_buff_ext));
+        if (memory == nullptr)
+            return nullptr;
+        ext = ::new (memory) sk_buff_ext();
+        return ext;
+    }
+
     /**
      * @brief release buff
      */  
-    virtual ~sk_buff() {}
+    ~sk_buff() {
+        skb_census::account(def::skb_owner(owner), -1, -int64_t(get_footprint()));
+        if (ext == nullptr)
+            return;
+        if (ext->census.linked)
+            skb_census::untrack(&ext->census);
+        ext->~sk_buff_ext();
+        skb_pool::free(ext);
+    }
 
 private:
     /**
-     * @brief get data
-     * @return data or nullptr
-     */    
-    void* operator new(std::size_t sk_size, uint16_t alloc_size) {
-        auto buffer = malloc(sk_size + alloc_size);
-        memset(buffer, 0, sk_size + alloc_size);
-        return buffer;
+     * @brief add reference
+     */
+    void hold() {
+        if (ref_local)
+            refcnt.store(refcnt.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            refcnt.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief drop reference
+     * @return true if is the last reference
+     */
+    bool drop() {
+        if (ref_local) {
+            auto count = refcnt.load(std::memory_order_relaxed) - 1;
+            refcnt.store(count, std::memory_order_relaxed);
+            return count == 0;
+        }
+        return refcnt.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    /**
+     * @brief drop reference, free buffer and next chain without recursion
+     * @param[in] buffer sk buffer
+     */
+    static void release(sk_buff* buffer) {
+        while (buffer != nullptr && buffer->drop()) {
+            sk_buff* next = nullptr;
+            if (buffer->ext != nullptr)
+                next = buffer->ext->next.detach();
+            buffer->~sk_buff();
+            skb_pool::free(buffer);
+            buffer = next;
+        }
     }
 };
 
+// rx fast path fields should stay in one cache line
+static_assert(sizeof(struct sk_buff) == def::cache_line_size, "sk_buff metadata exceeds one cache line");
+static_assert(alignof(struct sk_buff) == def::cache_line_size, "sk_buff data is not cache line aligned");
+
+inline skb_ptr::skb_ptr(sk_buff* buffer) : buffer_(buffer) {
+    if (buffer_ != nullptr)
+        buffer_->hold();
+}
+
+inline skb_ptr::skb_ptr(const skb_ptr& other) : buffer_(other.buffer_) {
+    if (buffer_ != nullptr)
+        buffer_->hold();
+}
+
+inline skb_ptr::~skb_ptr() {
+    sk_buff::release(buffer_);
+}
+
 /**
  * @file flow.hpp
  * @brief flow head and tail
@@ -182,16 +504,22 @@ public:
     /**
      * @brief append sk buff to tail
      * @param[in] elem sk buff
+     * @return false if out of memory
      */
-    void append(sk_buff::ptr elem) {
+    bool append(const sk_buff::ptr& elem) {
         if (head == nullptr) {
             head = elem;
             tail = elem;
-        } else {
-            tail->next = elem;
-            elem->pre = tail;
-            tail = elem;
+            return true;
         }
+        auto elem_ext = elem->get_ext();
+        auto tail_ext = tail->get_ext();
+        if (elem_ext == nullptr || tail_ext == nullptr)
+            return false;
+        elem_ext->pre = tail.get();
+        tail_ext->next = elem;
+        tail = elem;
+        return true;
     }
 
     /**
@@ -203,11 +531,19 @@ public:
             return nullptr;
         }
         sk_buff::ptr elem = head;
-        head = head->next;
+        // single elem may have no cold fields
+        if (elem->ext == nullptr) {
+            head = nullptr;
+            tail = nullptr;
+            return elem;
+        }
+        head = elem->ext->next;
         if (head != nullptr) {
-            head->pre.reset();
+            head->ext->pre = nullptr;
+        } else {
+            tail = nullptr;
         }
-        elem->next.reset();
+        elem->ext->next.reset();
         return elem;
     }
 
@@ -227,6 +563,287 @@ private:
     sk_buff::ptr tail;
 };
 
+/**
+ * @file flow.hpp
+ * @brief fixed size buffer vector, packets are passed between layers per batch
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class skb_batch {
+public:
+    skb_batch() : count_(0) {}
+
+    /**
+     * @brief append buffer
+     * @param[in] buffer buffer
+     * @return false if batch is full
+     */
+    bool push(sk_buff::ptr buffer) {
+        if (full())
+            return false;
+        buffers_[count_++] = std::move(buffer);
+        return true;
+    }
+
+    /**
+     * @brief drop all buffers
+     */
+    void clear() {
+        for (size_t index = 0; index < count_; index++)
+            buffers_[index].reset();
+        count_ = 0;
+    }
+
+    /**
+     * @brief keep buffers fn return true, others are dropped, order is kept
+     * @param[in] fn filter
+     */
+    template <typename Fn>
+    void filter(Fn fn) {
+        size_t keep = 0;
+        for (size_t index = 0; index < count_; index++) {
+            if (!fn(buffers_[index])) {
+                buffers_[index].reset();
+                continue;
+            }
+            if (keep != index)
+                buffers_[keep] = std::move(buffers_[index]);
+            keep++;
+        }
+        count_ = keep;
+    }
+
+    /**
+     * @brief move buffers fn return true to dst, order is kept
+     * @param[in] dst dst batch, must have room
+     * @param[in] fn match
+     */
+    template <typename Fn>
+    void take_if(skb_batch& dst, Fn fn) {
+        filter([&](sk_buff::ptr& buffer) {
+            if (!fn(buffer) || dst.full())
+                return true;
+            dst.push(std::move(buffer));
+            return false;
+        });
+    }
+
+    /**
+     * @brief move all buffers to dst, buffers dst has no room for are kept
+     * @param[in] dst dst batch
+     */
+    void take_all(skb_batch& dst) {
+        take_if(dst, [] (sk_buff::ptr&) { return true; });
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == def::max_skb_batch; }
+    sk_buff::ptr& operator[](size_t index) { return buffers_[index]; }
+    sk_buff::ptr* begin() { return buffers_.data(); }
+    sk_buff::ptr* end() { return buffers_.data() + count_; }
+
+private:
+    /// buffer count
+    size_t count_;
+    /// buffers
+    std::array<sk_buff::ptr, def::max_skb_batch> buffers_;
+};
+
+/**
+ * @file flow.hpp
+ * @brief bounded lock free buffer ring, any thread may push and pop
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ * @link https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+class skb_ring {
+public:
+    /**
+     * @brief Construct a new ring
+     * @param[in] size slot count, rounded up to power of two
+     */
+    explicit skb_ring(size_t size) : tail_(0), head_(0) {
+        size_t capacity = 1;
+        while (capacity < size)
+            capacity <<= 1;
+        mask_ = capacity - 1;
+        slots_.reset(new slot[capacity]);
+        // slot sequence tell which lap may use it
+        for (size_t index = 0; index < capacity; index++)
+            slots_[index].sequence.store(index, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief append buffer, buffer is moved only if success
+     * @param[in] buffer buffer
+     * @return false if ring is full
+     */
+    bool push(sk_buff::ptr& buffer) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& elem = slots_[pos & mask_];
+            size_t sequence = elem.sequence.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    elem.buffer = std::move(buffer);
+                    elem.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // slot of last lap not popped yet
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief take first buffer
+     * @return buffer, nullptr if ring is empty
+     */
+    sk_buff::ptr pop() {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& elem = slots_[pos & mask_];
+            size_t sequence = elem.sequence.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(sequence) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    sk_buff::ptr buffer = std::move(elem.buffer);
+                    // slot is free for next lap
+                    elem.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return buffer;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief take buffers until batch is full or ring is empty
+     * @param[out] batch buffers are appended
+     * @return buffer count taken
+     */
+    size_t pop(skb_batch& batch) {
+        size_t count = 0;
+        while (!batch.full()) {
+            auto buffer = pop();
+            if (buffer == nullptr)
+                break;
+            batch.push(std::move(buffer));
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief check if ring is empty, buffer being pushed may be seen as not empty
+     * @return true if empty
+     */
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct slot {
+        /// lap position slot is ready for
+        std::atomic<size_t> sequence;
+        /// buffer
+        sk_buff::ptr buffer;
+    };
+
+    /// ring slots
+    std::unique_ptr<slot[]> slots_;
+    /// slot count minus one
+    size_t mask_;
+    /// push position, producers and consumers dont share line
+    alignas(def::cache_line_size) std::atomic<size_t> tail_;
+    /// pop position
+    alignas(def::cache_line_size) std::atomic<size_t> head_;
+};
+
+/**
+ * @file flow.hpp
+ * @brief growable fifo for one lock owner, slots are reused so steady push and pop dont touch heap
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+template <typename T>
+class ring_queue {
+public:
+    /**
+     * @brief Construct a new ring queue
+     * @param[in] size initial slot count, rounded up to power of two
+     */
+    explicit ring_queue(size_t size = def::skb_queue_init_size) : head_(0), tail_(0) {
+        size_t capacity = 1;
+        while (capacity < size)
+            capacity <<= 1;
+        mask_ = capacity - 1;
+        slots_.reset(new T[capacity]);
+    }
+
+    /**
+     * @brief append elem, slots double when full
+     * @param[in] elem elem
+     */
+    void push(T elem) {
+        if (tail_ - head_ > mask_)
+            grow();
+        slots_[tail_++ & mask_] = std::move(elem);
+    }
+
+    /**
+     * @brief drop first elem, slot release its reference
+     */
+    void pop() {
+        slots_[head_++ & mask_] = T();
+    }
+
+    T& front() { return slots_[head_ & mask_]; }
+    T& back() { return slots_[(tail_ - 1) & mask_]; }
+    T& operator[](size_t index) { return slots_[(head_ + index) & mask_]; }
+    size_t size() const { return tail_ - head_; }
+    bool empty() const { return head_ == tail_; }
+
+private:
+    /**
+     * @brief double slots, elems keep order
+     */
+    void grow() {
+        size_t count = size();
+        size_t capacity = (mask_ + 1) * 2;
+        std::unique_ptr<T[]> slots(new T[capacity]);
+        for (size_t index = 0; index < count; index++)
+            slots[index] = std::move(slots_[(head_ + index) & mask_]);
+        slots_ = std::move(slots);
+        mask_ = capacity - 1;
+        head_ = 0;
+        tail_ = count;
+    }
+
+private:
+    /// slots
+    std::unique_ptr<T[]> slots_;
+    /// slot count minus one
+    size_t mask_;
+    /// pop position
+    size_t head_;
+    /// push position
+    size_t tail_;
+};
+
+/// buffer fifo of device and sock
+typedef ring_queue<sk_buff::ptr> skb_queue;
+
 
 
 
@@ -245,6 +862,29 @@ struct ether_hdr {
     uint16_t protocol;
 } __attribute__((packed));
 
+/**
+ * @file flow.hpp
+ * @brief virtio net header, tap exchange it before each frame, fields are in host order
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ * @link https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html
+ */
+struct vnet_hdr {
+    /// see def::vnet_hdr_flag
+    uint8_t flags;
+    /// see def::vnet_gso_type
+    uint8_t gso_type;
+    /// header len before payload of super frame
+    uint16_t hdr_len;
+    /// payload size of each segment
+    uint16_t gso_size;
+    /// checksum start from ether header
+    uint16_t csum_start;
+    /// checksum field offset from csum start
+    uint16_t csum_offset;
+} __attribute__((packed));
+
+
 
 /**
  * @file flow.hpp
@@ -366,26 +1006,6 @@ struct udp_hdr {
     char data[0];
 } __attribute__((packed));
 
-/**
- * @file flow.hpp
- * @brief udp header
- * @author ArisAachen
- * @copyright Copyright (c) 2024 aris All rights reserved
- * @link https://datatracker.ietf.org/doc/html/rfc792
- */
-struct transport_fake_hdr {
-    /// source ip
-    uint32_t src_ip;
-    /// dst ip
-    uint32_t dst_ip;
-    /// reserve 0
-    uint8_t reserve;
-    /// udp protocol
-    uint8_t protocol;
-    /// total len
-    uint16_t total_len;
-};
-
 /**
  * @file flow.hpp
  * @brief tcp header option
@@ -461,7 +1081,7 @@ struct tcp_hdr {
  * @param[in] buffer buffer
  * @param[in] device device
  */
-static void skb_push(sk_buff::ptr buffer, size_t offset) {
+static void skb_push(const sk_buff::ptr& buffer, size_t offset) {
     buffer->data_begin -= offset;
 }
 
@@ -470,7 +1090,7 @@ static void skb_push(sk_buff::ptr buffer, size_t offset) {
  * @param[in] buffer buffer
  * @param[in] offset offset
  */
-static void skb_put(sk_buff::ptr buffer, size_t offset) {
+static void skb_put(const sk_buff::ptr& buffer, size_t offset) {
     buffer->data_tail += offset;
 }
 
@@ -479,7 +1099,7 @@ static void skb_put(sk_buff::ptr buffer, size_t offset) {
  * @param[in] buffer buffer
  * @param[in] offset offset
  */
-static void skb_pull(sk_buff::ptr buffer, size_t offset) {
+static void skb_pull(const sk_buff::ptr& buffer, size_t offset) {
     buffer->data_begin += offset;
 }
 
@@ -488,7 +1108,7 @@ static void skb_pull(sk_buff::ptr buffer, size_t offset) {
  * @param[in] buffer buffer
  * @param[in] offset offset
  */
-static void skb_reserve(sk_buff::ptr buffer, size_t offset) {
+static void skb_reserve(const sk_buff::ptr& buffer, size_t offset) {
     buffer->data_begin += offset;
     buffer->data_tail += offset;
 }
@@ -498,7 +1118,7 @@ static void skb_reserve(sk_buff::ptr buffer, size_t offset) {
  * @param[in] buffer buffer
  * @param[in] len len
  */
-static void skb_reset(sk_buff::ptr buffer, size_t len) {
+static void skb_reset(const sk_buff::ptr& buffer, size_t len) {
     memset(buffer->get_data(), 0, len);
 }
 
@@ -506,49 +1126,489 @@ static void skb_reset(sk_buff::ptr buffer, size_t len) {
  * @brief release buffer
  * @param[in] buffer buffer
  */
-static void skb_release(sk_buff::ptr buffer) {
+static void skb_release(sk_buff::ptr& buffer) {
     buffer.reset();
     return;
 }
 
+/**
+ * @brief check if buffer has ip fragments
+ * @param[in] buffer buffer
+ * @return true if has fragments
+ */
+static bool skb_has_frags(const sk_buff::ptr& buffer) {
+    return buffer->ext != nullptr && !buffer->ext->child_frags.empty();
+}
+
+/**
+ * @brief get segment size device split payload by
+ * @param[in] buffer buffer
+ * @return segment size, 0 if buffer is sent as one frame
+ */
+static uint16_t skb_gso_size(const sk_buff::ptr& buffer) {
+    return buffer->ext != nullptr ? buffer->ext->gso_size : 0;
+}
+
+/**
+ * @brief set segment size device split payload by, cold fields are only alloc for super frame
+ * @param[in] buffer buffer
+ * @param[in] size segment size, 0 if buffer is sent as one frame
+ * @return false if out of memory
+ */
+static bool skb_set_gso_size(const sk_buff::ptr& buffer, uint16_t size) {
+    if (size == 0 && buffer->ext == nullptr)
+        return true;
+    auto ext = buffer->get_ext();
+    if (ext == nullptr)
+        return false;
+    ext->gso_size = size;
+    return true;
+}
+
+/**
+ * @brief mark buffer refcount as single thread, skip atomic op
+ * @param[in] buffer buffer
+ */
+static void skb_set_local(const sk_buff::ptr& buffer) {
+    buffer->ref_local = true;
+}
+
+/**
+ * @brief mark buffer refcount as shared, must call before pass to other thread
+ * @param[in] buffer buffer
+ */
+static void skb_set_shared(const sk_buff::ptr& buffer) {
+    buffer->ref_local = false;
+    if (buffer->ext == nullptr)
+        return;
+    // pages are released by whichever thread drops the buffer
+    for (auto& frag : buffer->ext->frags)
+        frag.page->ref_local = false;
+}
+
+/**
+ * @brief move buffer to owner in census, pages and children are held by the same owner
+ * @param[in] buffer buffer
+ * @param[in] owner layer or queue hold buffer
+ */
+static void skb_set_owner(const sk_buff::ptr& buffer, def::skb_owner owner) {
+    if (buffer->owner != uint8_t(owner)) {
+        auto size = int64_t(buffer->get_footprint());
+        skb_census::account(def::skb_owner(buffer->owner), -1, -size);
+        skb_census::account(owner, 1, size);
+        buffer->owner = uint8_t(owner);
+    }
+    if (buffer->ext == nullptr)
+        return;
+    for (auto& frag : buffer->ext->frags)
+        skb_set_owner(frag.page, owner);
+    for (auto& child : buffer->ext->child_frags)
+        skb_set_owner(child, owner);
+}
+
 /**
  * @brief copy header buffer
  * @param[in] src source buffer
  * @param[in] dst dst buffer
+ * @return false if out of memory
  */
-static void skb_header_clone(sk_buff::ptr src, sk_buff::ptr dst) {
+static bool skb_header_clone(const sk_buff::ptr& src, const sk_buff::ptr& dst) {
     dst->protocol = src->protocol;
     dst->mtu = src->mtu;
     dst->src = src->src;
     dst->dst = src->dst;
-    dst->key = src->key;
-    dst->dev = src->dev;
-    dst->stack = src->stack;
+    dst->dev_index = src->dev_index;
+    if (src->ext == nullptr)
+        return true;
+    auto ext = dst->get_ext();
+    if (ext == nullptr)
+        return false;
+    ext->key = src->ext->key;
+    ext->flow = src->ext->flow;
+    return true;
 }
 
 /**
- * @brief compute checksum
+ * @brief check if buffer has payload segments
  * @param[in] buffer buffer
+ * @return true if has segments
  */
-static uint16_t compute_checksum(const sk_buff::ptr buffer) {
-    // check if need append 0 to tail
-    auto remain = buffer->get_data_len() % def::checksum_div_base;
-    // TODO: check if need append 0
-    if (remain != 0)
-        std::cout << "checksum need append, count: " << remain << std::endl;
-    auto div = buffer->get_data_len() / def::checksum_div_base;
-    uint16_t sum = 0;
-    // add all bytes
-    for (uint16_t index = 0; index < div; index++) {
-        auto num_ptr = reinterpret_cast<uint16_t*>(buffer->get_data() + index * def::checksum_div_base);
-        // should convert to host
-        auto num = ntohs(*num_ptr);
-        if (def::checksum_max_num - sum > num)
-            sum += num;
-        else
-            sum += num + 1;
+static bool skb_is_nonlinear(const sk_buff::ptr& buffer) {
+    return buffer->ext != nullptr && !buffer->ext->frags.empty();
+}
+
+/**
+ * @brief get total data len, include linear data and payload segments
+ * @param[in] buffer buffer
+ * @return data len
+ */
+static uint32_t skb_len(const sk_buff::ptr& buffer) {
+    uint32_t len = buffer->get_data_len();
+    if (buffer->ext == nullptr)
+        return len;
+    for (auto& frag : buffer->ext->frags)
+        len += frag.len;
+    return len;
+}
+
+/**
+ * @brief gather linear data and payload segments of buffer for writev or sendmsg
+ * @param[in] buffer buffer
+ * @param[out] iov io vector, hold max_skb_frags + 1 entries
+ * @return entries filled, 0 if buffer has more segments than iov hold
+ */
+static size_t skb_fill_iovec(const sk_buff::ptr& buffer, struct iovec* iov) {
+    size_t count = 0;
+    iov[count].iov_base = buffer->get_data();
+    iov[count++].iov_len = buffer->get_data_len();
+    if (!skb_is_nonlinear(buffer))
+        return count;
+    // part of frame must not be sent, ip len and checksum cover all segments
+    if (buffer->ext->frags.size() > def::max_skb_frags)
+        return 0;
+    for (auto& frag : buffer->ext->frags) {
+        iov[count].iov_base = frag.page->data + frag.offset;
+        iov[count++].iov_len = frag.len;
     }
-    return (~sum & def::checksum_max_num);
+    return count;
+}
+
+/**
+ * @brief release buffer after device sent it, buffer may still be held by others
+ * @param[in] buffer buffer
+ */
+static void skb_tx_done(const sk_buff::ptr& buffer) {
+    // pages may outlive buffer in clones, like tcp retransmit payload
+    skb_set_owner(buffer, def::skb_owner::shared);
+}
+
+/**
+ * @brief append payload segment refer to page data, data is not copied
+ * @param[in] buffer buffer
+ * @param[in] page buffer own the data
+ * @param[in] offset data offset in page
+ * @param[in] len data len
+ * @return false if out of memory
+ */
+static bool skb_add_frag(const sk_buff::ptr& buffer, const sk_buff::ptr& page, uint16_t offset, uint16_t len) {
+    auto ext = buffer->get_ext();
+    if (ext == nullptr)
+        return false;
+    ext->frags.push_back(skb_frag{page, offset, len});
+    // payload changed
+    buffer->ip_summed = uint8_t(def::checksum_state::none);
+    return true;
+}
+
+/**
+ * @brief copy data out of buffer, include payload segments
+ * @param[in] buffer buffer
+ * @param[in] buf dst buf
+ * @param[in] size buf size
+ * @return copied size
+ */
+static size_t skb_copy_data(const sk_buff::ptr& buffer, char* buf, size_t size) {
+    size_t copied = std::min<size_t>(size, buffer->get_data_len());
+    memcpy(buf, buffer->data + buffer->data_begin, copied);
+    if (buffer->ext == nullptr)
+        return copied;
+    for (auto& frag : buffer->ext->frags) {
+        if (copied == size)
+            break;
+        auto len = std::min<size_t>(size - copied, frag.len);
+        memcpy(buf + copied, frag.page->data + frag.offset, len);
+        copied += len;
+    }
+    return copied;
+}
+
+/**
+ * @brief consume data from head, include payload segments
+ * @param[in] buffer buffer
+ * @param[in] size consume size
+ */
+static void skb_consume(const sk_buff::ptr& buffer, size_t size) {
+    buffer->ip_summed = uint8_t(def::checksum_state::none);
+    auto linear = std::min<size_t>(size, buffer->get_data_len());
+    buffer->data_begin += linear;
+    size -= linear;
+    if (size == 0 || buffer->ext == nullptr)
+        return;
+    auto& frags = buffer->ext->frags;
+    auto iter = frags.begin();
+    for (; iter != frags.end() && size >= iter->len; iter++)
+        size -= iter->len;
+    // drop consumed pages
+    frags.erase(frags.begin(), iter);
+    if (frags.empty())
+        return;
+    frags.front().offset += size;
+    frags.front().len -= size;
+}
+
+/**
+ * @brief trim data to len, include payload segments
+ * @param[in] buffer buffer
+ * @param[in] len data len to keep
+ */
+static void skb_trim(const sk_buff::ptr& buffer, size_t len) {
+    buffer->ip_summed = uint8_t(def::checksum_state::none);
+    auto linear = std::min<size_t>(len, buffer->get_data_len());
+    buffer->data_tail = buffer->data_begin + linear;
+    len -= linear;
+    if (buffer->ext == nullptr)
+        return;
+    auto& frags = buffer->ext->frags;
+    auto iter = frags.begin();
+    for (; iter != frags.end() && len > 0; iter++) {
+        iter->len = std::min<size_t>(len, iter->len);
+        len -= iter->len;
+    }
+    frags.erase(iter, frags.end());
+}
+
+/**
+ * @brief append segments refer to data range of src, data is not copied
+ * @param[in] buffer buffer
+ * @param[in] src buffer own the data
+ * @param[in] offset data offset in src, payload segments included
+ * @param[in] len data len
+ * @return false if out of memory
+ */
+static bool skb_add_frag_range(const sk_buff::ptr& buffer, const sk_buff::ptr& src, size_t offset, size_t len) {
+    size_t linear = src->get_data_len();
+    if (offset < linear) {
+        auto part = std::min(len, linear - offset);
+        if (!skb_add_frag(buffer, src, src->data_begin + offset, part))
+            return false;
+        offset += part;
+        len -= part;
+    }
+    if (len == 0 || src->ext == nullptr)
+        return true;
+    offset -= linear;
+    for (auto& frag : src->ext->frags) {
+        if (len == 0)
+            break;
+        if (offset >= frag.len) {
+            offset -= frag.len;
+            continue;
+        }
+        auto part = std::min<size_t>(len, frag.len - offset);
+        if (!skb_add_frag(buffer, frag.page, frag.offset + offset, part))
+            return false;
+        offset = 0;
+        len -= part;
+    }
+    return true;
+}
+
+/**
+ * @brief check if linear data is referenced by clones
+ * @param[in] buffer buffer
+ * @return true if cloned
+ */
+static bool skb_cloned(const sk_buff::ptr& buffer) {
+    return buffer->ext != nullptr && buffer->ext->cloned;
+}
+
+/**
+ * @brief clone buffer, payload is shared, metadata and headroom are private
+ * @param[in] buffer buffer
+ * @param[in] headroom headroom for headers of clone
+ * @return clone, nullptr if out of memory
+ */
+static sk_buff::ptr skb_clone(const sk_buff::ptr& buffer, size_t headroom = def::skb_clone_headroom) {
+    auto clone = sk_buff::alloc(headroom);
+    if (clone == nullptr)
+        return nullptr;
+    clone->data_len = headroom;
+    skb_reserve(clone, headroom);
+    if (!skb_header_clone(buffer, clone))
+        return nullptr;
+    clone->hash = buffer->hash;
+    // share all data as segments
+    if (!skb_add_frag_range(clone, buffer, 0, skb_len(buffer)))
+        return nullptr;
+    // clone cover the same payload, payload sum is still valid
+    clone->ip_summed = buffer->ip_summed;
+    clone->csum = buffer->csum;
+    if (buffer->get_data_len() > 0) {
+        auto ext = buffer->get_ext();
+        if (ext == nullptr)
+            return nullptr;
+        ext->cloned = true;
+    }
+    return clone;
+}
+
+/**
+ * @brief add data to checksum sum, odd tail is padded with 0
+ * @param[in] buf data
+ * @param[in] len data len
+ * @param[in] sum last sum
+ * @return unfolded sum
+ */
+static uint32_t checksum_partial(const char* buf, size_t len, uint32_t sum) {
+    // vector kernel sum in native order, swap to host order
+    return sum + ntohs(checksum_engine::sum(buf, len));
+}
+
+/**
+ * @brief fold carry into 16 bits
+ * @param[in] sum unfolded sum
+ * @return folded sum
+ */
+static uint16_t checksum_fold(uint32_t sum) {
+    while (sum >> 16)
+        sum = (sum & def::checksum_max_num) + (sum >> 16);
+    return sum;
+}
+
+/**
+ * @brief compute checksum of memory
+ * @param[in] buf data
+ * @param[in] len data len
+ */
+static uint16_t compute_checksum(const char* buf, size_t len) {
+    return (~checksum_fold(checksum_partial(buf, len, 0)) & def::checksum_max_num);
+}
+
+/**
+ * @brief add buffer data to checksum sum, include payload segments
+ * @param[in] buffer buffer
+ * @param[in] sum last sum
+ * @return unfolded sum
+ */
+static uint32_t skb_checksum_partial(const sk_buff::ptr& buffer, uint32_t sum) {
+    size_t pos = buffer->get_data_len();
+    sum = checksum_partial(buffer->data + buffer->data_begin, pos, sum);
+    if (buffer->ext != nullptr) {
+        for (auto& frag : buffer->ext->frags) {
+            uint16_t part = checksum_fold(checksum_partial(frag.page->data + frag.offset, frag.len, 0));
+            // segment start at odd position, swap bytes
+            if (pos % def::checksum_div_base != 0)
+                part = (part << 8) | (part >> 8);
+            sum += part;
+            pos += frag.len;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief compute checksum, include payload segments
+ * @param[in] buffer buffer
+ */
+static uint16_t compute_checksum(const sk_buff::ptr& buffer) {
+    return (~checksum_fold(skb_checksum_partial(buffer, 0)) & def::checksum_max_num);
+}
+
+/**
+ * @brief sum pseudo header without length, addresses are fixed per connection so sum can be cached
+ * @param[in] src_ip source ip
+ * @param[in] dst_ip dst ip
+ * @param[in] protocol transport protocol
+ * @return unfolded sum
+ */
+static uint32_t checksum_pseudo(uint32_t src_ip, uint32_t dst_ip, def::transport_protocol protocol) {
+    return (src_ip >> 16) + (src_ip & def::checksum_max_num) + (dst_ip >> 16) + (dst_ip & def::checksum_max_num)
+        + uint8_t(protocol);
+}
+
+/**
+ * @brief compute transport checksum, pseudo header is added arithmetically instead of written to headroom
+ * @param[in] buffer buffer, start at transport header
+ * @param[in] header_len transport header len, must be even
+ * @param[in] pseudo_sum pseudo header sum without length
+ * @return checksum
+ */
+static uint16_t compute_transport_checksum(const sk_buff::ptr& buffer, size_t header_len, uint32_t pseudo_sum) {
+    uint32_t sum = pseudo_sum + skb_len(buffer);
+    // payload summed on copy is not read again
+    if (buffer->ip_summed == uint8_t(def::checksum_state::partial))
+        sum = checksum_partial(buffer->get_data(), header_len, sum + buffer->csum);
+    else
+        sum = skb_checksum_partial(buffer, sum);
+    return (~checksum_fold(sum) & def::checksum_max_num);
+}
+
+/**
+ * @brief compute pseudo header checksum left in header for device offload, device sum the rest per segment
+ * @param[in] buffer buffer, start at transport header
+ * @param[in] pseudo_sum pseudo header sum without length
+ * @return checksum field
+ */
+static uint16_t compute_offload_checksum(const sk_buff::ptr& buffer, uint32_t pseudo_sum) {
+    return checksum_fold(pseudo_sum + skb_len(buffer)) & def::checksum_max_num;
+}
+
+/**
+ * @brief verify received transport checksum, pseudo header included
+ * @param[in] buffer buffer, start at transport header
+ * @param[in] pseudo_sum pseudo header sum without length
+ * @return true if checksum is valid or verified before
+ */
+static bool verify_transport_checksum(const sk_buff::ptr& buffer, uint32_t pseudo_sum) {
+    if (buffer->ip_summed == uint8_t(def::checksum_state::unnecessary))
+        return true;
+    // checksum field is summed too, valid segment fold to all ones
+    uint32_t sum = skb_checksum_partial(buffer, pseudo_sum + skb_len(buffer));
+    return checksum_fold(sum) == def::checksum_max_num;
+}
+
+/**
+ * @brief update checksum after 16 bits field changed, RFC 1624 eqn 3
+ * @param[in] check checksum as stored in header
+ * @param[in] old_value old field as stored in header
+ * @param[in] new_value new field as stored in header
+ * @return new checksum as stored in header
+ */
+static uint16_t checksum_replace16(uint16_t check, uint16_t old_value, uint16_t new_value) {
+    // HC' = ~(~HC + ~m + m'), byte order free as long as all values share it
+    uint32_t sum = uint16_t(~check) + uint16_t(~old_value) + new_value;
+    return ~checksum_fold(sum);
+}
+
+/**
+ * @brief update checksum after 32 bits field changed, like ip address or sequence number
+ * @param[in] check checksum as stored in header
+ * @param[in] old_value old field as stored in header
+ * @param[in] new_value new field as stored in header
+ * @return new checksum as stored in header
+ */
+static uint16_t checksum_replace32(uint16_t check, uint32_t old_value, uint32_t new_value) {
+    uint32_t sum = uint16_t(~check) + uint16_t(~(old_value >> 16)) + uint16_t(~old_value)
+        + (new_value >> 16) + (new_value & def::checksum_max_num);
+    return ~checksum_fold(sum);
+}
+
+/**
+ * @brief update checksum after 16 bits word in header changed, word may hold two 8 bits fields
+ * @param[in] check checksum as stored in header
+ * @param[in] old_word old word memory
+ * @param[in] new_word new word memory
+ * @return new checksum as stored in header
+ */
+static uint16_t checksum_replace_word(uint16_t check, const void* old_word, const void* new_word) {
+    uint16_t old_value;
+    uint16_t new_value;
+    memcpy(&old_value, old_word, sizeof(old_value));
+    memcpy(&new_value, new_word, sizeof(new_value));
+    return checksum_replace16(check, old_value, new_value);
+}
+
+/**
+ * @brief get flow hash, same as sock table hash
+ * @param[in] local_ip local ip
+ * @param[in] local_port local port
+ * @param[in] remote_ip remote ip
+ * @param[in] remote_port remote port
+ * @return flow hash
+ */
+static uint32_t get_flow_hash(uint32_t local_ip, uint16_t local_port, uint32_t remote_ip, uint16_t remote_port) {
+    uint32_t port = (local_port << 16) + remote_port;
+    return utils::generic::jhash_3words(local_ip, remote_ip, port);
 }
 
 /**
@@ -601,6 +1661,25 @@ static uint16_t get_max_udp_data_offset() {
     return offset;
 }
 
+/**
+ * @brief fill rx buffer info from ether frame at data begin, then move data to network header
+ * @param[in] buffer buffer
+ * @param[in] ifindex device index
+ * @param[in] len frame len
+ */
+static void skb_rx_init(const sk_buff::ptr& buffer, uint8_t ifindex, size_t len) {
+    auto hdr = reinterpret_cast<const ether_hdr*>(buffer->data + buffer->data_begin);
+    // only handle thread touch it, until it is queued to sock or device
+    skb_set_local(buffer);
+    skb_set_owner(buffer, def::skb_owner::device_rx);
+    buffer->protocol = htons(hdr->protocol);
+    buffer->dev_index = ifindex;
+    buffer->data_len = len;
+    skb_put(buffer, len);
+    skb_pull(buffer, get_ether_offset());
+    buffer->network_offset = buffer->data_begin;
+}
+
 }
 
 
@@ -25,12 +25,12 @@ def::network_protocol icmp::get_protocol() {
 }
 
 // pack icmp flow
-bool icmp::pack_flow(flow::sk_buff::ptr buffer) {
+bool icmp::pack_flow(const flow::sk_buff::ptr& buffer) {
     return true;
 }
 
 // unpack flow
-bool icmp::unpack_flow(flow::sk_buff::ptr buffer) {
+bool icmp::unpack_flow(flow::sk_buff::ptr& buffer) {
     // get icmp header
     auto hdr = reinterpret_cast<const struct flow::icmp_hdr*>(buffer->get_data());
     if (hdr == nullptr)
@@ -51,68 +51,60 @@ bool icmp::unpack_flow(flow::sk_buff::ptr buffer) {
 }
 
 // handle icmp echo request 
-bool icmp::handle_icmp_echo_request(flow::sk_buff::ptr req_buffer) {
+bool icmp::handle_icmp_echo_request(const flow::sk_buff::ptr& req_buffer) {
     auto req_hdr = reinterpret_cast<const struct flow::icmp_echo_body*>(req_buffer->get_data());
     if (req_hdr == nullptr)
         return false;
     std::cout << "rcv icmp request, identifier: " << std::dec << ntohs(req_hdr->identifier) 
         << ", seq: " << ntohs(req_hdr->sequence_number) << std::endl;
-    // send back length is the same
-    auto total_len = req_buffer->data_len;
-    auto buf_len = req_buffer->get_data_len() - sizeof(struct flow::icmp_echo_body);
-    auto resp_buffer = flow::sk_buff::alloc(total_len);
-    resp_buffer->data_len = total_len;
+    // reply in place, echo body and payload are sent back as is
+    auto resp_buffer = req_buffer;
+    // payload shared with others, write headers to clone
+    if (flow::skb_cloned(req_buffer))
+        resp_buffer = flow::skb_clone(req_buffer);
+    if (resp_buffer == nullptr)
+        return false;
+    auto src = std::get<uint32_t>(req_buffer->dst);
+    auto dst = std::get<uint32_t>(req_buffer->src);
+    resp_buffer->src = src;
+    resp_buffer->dst = dst;
     // define next layer protocol
     resp_buffer->protocol = uint16_t(def::network_protocol::icmp);
-    resp_buffer->dev = req_buffer->dev;
-    resp_buffer->stack = stack_;
-    // set tail
-    flow::skb_reserve(resp_buffer, total_len);
-    flow::skb_push(resp_buffer, buf_len + sizeof(struct flow::icmp_echo_body));
-    // copy request src ip to response dst ip
-    resp_buffer->src = std::get<uint32_t>(req_buffer->dst);
-    resp_buffer->dst = std::get<uint32_t>(req_buffer->src);
-    auto icmp_echo_body = reinterpret_cast<struct flow::icmp_echo_body*>(resp_buffer->get_data());
-    if (icmp_echo_body == nullptr)
-        std::cout << "icmp echo body is invalid" << std::endl;
-    // set icmp echo body
-    icmp_echo_body->identifier = req_hdr->identifier;
-    icmp_echo_body->sequence_number = req_hdr->sequence_number;
-    memcpy(icmp_echo_body->data, req_hdr->data,  buf_len);
-    // set icmp request hdr
+    // request header is just before echo body
+    auto req_icmp_hdr = *reinterpret_cast<const flow::icmp_hdr*>(req_buffer->get_data() - sizeof(struct flow::icmp_hdr));
+    // set icmp reply hdr over request hdr
     flow::skb_push(resp_buffer, sizeof(struct flow::icmp_hdr));
     auto icmp_hdr = reinterpret_cast<flow::icmp_hdr*>(resp_buffer->get_data());
-    icmp_hdr->icmp_code = uint8_t(def::icmp_type::reply);
+    icmp_hdr->icmp_type = uint8_t(def::icmp_type::reply);
     icmp_hdr->icmp_code = uint8_t(def::icmp_code::none);
-    // set checksum to 0 first, in case compute error checksum
-    icmp_hdr->icmp_checksum = 0;
-    icmp_hdr->icmp_checksum = htons(flow::compute_checksum(resp_buffer));
+    // only type and code change, update request checksum instead of summing payload
+    icmp_hdr->icmp_checksum = flow::checksum_replace_word(req_icmp_hdr.icmp_checksum, &req_icmp_hdr, icmp_hdr);
     if (stack_.expired())
         return false;
     auto stack = stack_.lock();
+    std::cout << "send icmp response, identifier: " << std::dec << ntohs(req_hdr->identifier) 
+        << ", seq: " << ntohs(req_hdr->sequence_number) << std::endl;
     stack->write_network_package(resp_buffer);
-    std::cout << "send icmp response, identifier: " << std::dec << ntohs(icmp_echo_body->identifier) 
-        << ", seq: " << ntohs(icmp_echo_body->sequence_number) << std::endl;
     return false;
 }
 
 // handle icmp echo request 
-bool icmp::handle_icmp_echo_reply(flow::sk_buff::ptr buffer) {
+bool icmp::handle_icmp_echo_reply(const flow::sk_buff::ptr& buffer) {
     
 
 
     return false;
 }
 
-bool icmp::send_icmp_echo_request(flow::sk_buff::ptr buffer) {
+bool icmp::send_icmp_echo_request(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
-bool icmp::send_icmp_echo_reply(flow::sk_buff::ptr req_buffer) {
+bool icmp::send_icmp_echo_reply(const flow::sk_buff::ptr& req_buffer) {
     return false;
 }
 
-bool icmp::icmp_send(flow::sk_buff::ptr buffer) {
+bool icmp::icmp_send(const flow::sk_buff::ptr& buffer) {
 
     return false;
 }
@@ -49,14 +49,14 @@ public:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr buffer);
+    virtual bool pack_flow(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief package flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool unpack_flow(flow::sk_buff::ptr buffer);
+    virtual bool unpack_flow(flow::sk_buff::ptr& buffer);
 
 private:
     /**
@@ -71,35 +71,35 @@ private:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool handle_icmp_echo_request(flow::sk_buff::ptr buffer);
+    bool handle_icmp_echo_request(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle icmp reply
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool handle_icmp_echo_reply(flow::sk_buff::ptr buffer);
+    bool handle_icmp_echo_reply(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief send icmp request
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool send_icmp_echo_request(flow::sk_buff::ptr buffer);
+    bool send_icmp_echo_request(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief send icmp reply
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool send_icmp_echo_reply(flow::sk_buff::ptr buffer);
+    bool send_icmp_echo_reply(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle icmp response
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool icmp_send(flow::sk_buff::ptr buffer);
+    bool icmp_send(const flow::sk_buff::ptr& buffer);
 
 private:
     /// stack
@@ -40,7 +40,28 @@ struct net_device {
      * @param[in] len write buffer length
      * @return write buffer length
      */
-    virtual int write_to_device(flow::sk_buff::ptr buffer) = 0;
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer) = 0;
+
+    /**
+     * @brief read buffers from net_device device, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch) {
+        batch.push(read_from_device());
+        return batch.size();
+    }
+
+    /**
+     * @brief write buffers to net_device device
+     * @param[in] batch write buffers
+     * @return write buffer count
+     */
+    virtual int write_to_device(flow::skb_batch& batch) {
+        for (auto& buffer : batch)
+            write_to_device(buffer);
+        return batch.size();
+    }
 
     /**
      * @brief get net_device mac
@@ -60,6 +81,32 @@ struct net_device {
      */
     virtual uint8_t get_device_ifindex() = 0;
 
+    /**
+     * @brief get queue count, each queue has own reader, writer and stack thread
+     * @return queue count
+     */
+    virtual uint32_t get_queue_count() {
+        return 1;
+    }
+
+    /**
+     * @brief read buffers from one queue, block until one buffer is ready
+     * @param[in] queue queue index
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_queue(uint32_t /* queue */, flow::skb_batch& batch) {
+        return read_from_device(batch);
+    }
+
+    /**
+     * @brief get max super frame device segment itself
+     * @return max frame size, 0 if stack must segment by mtu
+     */
+    virtual uint32_t get_device_gso_size() {
+        return 0;
+    }
+
 public:
     /**
      * @brief read from net_device device
@@ -73,6 +120,22 @@ public:
      */
     virtual void write_thread() = 0;
 
+    /**
+     * @brief read from one queue of net_device device
+     * @param[in] queue queue index
+     */
+    virtual void read_queue_thread(uint32_t /* queue */) {
+        read_thread();
+    }
+
+    /**
+     * @brief write to one queue of net_device device
+     * @param[in] queue queue index
+     */
+    virtual void write_queue_thread(uint32_t /* queue */) {
+        write_thread();
+    }
+
     /**
      * @brief get net_device device status from kernel status
      * @return bool net_device device status
@@ -100,14 +163,22 @@ struct network_handler {
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr skb) = 0;
+    virtual bool pack_flow(const flow::sk_buff::ptr& skb) = 0;
 
     /**
      * @brief unpackage flow
-     * @param[in] skb sk buffer
+     * @param[in,out] skb sk buffer, may be replaced by reassembled buffer
      * @return return if package is valid, like checksum failed
      */        
-    virtual bool unpack_flow(flow::sk_buff::ptr skb) = 0;
+    virtual bool unpack_flow(flow::sk_buff::ptr& skb) = 0;
+
+    /**
+     * @brief unpackage flow batch
+     * @param[in,out] batch sk buffers, only buffers need next handle are kept
+     */
+    virtual void unpack_batch(flow::skb_batch& batch) {
+        batch.filter([this] (flow::sk_buff::ptr& buffer) { return unpack_flow(buffer); });
+    }
 };
 
 struct transport_handler {
@@ -124,14 +195,22 @@ struct transport_handler {
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr skb) = 0;
+    virtual bool pack_flow(const flow::sk_buff::ptr& skb) = 0;
 
     /**
      * @brief unpackage flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */        
-    virtual bool unpack_flow(flow::sk_buff::ptr skb) = 0;
+    virtual bool unpack_flow(const flow::sk_buff::ptr& skb) = 0;
+
+    /**
+     * @brief unpackage flow batch
+     * @param[in,out] batch sk buffers, only buffers need next handle are kept
+     */
+    virtual void unpack_batch(flow::skb_batch& batch) {
+        batch.filter([this] (flow::sk_buff::ptr& buffer) { return unpack_flow(buffer); });
+    }
 };
 
 struct sock_handler {
@@ -255,8 +334,23 @@ public:
     /**
      * @brief register device to stack
      * @param[in] device device
+     * @param[in] arena_config buffer arena of device rx thread
+     */
+    virtual void register_device(interface::net_device::ptr device, const flow::skb_arena_config& arena_config = {}) = 0;
+
+    /**
+     * @brief get device by index
+     * @param[in] ifindex device index
+     * @return device, nullptr if not exist
+     */
+    virtual interface::net_device::ptr get_device(uint8_t ifindex) = 0;
+
+    /**
+     * @brief get device buffer is written to
+     * @param[in] ifindex device index of buffer, 0 if buffer has no device
+     * @return device, nullptr if no device
      */
-    virtual void register_device(interface::net_device::ptr device) = 0;
+    virtual interface::net_device::ptr get_tx_device(uint8_t ifindex) = 0;
 
     /**
      * @brief register network handler to stack
@@ -283,13 +377,13 @@ public:
      * @param[in] buffer write buffer
      * @param[in] device_id device id
      */
-    virtual void write_to_device(flow::sk_buff::ptr buffer) = 0;
+    virtual void write_to_device(const flow::sk_buff::ptr& buffer) = 0;
 
     /**
      * @brief update neighbor info
      * @param[in] hdr arp hdr
      */
-    virtual void update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device::ptr dev) = 0;
+    virtual void update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device* dev) = 0;
 
     /**
      * @brief write to device
@@ -297,14 +391,14 @@ public:
      * @param[in] buffer buffer remove ether header
      * @return if need next handle
      */
-    virtual bool handle_network_package(flow::sk_buff::ptr buffer) = 0;
+    virtual bool handle_network_package(flow::sk_buff::ptr& buffer) = 0;
 
     /**
      * @brief write to network
      * @param[in] buffer buffer remove ether header
      * @return if need next handle
      */
-    virtual bool write_network_package(flow::sk_buff::ptr buffer) = 0;
+    virtual bool write_network_package(const flow::sk_buff::ptr& buffer) = 0;
 
     /**
      * @brief read and handle buffer
@@ -3,6 +3,7 @@
 #include "flow.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -35,16 +36,18 @@ def::network_protocol ip::get_protocol() {
 } 
 
 // pack ip flow
-bool ip::pack_flow(flow::sk_buff::ptr buffer) {
+bool ip::pack_flow(const flow::sk_buff::ptr& buffer) {
     // check if need mtu
-    if (!buffer->child_frags.empty()) {
+    if (flow::skb_has_frags(buffer)) {
         std::cout << "use ip fast fragment" << std::endl;
         ip_make_flow(buffer, 0, false);
-        for (auto iter : buffer->child_frags)
-            ip_make_flow(buffer, 0, false);
-    } else if (buffer->mtu && buffer->get_data_len() > (buffer->mtu - sizeof(struct flow::ip_hdr))) {
+        // segments share header except length, checksum is updated incrementally
+        auto hdr = reinterpret_cast<const flow::ip_hdr*>(buffer->get_data());
+        for (auto& iter : buffer->ext->child_frags)
+            ip_make_flow(iter, 0, false, hdr);
+    } else if (buffer->mtu && !flow::skb_gso_size(buffer) && flow::skb_len(buffer) > (buffer->mtu - sizeof(struct flow::ip_hdr))) {
         std::cout << "use slow fast fragment" << std::endl;
-        ip_fragment(buffer);
+        return ip_fragment(buffer);
     } else {
         ip_make_flow(buffer, 0, false);
     }
@@ -52,12 +55,31 @@ bool ip::pack_flow(flow::sk_buff::ptr buffer) {
     return true;
 }
 
+// unpack flow batch
+void ip::unpack_batch(flow::skb_batch& batch) {
+    batch.filter([this] (flow::sk_buff::ptr& buffer) { return ip::unpack_flow(buffer); });
+}
+
 // unpack flow
-bool ip::unpack_flow(flow::sk_buff::ptr buffer) {
+bool ip::unpack_flow(flow::sk_buff::ptr& buffer) {
     // get ip header
     auto hdr = reinterpret_cast<const struct flow::ip_hdr*>(buffer->get_data());
     if (hdr == nullptr)
         return false;
+    // header checksum is never verified by kernel, it is short so always check it
+    size_t header_len = (hdr->version_and_head_len & 0b00001111) * def::ip_len;
+    if (header_len < sizeof(struct flow::ip_hdr) || header_len > buffer->get_data_len() ||
+        flow::compute_checksum(reinterpret_cast<const char*>(hdr), header_len) != 0) {
+        checksum_drops_.fetch_add(1, std::memory_order_relaxed);
+        std::cout << "drop ip msg, header checksum failed" << std::endl;
+        return false;
+    }
+    // total len is trusted below to trim padding and find payload
+    size_t total_len = ntohs(hdr->total_len);
+    if (total_len < header_len || total_len > buffer->get_data_len()) {
+        std::cout << "drop ip msg, invalid total len: " << std::dec << total_len << std::endl;
+        return false;
+    }
     std::cout << "rcv ip msg, src: " << utils::generic::format_ip_address(ntohl(hdr->src_ip))
         << ", dst: " << utils::generic::format_ip_address(ntohl(hdr->dst_ip)) 
         << ", protocol: " << (int)(def::network_protocol(hdr->protocol)) << std::endl;
@@ -73,34 +95,31 @@ bool ip::unpack_flow(flow::sk_buff::ptr buffer) {
     auto offset = uint16_t(flag_and_fragoffset << 3) >> 3;
     if (!more_flag && offset == 0) {
         std::cout << "rcv ip msg dont need defrag" << std::endl;
-        flow::skb_pull(buffer, sizeof(struct flow::ip_hdr));
-        // get real offset here
-        flow::skb_put(buffer, htons(hdr->total_len));
+        // trim ether padding
+        buffer->data_tail = buffer->data_begin + total_len;
+        // options are skipped, transport header start after them
+        flow::skb_pull(buffer, header_len);
+        buffer->transport_offset = buffer->data_begin;
         return true;
     }
     return ip_defragment(buffer);
 }
 
 // ip rcv 
-bool ip::ip_rcv(flow::sk_buff::ptr buffer) {
+bool ip::ip_rcv(const flow::sk_buff::ptr& buffer) {
     return true;
 }
 
 // ip send
-bool ip::ip_send(flow::sk_buff::ptr buffer) {
+bool ip::ip_send(const flow::sk_buff::ptr& buffer) {
     return true;
 }
 
 // make ip flow 
-bool ip::ip_make_flow(flow::sk_buff::ptr buffer, size_t offset, bool more_flag) {
+bool ip::ip_make_flow(flow::sk_buff::ptr buffer, size_t offset, bool more_flag, const flow::ip_hdr* base_hdr) {
     // set ip hdr
     flow::skb_push(buffer, sizeof(struct flow::ip_hdr));
     auto hdr = reinterpret_cast<flow::ip_hdr*>(buffer->get_data());
-    // append to tail
-    hdr->version_and_head_len = (4 << 4) + 5;
-    hdr->diff_serv_and_ecn = 0;
-    hdr->total_len = htons(buffer->get_data_len());
-    hdr->identification = htons(identification_ + 1);
     auto flag_and_offset = uint16_t(0);
     // set flag
     if (offset || more_flag)
@@ -108,71 +127,77 @@ bool ip::ip_make_flow(flow::sk_buff::ptr buffer, size_t offset, bool more_flag)
     if (more_flag)
         flag_and_offset |= (0b01 << def::ip_flag_offset);
     flag_and_offset |= offset;
-    hdr->flag_and_fragoffset |= htons(flag_and_offset);
+    if (base_hdr != nullptr) {
+        // copy header of same datagram, only update changed fields and checksum
+        *hdr = *base_hdr;
+        auto total_len = htons(flow::skb_len(buffer));
+        auto flag_and_fragoffset = htons(flag_and_offset);
+        hdr->head_checksum = flow::checksum_replace16(hdr->head_checksum, hdr->total_len, total_len);
+        hdr->head_checksum = flow::checksum_replace16(hdr->head_checksum, hdr->flag_and_fragoffset, flag_and_fragoffset);
+        hdr->total_len = total_len;
+        hdr->flag_and_fragoffset = flag_and_fragoffset;
+        buffer->protocol = uint16_t(def::network_protocol::ip);
+        return true;
+    }
+    // append to tail
+    hdr->version_and_head_len = (4 << 4) + 5;
+    hdr->diff_serv_and_ecn = 0;
+    hdr->total_len = htons(flow::skb_len(buffer));
+    hdr->identification = htons(identification_ + 1);
+    hdr->flag_and_fragoffset = htons(flag_and_offset);
     hdr->time_to_live = def::ip_time_to_live;
     hdr->protocol = buffer->protocol;
     // in case checksum failed
     hdr->head_checksum = 0;
     hdr->src_ip = htonl(std::get<uint32_t>(buffer->src));
     hdr->dst_ip = htonl(std::get<uint32_t>(buffer->dst));
-    // compute checksum
-    auto data_tail = buffer->data_tail;
-    buffer->data_tail = buffer->data_begin + sizeof(struct flow::ip_hdr);
-    hdr->head_checksum = ntohs(flow::compute_checksum(buffer));
-    buffer->data_tail = data_tail;
+    // compute checksum, only cover header
+    hdr->head_checksum = htons(flow::compute_checksum(reinterpret_cast<char*>(hdr), sizeof(struct flow::ip_hdr)));
     buffer->protocol = uint16_t(def::network_protocol::ip);
     return true;
 }
 
 // make ip fragment
-bool ip::ip_fragment(flow::sk_buff::ptr buffer) {
+bool ip::ip_fragment(const flow::sk_buff::ptr& buffer) {
     std::vector<flow::sk_buff::ptr> child_buffer;
-    auto frag_size = buffer->mtu - sizeof(struct flow::ip_hdr);
-    // continue make len
-    for (int index = 1; buffer->data_len > frag_size; index++) {
-        // check rest part of data
-        flow::sk_buff::ptr frag_buffer;
-        auto copy_size = buffer->data_len - frag_size;
-        auto more_flag = false;
-        // get copy buffer
-        if (copy_size > frag_size) {
-            auto alloc_size = buffer->mtu + def::max_ether_header;
-            frag_buffer = flow::sk_buff::alloc(alloc_size);
-            frag_buffer->data_len = alloc_size;
-            flow::skb_reserve(frag_buffer, def::max_ether_header);
-            flow::skb_header_clone(buffer, frag_buffer);
-            copy_size = frag_size;
-            more_flag = true;
-        } else {
-            auto alloc_size = copy_size + sizeof(struct flow::ip_hdr) + def::max_ether_header;
-            frag_buffer = flow::sk_buff::alloc(alloc_size);
-            frag_buffer->data_len = alloc_size;
-            flow::skb_reserve(frag_buffer, def::max_ether_header);
-            flow::skb_header_clone(buffer, frag_buffer);
-        }
-        // set buffer
-        flow::skb_reserve(frag_buffer, sizeof(struct flow::ip_hdr));
-        // copy data 
-        memcpy(frag_buffer->get_data(), buffer->get_data() + index * frag_size, copy_size);
-        flow::skb_put(frag_buffer, copy_size);
+    // fragment offset is counted in 8 bytes
+    size_t frag_size = (buffer->mtu - sizeof(struct flow::ip_hdr)) / def::ip_frag_offset_base * def::ip_frag_offset_base;
+    size_t total_len = flow::skb_len(buffer);
+    // first header is computed in full, others are derived from it
+    const flow::ip_hdr* base_hdr = nullptr;
+    for (size_t offset = frag_size; offset < total_len; offset += frag_size) {
+        auto copy_size = std::min(frag_size, total_len - offset);
+        // fragment only hold header, payload refer to parent buffer
+        auto alloc_size = sizeof(struct flow::ip_hdr) + def::max_ether_header;
+        auto frag_buffer = flow::sk_buff::alloc(alloc_size);
+        if (frag_buffer == nullptr)
+            return false;
+        frag_buffer->data_len = alloc_size;
+        flow::skb_reserve(frag_buffer, alloc_size);
+        if (!flow::skb_header_clone(buffer, frag_buffer) || !flow::skb_add_frag_range(frag_buffer, buffer, offset, copy_size))
+            return false;
         // make ip header
-        ip_make_flow(frag_buffer, index * frag_size / def::ip_frag_offset_base, more_flag);
-        // resize data len
-        buffer->data_len -= copy_size;
-        child_buffer.push_back(frag_buffer);
+        ip_make_flow(frag_buffer, offset / def::ip_frag_offset_base, offset + copy_size < total_len, base_hdr);
+        if (base_hdr == nullptr)
+            base_hdr = reinterpret_cast<const flow::ip_hdr*>(frag_buffer->get_data());
+        child_buffer.push_back(std::move(frag_buffer));
     }
-    // reset buffer tail
-    buffer->data_tail = buffer->data_begin + frag_size;
-    ip_make_flow(buffer, 0, true);
+    // first fragment stay in buffer
+    flow::skb_trim(buffer, frag_size);
+    ip_make_flow(buffer, 0, true, base_hdr);
 
     // check if child buffer is empty
-    if (!child_buffer.empty())
-        buffer->child_frags = std::move(child_buffer);
+    if (!child_buffer.empty()) {
+        auto ext = buffer->get_ext();
+        if (ext == nullptr)
+            return false;
+        ext->child_frags = std::move(child_buffer);
+    }
 
     return true;
 };
 
-bool ip::ip_defragment(flow::sk_buff::ptr buffer) {
+bool ip::ip_defragment(flow::sk_buff::ptr& buffer) {
     // check if find full package
     auto defrag_buffer = defrag_queue_->defrag_push(buffer);
     if (defrag_buffer == nullptr)
@@ -195,7 +220,7 @@ ip_defrag_queue::ptr ip_defrag_queue::create() {
     return ip_defrag_queue::ptr(new ip_defrag_queue());
 }
 
-flow::sk_buff::ptr ip_defrag_queue::defrag_push(flow::sk_buff::ptr buffer) {    
+flow::sk_buff::ptr ip_defrag_queue::defrag_push(const flow::sk_buff::ptr& buffer) {    
     // get ip header
     auto hdr = reinterpret_cast<const struct flow::ip_hdr*>(buffer->get_data());
     if (hdr == nullptr)
@@ -207,13 +232,14 @@ flow::sk_buff::ptr ip_defrag_queue::defrag_push(flow::sk_buff::ptr buffer) {
     auto protocol = hdr->protocol;
     auto flag_and_fragoffset = ntohs(hdr->flag_and_fragoffset);
     uint16_t fragoffset = uint16_t(flag_and_fragoffset << 3) >> 3;
-    auto key = ip_defrag_key::ptr(new ip_defrag_key(src_ip, dst_ip, id, protocol));
+    ip_defrag_key key(src_ip, dst_ip, id, protocol);
     auto offset_map = defrag_find(key);
     if (offset_map == nullptr) {
         offset_map = defrag_list_create(key);
     }
     // get mutex
     std::unique_lock<std::shared_mutex> lock(mutex);
+    flow::skb_set_owner(buffer, def::skb_owner::ip_defrag);
     offset_map->insert(std::make_pair(fragoffset, buffer));
     auto defrag_buffer = ip_defrag_reassemble(offset_map);
     if (defrag_buffer == nullptr)
@@ -221,17 +247,19 @@ flow::sk_buff::ptr ip_defrag_queue::defrag_push(flow::sk_buff::ptr buffer) {
     lock.unlock();
     // remove map
     defrag_remove(key);
+    // fragments are pages of reassembled buffer now
+    flow::skb_set_owner(defrag_buffer, def::skb_owner::stack);
     return defrag_buffer;
 }
 
 // remove defrag
-bool ip_defrag_queue::defrag_remove(ip_defrag_key::ptr key) {
+bool ip_defrag_queue::defrag_remove(const ip_defrag_key& key) {
     std::lock_guard<std::shared_mutex> lock(mutex);
     defrag_map.erase(defrag_map.find(key));
     return false;
 }
 
-ip_defrag_queue::defrag_offset_map_ptr ip_defrag_queue::defrag_find(ip_defrag_key::ptr key) {
+ip_defrag_queue::defrag_offset_map_ptr ip_defrag_queue::defrag_find(const ip_defrag_key& key) {
     std::shared_lock<std::shared_mutex> lock(mutex);
     auto elem = defrag_map.find(key);
     if (elem == defrag_map.end())
@@ -240,7 +268,7 @@ ip_defrag_queue::defrag_offset_map_ptr ip_defrag_queue::defrag_find(ip_defrag_ke
 }
 
 // get defrag list
-ip_defrag_queue::defrag_offset_map_ptr ip_defrag_queue::defrag_list_create(ip_defrag_key::ptr key) {
+ip_defrag_queue::defrag_offset_map_ptr ip_defrag_queue::defrag_list_create(const ip_defrag_key& key) {
     std::lock_guard<std::shared_mutex> lock(mutex);
     auto offset_map = defrag_offset_map_ptr(new std::unordered_map<uint16_t, flow::sk_buff::ptr>());
     defrag_map.insert(std::make_pair(key, offset_map));
@@ -286,37 +314,38 @@ flow::sk_buff::ptr ip_defrag_queue::ip_defrag_reassemble(defrag_offset_map_ptr o
     // check if full frag set
     if (!full_frag)
         return nullptr;
-    // create buffer
-    auto reassemble_buffer = flow::sk_buff::alloc(total_buf_len);
-    reassemble_buffer->data_len = total_buf_len;
-    flow::skb_pull(reassemble_buffer, sizeof(struct flow::ip_hdr));
-    // copy buffer
+    // first frag keep linear data, others are chained as payload segments
     offset_frag = offset_map->find(0);
-    // check if recv all frag
+    auto reassemble_buffer = offset_frag->second;
     while (true) {
-        auto hdr = reinterpret_cast<flow::ip_hdr*>(offset_frag->second->get_data());
+        auto frag_buffer = offset_frag->second;
+        auto hdr = reinterpret_cast<flow::ip_hdr*>(frag_buffer->get_data());
         // get frag
         auto flag_and_fragoffset = ntohs(hdr->flag_and_fragoffset);
+        auto more_flag = flag_and_fragoffset >> def::ip_flag_offset & 0b001;
         // get current offset
         uint16_t offset = uint16_t(flag_and_fragoffset << 3) >> 3;
         // get header len
         auto header_len = (hdr->version_and_head_len & 0b00001111) * def::ip_len;
         auto data_len = ntohs(hdr->total_len) - header_len;
-        auto frag_buffer = offset_frag->second;
-        flow::skb_pull(frag_buffer, header_len);
-        memcpy(reassemble_buffer->get_data(), frag_buffer->get_data(), data_len);
+        // next offset must be read before header is pulled
+        offset += data_len / def::ip_frag_offset_base;
+        if (frag_buffer == reassemble_buffer) {
+            flow::skb_pull(frag_buffer, header_len);
+            frag_buffer->transport_offset = frag_buffer->data_begin;
+            frag_buffer->data_tail = frag_buffer->data_begin + data_len;
+        } else if (!flow::skb_add_frag(reassemble_buffer, frag_buffer, frag_buffer->data_begin + header_len, data_len)) {
+            std::cout << "ip rcv frag chain out of memory" << std::endl;
+            return nullptr;
+        }
         // check if is last frag
-        auto more_flag = flag_and_fragoffset >> def::ip_flag_offset & 0b001;
         if (!more_flag) {
-            reassemble_buffer->src = htonl(hdr->src_ip);
-            reassemble_buffer->dst = htonl(hdr->dst_ip);
-            std::cout << "ip rcv frag copy data complete" << std::endl;
+            std::cout << "ip rcv frag chain complete, len: " << std::dec << total_buf_len << std::endl;
             return reassemble_buffer;
         }
-        offset += data_len / def::ip_frag_offset_base;
         offset_frag = offset_map->find(offset);
         if (offset_frag == offset_map->end()) {
-            std::cout << "ip rcv frag copy failed" << std::endl;
+            std::cout << "ip rcv frag chain failed" << std::endl;
             return nullptr;
         }
     }
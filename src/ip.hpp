@@ -57,14 +57,26 @@ public:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr buffer);
+    virtual bool pack_flow(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief package flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool unpack_flow(flow::sk_buff::ptr buffer);
+    virtual bool unpack_flow(flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief unpack flow batch, per packet unpack is not dispatched virtually
+     * @param[in,out] batch sk buffers, only buffers need next handle are kept
+     */
+    virtual void unpack_batch(flow::skb_batch& batch);
+
+    /**
+     * @brief get count of received buffers dropped by checksum
+     * @return drop count
+     */
+    uint64_t get_checksum_drops() { return checksum_drops_.load(std::memory_order_relaxed); }
 
 private:
     /**
@@ -79,35 +91,38 @@ private:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool ip_rcv(flow::sk_buff::ptr buffer);
+    bool ip_rcv(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle ip response
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool ip_send(flow::sk_buff::ptr buffer);
+    bool ip_send(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief make package flow
      * @param[in] skb sk buffer
+     * @param[in] offset fragment offset in 8 bytes
+     * @param[in] more_flag more fragment follow
+     * @param[in] base_hdr header of same datagram, checksum is updated incrementally from it
      * @return return if package is valid, like checksum failed
      */
-    bool ip_make_flow(flow::sk_buff::ptr buffer, size_t offset, bool more_flag);
+    bool ip_make_flow(flow::sk_buff::ptr buffer, size_t offset, bool more_flag, const flow::ip_hdr* base_hdr = nullptr);
 
     /**
      * @brief fragment ip
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool ip_fragment(flow::sk_buff::ptr buffer);
+    bool ip_fragment(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief defragment ip
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool ip_defragment(flow::sk_buff::ptr buffer);
+    bool ip_defragment(flow::sk_buff::ptr& buffer);
 
 private:
     /// stack
@@ -116,6 +131,8 @@ private:
     std::atomic<uint16_t> identification_;
     /// defrag queue
     std::shared_ptr<flow_table::ip_defrag_queue> defrag_queue_;
+    /// received buffers dropped by checksum
+    std::atomic<uint64_t> checksum_drops_ { 0 };
 };
 
 }
@@ -124,7 +141,6 @@ private:
 namespace flow_table {
 
 struct ip_defrag_key {
-typedef std::shared_ptr<ip_defrag_key> ptr;
     ip_defrag_key(uint32_t src_ip, uint32_t dst_ip, uint16_t id, uint8_t protocol) :
     src_ip(src_ip), dst_ip(dst_ip), identification(id), protocol(protocol) {}
     /// source ip
@@ -139,9 +155,9 @@ typedef std::shared_ptr<ip_defrag_key> ptr;
 
 struct ip_defrag_key_equal {
     // check if is the same
-    bool operator() (const ip_defrag_key::ptr first, const ip_defrag_key::ptr second) const {
-        if (first->src_ip == second->src_ip && first->dst_ip == second->dst_ip
-            && first->identification == second->identification && first->protocol == second->protocol)
+    bool operator() (const ip_defrag_key& first, const ip_defrag_key& second) const {
+        if (first.src_ip == second.src_ip && first.dst_ip == second.dst_ip
+            && first.identification == second.identification && first.protocol == second.protocol)
             return true;
         return false;
     }
@@ -153,9 +169,9 @@ struct ip_defrag_hash_key {
     * @param[in] key id key
     * @return hash result
     */
-    size_t operator() (const ip_defrag_key::ptr key) const {
+    size_t operator() (const ip_defrag_key& key) const {
         // get port
-        auto hash_code = utils::generic::jhash_3words(key->src_ip, key->dst_ip, key->identification);
+        auto hash_code = utils::generic::jhash_3words(key.src_ip, key.dst_ip, key.identification);
         return hash_code;
     }
 };
@@ -164,7 +180,7 @@ struct ip_defrag_queue {
 public:
     typedef std::shared_ptr<ip_defrag_queue> ptr;
     typedef std::shared_ptr<std::unordered_map<uint16_t, flow::sk_buff::ptr>> defrag_offset_map_ptr; 
-    typedef std::unordered_map<ip_defrag_key::ptr, defrag_offset_map_ptr, ip_defrag_hash_key, ip_defrag_key_equal> ip_defrag_map;
+    typedef std::unordered_map<ip_defrag_key, defrag_offset_map_ptr, ip_defrag_hash_key, ip_defrag_key_equal> ip_defrag_map;
 
     /**
      * @brief create ip defrag
@@ -177,28 +193,28 @@ public:
      * @param[in] skb sk buffer
      * @return check if buffer get full package
      */
-    flow::sk_buff::ptr defrag_push(flow::sk_buff::ptr buffer);
+    flow::sk_buff::ptr defrag_push(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief remove defrag
      * @param[in] key defrag key
      * @return check if buffer get full package
      */
-    bool defrag_remove(ip_defrag_key::ptr key);
+    bool defrag_remove(const ip_defrag_key& key);
 
     /**
      * @brief get defrag list
      * @param[in] key defrag key
      * @return check if defrag list exist
      */
-    defrag_offset_map_ptr defrag_find(ip_defrag_key::ptr key);
+    defrag_offset_map_ptr defrag_find(const ip_defrag_key& key);
 
     /**
      * @brief create defrag list
      * @param[in] key defrag key
      * @return check if defrag list exist
      */
-    defrag_offset_map_ptr defrag_list_create(ip_defrag_key::ptr key);
+    defrag_offset_map_ptr defrag_list_create(const ip_defrag_key& key);
 
     /**
      * @brief try to reassemble ip frag
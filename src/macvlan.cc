@@ -1,8 +1,10 @@
 #include "macvlan.hpp"
 #include "def.hpp"
 #include "flow.hpp"
+#include "sock.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cerrno>
@@ -13,18 +15,110 @@
 #include <mutex>
 #include <string>
 
+#include <poll.h>
 #include <unistd.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
+#include <linux/bpf.h>
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
 
 namespace driver {
 
-macvlan_device::macvlan_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address)
-    : dev_name_(dev_name), status_(def::device_status::down) {
+namespace {
+
+// ipv4 field offset from network header
+const int32_t ip_frag_offset = 6;
+const int32_t ip_protocol_offset = 9;
+const int32_t ip_src_offset = 12;
+const int32_t ip_dst_offset = 16;
+// more fragment flag and fragment offset
+const int32_t ip_frag_mask = 0x3fff;
+
+// io_uring request kind in high half of user data, low half carry send slot
+const uint64_t uring_recv_tag = 1ull << 32;
+const uint64_t uring_wake_tag = 2ull << 32;
+const uint64_t uring_send_tag = 3ull << 32;
+const uint64_t uring_tag_mask = ~0ull << 32;
+// max io_uring buffer ring entries
+const uint32_t uring_max_buffers = 1 << 15;
+
+// send queued to io_uring, buffer is kept until kernel complete it
+struct uring_send {
+    flow::sk_buff::ptr buffer;
+    struct msghdr msg;
+    struct iovec iov[def::max_skb_frags + 1];
+};
+
+// make one jhash_final step, x ^= y, x -= rol32(y, shift)
+void append_hash_step(std::vector<struct bpf_insn>& program, uint8_t x, uint8_t y, int32_t shift) {
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_XOR | BPF_X, x, y, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_2, y, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_LSH | BPF_K, BPF_REG_2, 0, 0, shift));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_3, y, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_RSH | BPF_K, BPF_REG_3, 0, 0, 32 - shift));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_OR | BPF_X, BPF_REG_2, BPF_REG_3, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_SUB | BPF_X, x, BPF_REG_2, 0, 0));
+}
+
+// make fanout program, it return flow::get_flow_hash of frame, kernel take it modulo socket count
+std::vector<struct bpf_insn> make_fanout_program() {
+    // r7 local ip, r8 remote ip, r9 ports, packet load return host order like stack key
+    // jump offset count from next instruction, hash is at 23, zero at 74
+    std::vector<struct bpf_insn> program = {
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct __sk_buff, protocol), 0),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_2, 0, 71, htons(ETH_P_IP)),
+        utils::bpf::make_insn(BPF_LD | BPF_ABS | BPF_W, 0, 0, 0, ip_dst_offset),
+        utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_7, BPF_REG_0, 0, 0),
+        utils::bpf::make_insn(BPF_LD | BPF_ABS | BPF_W, 0, 0, 0, ip_src_offset),
+        utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_8, BPF_REG_0, 0, 0),
+        utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_K, BPF_REG_9, 0, 0, 0),
+        // fragment has no port, hash on ip only
+        utils::bpf::make_insn(BPF_LD | BPF_ABS | BPF_H, 0, 0, 0, ip_frag_offset),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JSET | BPF_K, BPF_REG_0, 0, 13, ip_frag_mask),
+        utils::bpf::make_insn(BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, ip_protocol_offset),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_0, 0, 2, int32_t(def::transport_protocol::tcp)),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_0, 0, 1, int32_t(def::transport_protocol::udp)),
+        utils::bpf::make_insn(BPF_JMP | BPF_JA, 0, 0, 9, 0),
+        // ports follow ip header, src port is loaded in high half
+        utils::bpf::make_insn(BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, 0),
+        utils::bpf::make_insn(BPF_ALU | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0xf),
+        utils::bpf::make_insn(BPF_ALU | BPF_LSH | BPF_K, BPF_REG_0, 0, 0, 2),
+        utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_9, BPF_REG_0, 0, 0),
+        utils::bpf::make_insn(BPF_LD | BPF_IND | BPF_W, 0, BPF_REG_9, 0, 0),
+        utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_9, BPF_REG_0, 0, 0),
+        utils::bpf::make_insn(BPF_ALU | BPF_LSH | BPF_K, BPF_REG_9, 0, 0, 16),
+        utils::bpf::make_insn(BPF_ALU | BPF_RSH | BPF_K, BPF_REG_0, 0, 0, 16),
+        utils::bpf::make_insn(BPF_ALU | BPF_OR | BPF_X, BPF_REG_9, BPF_REG_0, 0, 0),
+    };
+    // hash: same steps as utils::generic::jhash_3words
+    append_hash_step(program, BPF_REG_9, BPF_REG_8, 14);
+    append_hash_step(program, BPF_REG_7, BPF_REG_9, 11);
+    append_hash_step(program, BPF_REG_8, BPF_REG_7, 15);
+    append_hash_step(program, BPF_REG_9, BPF_REG_8, 16);
+    append_hash_step(program, BPF_REG_7, BPF_REG_9, 4);
+    append_hash_step(program, BPF_REG_8, BPF_REG_7, 14);
+    append_hash_step(program, BPF_REG_9, BPF_REG_8, 24);
+    program.push_back(utils::bpf::make_insn(BPF_ALU | BPF_MOV | BPF_X, BPF_REG_0, BPF_REG_9, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    // zero: not ipv4, all go to first socket
+    program.push_back(utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0));
+    program.push_back(utils::bpf::make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    return program;
+}
+
+}
+
+macvlan_device::macvlan_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address,
+    uint16_t mtu, uint16_t headroom, const macvlan_rx_config& rx_config, const macvlan_tx_config& tx_config)
+    : dev_name_(dev_name), fanout_prog_fd_(-1), mtu_(mtu), headroom_(headroom), rx_config_(rx_config), tx_config_(tx_config), tx_ring_fd_(-1), tx_ring_(nullptr), tx_ring_size_(0), tx_block_size_(0), tx_block_frames_(0),
+    tx_frame_index_(0), tx_frame_count_(0), status_(def::device_status::down) {
     utils::generic::convert_string_to_mac(mac_address, mac_address_);
     utils::generic::convert_string_to_ip(ip_address, &ip_address_);
     // get ifindex by device name
@@ -32,6 +126,9 @@ macvlan_device::macvlan_device(const std::string& dev_name, const std::string& i
     if (if_index_ == 0) {
         std::cout << "get macvlan ifindex failed, err: " << std::strerror(errno) << std::endl;
     }
+    // sockets are created in up, count is known before device is registered
+    for (uint32_t index = 0; index < std::max<uint32_t>(rx_config_.fanout_count, 1); index++)
+        queues_.push_back(std::unique_ptr<macvlan_queue>(new macvlan_queue()));
 }
 
 macvlan_device::~macvlan_device() {
@@ -39,12 +136,83 @@ macvlan_device::~macvlan_device() {
 }
 
 bool macvlan_device::up() {
+    if (queues_.size() > 1 && rx_config_.fanout_mode == def::fanout_mode::ebpf && !load_fanout_program()) {
+        std::cout << "load macvlan fanout program failed, fall back to kernel hash" << std::endl;
+        rx_config_.fanout_mode = def::fanout_mode::hash;
+    }
+    // members join in order, so kernel index of socket is its queue index
+    for (auto& queue : queues_) {
+        if (!setup_queue(*queue))
+            return false;
+    }
+    // sends are queued by ring thread, socket without ring has none
+    if (tx_config_.mode == def::device_tx_mode::io_uring && rx_config_.mode != def::device_rx_mode::io_uring) {
+        std::cout << "macvlan io_uring tx need io_uring rx, fall back to sendmmsg mode" << std::endl;
+        tx_config_.mode = def::device_tx_mode::mmsg;
+    }
+    // one tx ring can not be shared by writer of each socket
+    if (tx_config_.mode == def::device_tx_mode::packet_ring && queues_.size() > 1) {
+        std::cout << "macvlan tx ring not support fanout, fall back to sendmmsg mode" << std::endl;
+        tx_config_.mode = def::device_tx_mode::mmsg;
+    }
+    if (tx_config_.mode == def::device_tx_mode::packet_ring && !setup_tx_ring()) {
+        std::cout << "setup macvlan tx ring failed, fall back to sendmmsg mode" << std::endl;
+        tx_config_.mode = def::device_tx_mode::mmsg;
+    }
+    // ring thread send frames of queue until it fall back
+    for (auto& queue : queues_)
+        queue->ring_tx = queue->ring != nullptr && tx_config_.mode == def::device_tx_mode::io_uring;
+    std::cout << "up macvlan device success, device name: " << dev_name_ << ", ifindex: " << (int)if_index_ 
+        << ", sockets: " << std::dec << queues_.size()
+        << ", mac: " << std::hex << utils::generic::format_mac_address(mac_address_) 
+        << ", ip: " << utils::generic::format_ip_address(ip_address_) << std::endl;
+    return true;
+}
+
+bool macvlan_device::down() {
+    for (auto& queue : queues_) {
+        if (queue->rx_ring != nullptr) {
+            munmap(queue->rx_ring, queue->rx_ring_size);
+            queue->rx_ring = nullptr;
+        }
+        if (queue->fd >= 0) {
+            close(queue->fd);
+            queue->fd = -1;
+        }
+        if (queue->event_fd >= 0) {
+            close(queue->event_fd);
+            queue->event_fd = -1;
+        }
+        // ring is still used by its thread, it is released with device
+    }
+    if (tx_ring_ != nullptr) {
+        munmap(tx_ring_, tx_ring_size_);
+        tx_ring_ = nullptr;
+    }
+    if (tx_ring_fd_ >= 0) {
+        close(tx_ring_fd_);
+        tx_ring_fd_ = -1;
+    }
+    if (fanout_prog_fd_ >= 0) {
+        close(fanout_prog_fd_);
+        fanout_prog_fd_ = -1;
+    }
+    return 0;
+}
+
+// create socket of queue
+bool macvlan_device::setup_queue(macvlan_queue& queue) {
     // connect to socket
-    macvlan_fd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-    if (macvlan_fd_ < 0) {
+    queue.fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (queue.fd < 0) {
         std::cout << "create raw socket failed" << std::strerror(errno) << std::endl;
         return false;
     }
+    // ring must be set before bind, or frames queued in between are lost to ring
+    if (rx_config_.mode == def::device_rx_mode::packet_ring && !setup_rx_ring(queue)) {
+        std::cout << "setup macvlan rx ring failed, fall back to recvmmsg mode" << std::endl;
+        rx_config_.mode = def::device_rx_mode::mmsg;
+    }
     // create link addr
     struct sockaddr_ll source_link;
     memset(&source_link, 0, sizeof(struct sockaddr_ll));
@@ -52,43 +220,178 @@ bool macvlan_device::up() {
     source_link.sll_ifindex = if_index_;
     source_link.sll_protocol = htons(ETH_P_ALL);
     // bind socket to device
-    if (bind(macvlan_fd_, (struct sockaddr*)&source_link, sizeof(struct sockaddr_ll)) < 0) {
+    if (bind(queue.fd, (struct sockaddr*)&source_link, sizeof(struct sockaddr_ll)) < 0) {
         std::cout << "bind raw socket failed" << std::strerror(errno) << std::endl;
         return false;
     }
-    std::cout << "up macvlan device success, device name: " << dev_name_ << ", ifindex: " << (int)if_index_ 
-        << ", mac: " << std::hex << utils::generic::format_mac_address(mac_address_) 
-        << ", ip: " << utils::generic::format_ip_address(ip_address_) << std::endl;
+    if (queues_.size() > 1 && !setup_fanout(queue))
+        return false;
+    // let kernel report checksum it verified, stack skip software verify for them
+    int aux_data = 1;
+    if (setsockopt(queue.fd, SOL_PACKET, PACKET_AUXDATA, &aux_data, sizeof(aux_data)) < 0)
+        std::cout << "enable packet auxdata failed, checksum is verified by stack, err: " << std::strerror(errno) << std::endl;
+    if (rx_config_.mode == def::device_rx_mode::io_uring && !setup_uring(queue)) {
+        std::cout << "setup macvlan io_uring failed, fall back to recvmmsg mode" << std::endl;
+        rx_config_.mode = def::device_rx_mode::mmsg;
+        queue.ring.reset();
+    }
     return true;
 }
 
-bool macvlan_device::down() {
-    if (macvlan_fd_ != 0)
-        close(macvlan_fd_); 
-    return 0;
+// create io_uring of socket
+bool macvlan_device::setup_uring(macvlan_queue& queue) {
+    // buffer ring size must be power of two
+    uint32_t buffers = 1;
+    while (buffers < std::min(rx_config_.uring_buffer_count, uring_max_buffers))
+        buffers <<= 1;
+    rx_config_.uring_buffer_count = buffers;
+    uint32_t depth = tx_config_.mode == def::device_tx_mode::io_uring ? std::max<uint32_t>(tx_config_.uring_depth, 1) : 0;
+    tx_config_.uring_depth = depth;
+    // one recv and one wake request stay armed, each posted buffer may complete once
+    queue.ring = uring::create(depth + 2, buffers + depth + 2);
+    if (queue.ring == nullptr)
+        return false;
+    if (!queue.ring->register_files(&queue.fd, 1))
+        return false;
+    if (!queue.ring->register_buffer_ring(def::uring_rx_buffer_group, buffers))
+        return false;
+    if (depth > 0) {
+        queue.event_fd = eventfd(0, EFD_CLOEXEC);
+        if (queue.event_fd < 0) {
+            std::cout << "create macvlan ring event fd failed, err: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    std::cout << "setup macvlan io_uring success, buffers: " << std::dec << buffers << ", send depth: " << depth << std::endl;
+    return true;
+}
+
+// join fanout group
+bool macvlan_device::setup_fanout(macvlan_queue& queue) {
+    int type = PACKET_FANOUT_HASH;
+    if (rx_config_.fanout_mode == def::fanout_mode::cpu)
+        type = PACKET_FANOUT_CPU;
+    else if (rx_config_.fanout_mode == def::fanout_mode::ebpf)
+        type = PACKET_FANOUT_EBPF;
+    // group is per device, socket must be bound before join
+    int fanout = (type << 16) | if_index_;
+    if (setsockopt(queue.fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+        std::cout << "join macvlan fanout group failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (type == PACKET_FANOUT_EBPF && setsockopt(queue.fd, SOL_PACKET, PACKET_FANOUT_DATA, &fanout_prog_fd_,
+        sizeof(fanout_prog_fd_)) < 0) {
+        std::cout << "attach macvlan fanout program failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // group member see frames sent by other sockets, like tx ring
+    int ignore = 1;
+    if (setsockopt(queue.fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore)) < 0)
+        std::cout << "ignore macvlan outgoing failed, err: " << std::strerror(errno) << std::endl;
+    return true;
+}
+
+// load fanout program
+bool macvlan_device::load_fanout_program() {
+    auto program = make_fanout_program();
+    char license[] = "GPL";
+    // verifier log of whole hash is larger than one page, short log fail the load
+    std::vector<char> log(1 << 16, 0);
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = reinterpret_cast<uint64_t>(program.data());
+    attr.insn_cnt = program.size();
+    attr.license = reinterpret_cast<uint64_t>(license);
+    attr.log_buf = reinterpret_cast<uint64_t>(log.data());
+    attr.log_size = log.size();
+    attr.log_level = 1;
+    fanout_prog_fd_ = utils::bpf::bpf_call(BPF_PROG_LOAD, attr);
+    if (fanout_prog_fd_ < 0) {
+        std::cout << "load fanout program failed, err: " << std::strerror(errno) << ", log: " << log.data() << std::endl;
+        return false;
+    }
+    return true;
 }
 
 // read buffer from device
 flow::sk_buff::ptr macvlan_device::read_from_device() {
+    auto& queue = *queues_[0];
     // unique lock
-    std::unique_lock<std::mutex> lock(read_mutex_);
-    read_cond_.wait(lock, [this] { return !this->read_head_.empty(); });
+    std::unique_lock<std::mutex> lock(queue.read_mutex);
+    queue.read_cond.wait(lock, [&] { return !queue.read_head.empty(); });
     // get buffer
-    auto buffer = read_head_.front();
-    read_head_.pop();
+    auto buffer = std::move(queue.read_head.front());
+    queue.read_head.pop();
+    flow::skb_set_owner(buffer, def::skb_owner::stack);
     return buffer;
 }
 
 // write buffer to device
-int macvlan_device::write_to_device(flow::sk_buff::ptr buffer) {
+int macvlan_device::write_to_device(const flow::sk_buff::ptr& buffer) {
     append_buffer_to_write_queue(buffer);
-    if (!buffer->child_frags.empty()) {
-        for (auto iter : buffer->child_frags)
-            append_buffer_to_write_queue(iter);
-    }
     return 0;
 }
 
+// read buffer batch from device
+size_t macvlan_device::read_from_device(flow::skb_batch& batch) {
+    return read_from_queue(0, batch);
+}
+
+// read buffer batch from socket
+size_t macvlan_device::read_from_queue(uint32_t index, flow::skb_batch& batch) {
+    auto& queue = *queues_[index];
+    std::unique_lock<std::mutex> lock(queue.read_mutex);
+    queue.read_cond.wait(lock, [&] { return !queue.read_head.empty(); });
+    while (!queue.read_head.empty() && !batch.full()) {
+        flow::skb_set_owner(queue.read_head.front(), def::skb_owner::stack);
+        batch.push(std::move(queue.read_head.front()));
+        queue.read_head.pop();
+    }
+    return batch.size();
+}
+
+// write buffer batch to device
+int macvlan_device::write_to_device(flow::skb_batch& batch) {
+    uint32_t queue_index[def::max_skb_batch];
+    for (size_t index = 0; index < batch.size(); index++) {
+        make_ether_header(batch[index]);
+        queue_index[index] = select_tx_queue(batch[index]);
+    }
+    // each queue lock is taken once per batch
+    for (uint32_t index = 0; index < queues_.size(); index++) {
+        auto& queue = *queues_[index];
+        bool pushed = false;
+        {
+            std::lock_guard<std::mutex> lock(queue.write_mutex);
+            for (size_t elem = 0; elem < batch.size(); elem++) {
+                if (queue_index[elem] != index)
+                    continue;
+                queue.write_head.push(batch[elem]);
+                pushed = true;
+            }
+            if (pushed)
+                wake_ring(queue);
+        }
+        if (pushed)
+            queue.write_cond.notify_one();
+    }
+    return batch.size();
+}
+
+// choose tx socket by flow hash
+uint32_t macvlan_device::select_tx_queue(const flow::sk_buff::ptr& buffer) {
+    if (queues_.size() == 1)
+        return 0;
+    // reply reuse rx hash, buffer from sock get hash from its key
+    uint32_t hash = buffer->hash;
+    if (hash == 0 && buffer->ext != nullptr && buffer->ext->key != nullptr) {
+        auto& key = buffer->ext->key;
+        hash = flow::get_flow_hash(key->local_ip, key->local_port, key->remote_ip, key->remote_port);
+    }
+    return hash % queues_.size();
+}
+
 // get macvlan device mac
 uint8_t* macvlan_device::get_device_mac() {
     return mac_address_;
@@ -104,68 +407,743 @@ uint8_t macvlan_device::get_device_ifindex() {
     return if_index_;
 }
 
+// get socket count
+uint32_t macvlan_device::get_queue_count() {
+    return queues_.size();
+}
+
+// get transmit completion stats
+macvlan_tx_stats macvlan_device::get_tx_stats() {
+    std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+    return tx_stats_;
+}
+
 void macvlan_device::read_thread() {
+    read_queue_thread(0);
+}
+
+void macvlan_device::write_thread() {
+    write_queue_thread(0);
+}
+
+// read frames from one socket
+void macvlan_device::read_queue_thread(uint32_t index) {
+    auto& queue = *queues_[index];
     // check if fd is valid
-    assert(macvlan_fd_ != 0);
-    char buf[def::flow_buffer_size];
+    assert(queue.fd >= 0);
+    if (queue.ring != nullptr)
+        return read_uring_thread(queue);
+    if (queue.rx_ring != nullptr)
+        return read_ring_thread(queue);
+    if (rx_config_.mode == def::device_rx_mode::mmsg)
+        return read_mmsg_thread(queue);
+    read_socket_thread(queue);
+}
+
+// read frames with recvmsg
+void macvlan_device::read_socket_thread(macvlan_queue& queue) {
+    size_t frame_size = def::max_ether_header + mtu_;
+    flow::skb_batch batch;
+    // kernel checksum status is passed in control message
+    char control[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    struct iovec iov;
+    struct msghdr msg;
     while (true) {
-        size_t size = read(macvlan_fd_, buf, def::flow_buffer_size);
-        if (size < 0) {
+        // recv straight into pool buffer, headroom is left for in place reply
+        flow::sk_buff::ptr skb = alloc_rx_buffer();
+        if (skb == nullptr) {
+            std::cout << "alloc macvlan rx buffer failed" << std::endl;
+            break;
+        }
+        // block for first frame, then take frames already queued in socket
+        int flags = batch.empty() ? MSG_TRUNC : MSG_TRUNC | MSG_DONTWAIT;
+        iov.iov_base = skb->data + skb->data_begin;
+        iov.iov_len = frame_size;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t size = recvmsg(queue.fd, &msg, flags);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            flush_read_batch(queue, batch);
+            continue;
+        } else if (size < 0) {
             std::cout << "read macvlan buffer failed" << std::endl;
             break;
         } else if (size == 0) {
             std::cout << "read macvlan buffer end" << std::endl;
+            continue;
+        } else if (size_t(size) > frame_size) {
+            std::cout << "drop macvlan frame exceed mtu, size: " << std::dec << size << std::endl;
+            continue;
         }
-        // get ether mac 
-        const flow::ether_hdr* hdr = reinterpret_cast<const flow::ether_hdr*>(buf);
-        // check if should ignore
-        if (!memcmp(mac_address_, hdr->dst, def::mac_len) &&
-            !memcmp(def::broadcast_mac, hdr->dst, def::mac_len))
+        if (!accept_rx_frame(skb, size))
             continue;
-        std::cout << "rcv ether msg, " << utils::generic::format_mac_address(hdr->src) << " -> "
-            << utils::generic::format_mac_address(hdr->dst) << std::endl;
-        // malloc flow
-        flow::sk_buff::ptr skb = flow::sk_buff::alloc(size);
-        // copy buffer
-        skb->protocol = htons(hdr->protocol);
-        skb->dev = weak_from_this();
-        skb->store_data(buf, size);
-        flow::skb_reserve(skb, flow::get_ether_offset());
-        // push to queue
-        std::lock_guard<std::mutex> lock(read_mutex_);
-        read_head_.push(skb);
-        // std::cout << utils::generic::format_mac_address(hdr->src) << " -> " 
-        //     << utils::generic::format_mac_address(hdr->dst) << ", sizes: " 
-        //     << std::dec << size << ", protocol: "<< std::hex << (int)skb->protocol << std::endl;
-        read_cond_.notify_one();
+        skb->ip_summed = get_checksum_state(msg);
+        batch.push(std::move(skb));
+        if (batch.full())
+            flush_read_batch(queue, batch);
     }
 }
 
+// read frames from rx ring
+void macvlan_device::read_ring_thread(macvlan_queue& queue) {
+    size_t frame_size = def::max_ether_header + mtu_;
+    flow::skb_batch batch;
+    uint32_t block_index = 0;
+    struct pollfd poll_fd;
+    poll_fd.fd = queue.fd;
+    poll_fd.events = POLLIN | POLLERR;
+    while (true) {
+        auto block = reinterpret_cast<struct tpacket_block_desc*>(queue.rx_ring + size_t(block_index) * rx_config_.block_size);
+        // block is owned by kernel until it is retired, by full or timeout
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            flush_read_batch(queue, batch);
+            if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+                std::cout << "poll macvlan rx ring failed, err: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+        auto packet = reinterpret_cast<struct tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t index = 0; index < block->hdr.bh1.num_pkts; index++) {
+            auto frame = reinterpret_cast<uint8_t*>(packet) + packet->tp_mac;
+            size_t size = packet->tp_snaplen;
+            if (packet->tp_len > size || size > frame_size) {
+                std::cout << "drop macvlan frame exceed mtu, size: " << std::dec << packet->tp_len << std::endl;
+            } else {
+                // copy once into pool buffer, so block can be returned to kernel right away
+                flow::sk_buff::ptr skb = alloc_rx_buffer();
+                if (skb == nullptr) {
+                    std::cout << "alloc macvlan rx buffer failed" << std::endl;
+                    break;
+                }
+                memcpy(skb->data + skb->data_begin, frame, size);
+                if (accept_rx_frame(skb, size)) {
+                    skb->ip_summed = get_checksum_state(packet->tp_status);
+                    batch.push(std::move(skb));
+                    if (batch.full())
+                        flush_read_batch(queue, batch);
+                }
+            }
+            packet = reinterpret_cast<struct tpacket3_hdr*>(reinterpret_cast<uint8_t*>(packet) + packet->tp_next_offset);
+        }
+        // return whole block to kernel
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        block_index = (block_index + 1) % rx_config_.block_count;
+    }
+}
 
-// write buffer to device
-void macvlan_device::write_thread() {
-    // init write buffer
-    flow::sk_buff::ptr buffer = nullptr;
+// read frames with recvmmsg
+void macvlan_device::read_mmsg_thread(macvlan_queue& queue) {
+    size_t frame_size = def::max_ether_header + mtu_;
+    size_t count = std::min<size_t>(std::max<uint32_t>(rx_config_.mmsg_count, 1), def::max_skb_batch);
+    flow::skb_batch batch;
+    // slots keep buffers not consumed by last call, like frames for other device
+    flow::sk_buff::ptr skbs[def::max_skb_batch];
+    struct mmsghdr msgs[def::max_skb_batch];
+    struct iovec iov[def::max_skb_batch];
+    char control[def::max_skb_batch][CMSG_SPACE(sizeof(struct tpacket_auxdata))];
     while (true) {
-        {
-            std::unique_lock<std::mutex> lock(write_mutex_);
-            write_cond_.wait(lock, [&] () { return !write_head_.empty(); });
-            buffer = write_head_.front();
-            write_head_.pop();
-        }
-        // write buffer to device
-        size_t size = write(macvlan_fd_, buffer->get_data(), buffer->get_data_len());
-        if (size < 0) {
-            std::cout << "write macvlan buffer failed" << std::endl;
+        for (size_t index = 0; index < count; index++) {
+            if (skbs[index] == nullptr) {
+                skbs[index] = alloc_rx_buffer();
+                if (skbs[index] == nullptr) {
+                    std::cout << "alloc macvlan rx buffer failed" << std::endl;
+                    return;
+                }
+            }
+            iov[index].iov_base = skbs[index]->data + skbs[index]->data_begin;
+            iov[index].iov_len = frame_size;
+            memset(&msgs[index], 0, sizeof(struct mmsghdr));
+            msgs[index].msg_hdr.msg_iov = &iov[index];
+            msgs[index].msg_hdr.msg_iovlen = 1;
+            msgs[index].msg_hdr.msg_control = control[index];
+            msgs[index].msg_hdr.msg_controllen = sizeof(control[index]);
+        }
+        // block for first frame, then take frames already queued in socket
+        int size = recvmmsg(queue.fd, msgs, count, MSG_WAITFORONE | MSG_TRUNC, nullptr);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size < 0) {
+            std::cout << "read macvlan batch failed, err: " << std::strerror(errno) << std::endl;
             break;
-        } else if (size == 0) {
-            std::cout << "write macvlan buffer end" << std::endl;
         }
+        for (int index = 0; index < size; index++) {
+            if (msgs[index].msg_len > frame_size) {
+                std::cout << "drop macvlan frame exceed mtu, size: " << std::dec << msgs[index].msg_len << std::endl;
+                continue;
+            }
+            if (msgs[index].msg_len == 0 || !accept_rx_frame(skbs[index], msgs[index].msg_len))
+                continue;
+            skbs[index]->ip_summed = get_checksum_state(msgs[index].msg_hdr);
+            batch.push(std::move(skbs[index]));
+            skbs[index] = nullptr;
+        }
+        // one notify per call
+        flush_read_batch(queue, batch);
+    }
+}
+
+// reap completions of socket io_uring
+void macvlan_device::read_uring_thread(macvlan_queue& queue) {
+    auto& ring = *queue.ring;
+    size_t frame_size = def::max_ether_header + mtu_;
+    // kernel put recvmsg header and auxdata before frame, they land in room reserved before headroom
+    size_t control_size = CMSG_SPACE(sizeof(struct tpacket_auxdata));
+    size_t meta_size = sizeof(struct io_uring_recvmsg_out) + control_size;
+    bool uring_tx = tx_config_.mode == def::device_tx_mode::io_uring;
+    flow::skb_batch batch;
+    // buffer id is slot index, slot own buffer while kernel may fill it
+    std::vector<flow::sk_buff::ptr> rx_slots(rx_config_.uring_buffer_count);
+    std::vector<uint16_t> empty_slots;
+    std::vector<uring_send> tx_slots(tx_config_.uring_depth);
+    std::vector<uint32_t> free_slots;
+    for (uint32_t slot = 0; slot < tx_slots.size(); slot++)
+        free_slots.push_back(slot);
+    // rx buffer is allocated here, so it come from arena bound to this thread
+    auto post_buffer = [&] (uint16_t id) {
+        if (rx_slots[id] == nullptr) {
+            auto skb = flow::sk_buff::alloc(meta_size + headroom_ + frame_size);
+            if (skb == nullptr) {
+                empty_slots.push_back(id);
+                return;
+            }
+            flow::skb_reserve(skb, meta_size + headroom_);
+            rx_slots[id] = std::move(skb);
+        }
+        auto& skb = rx_slots[id];
+        ring.add_buffer(skb->data + skb->data_begin - meta_size, meta_size + frame_size, id);
+    };
+    for (uint32_t id = 0; id < rx_slots.size(); id++)
+        post_buffer(id);
+    ring.commit_buffers();
+    // multishot recv keep name and control len of it
+    struct msghdr recv_msg;
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_controllen = control_size;
+    uint64_t wake_value = 0;
+    bool recv_armed = false;
+    bool wake_armed = false;
+    // recv failed before any frame arrive mean kernel not support it, like multishot recvmsg before 6.0
+    bool recv_done = false;
+    bool recv_failed = false;
+    bool ring_failed = false;
+    struct io_uring_cqe* cqes[def::max_skb_batch];
+    while (!recv_failed) {
+        // multishot recv end when buffers run out, arm again once some are posted
+        auto sqe = recv_armed || empty_slots.size() == rx_slots.size() ? nullptr : ring.get_sqe();
+        if (sqe != nullptr) {
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = 0;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->addr = reinterpret_cast<uint64_t>(&recv_msg);
+            sqe->len = 1;
+            sqe->buf_group = def::uring_rx_buffer_group;
+            sqe->user_data = uring_recv_tag;
+            recv_armed = true;
+        }
+        sqe = !uring_tx || wake_armed ? nullptr : ring.get_sqe();
+        if (sqe != nullptr) {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = queue.event_fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&wake_value);
+            sqe->len = sizeof(wake_value);
+            sqe->user_data = uring_wake_tag;
+            wake_armed = true;
+        }
+        uint32_t queued = 0;
+        uint64_t dropped = 0;
+        if (uring_tx) {
+            std::lock_guard<std::mutex> lock(queue.write_mutex);
+            while (!queue.write_head.empty() && !free_slots.empty()) {
+                uint32_t slot = free_slots.back();
+                auto& send = tx_slots[slot];
+                // gather linear data and payload segments, slot is taken only if frame is sent
+                size_t iov_count = flow::skb_fill_iovec(queue.write_head.front(), send.iov);
+                if (iov_count == 0) {
+                    std::cout << "drop macvlan frame, too many segments: " << std::dec
+                        << queue.write_head.front()->ext->frags.size() << std::endl;
+                    flow::skb_tx_done(queue.write_head.front());
+                    queue.write_head.pop();
+                    dropped++;
+                    continue;
+                }
+                sqe = ring.get_sqe();
+                if (sqe == nullptr)
+                    break;
+                free_slots.pop_back();
+                send.buffer = std::move(queue.write_head.front());
+                queue.write_head.pop();
+                memset(&send.msg, 0, sizeof(send.msg));
+                send.msg.msg_iov = send.iov;
+                send.msg.msg_iovlen = iov_count;
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = 0;
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->addr = reinterpret_cast<uint64_t>(&send.msg);
+                sqe->len = 1;
+                sqe->user_data = uring_send_tag | slot;
+                queued++;
+            }
+            // sleep only if nothing is left, writer signal event fd then
+            queue.ring_waiting = queue.write_head.empty();
+        }
+        // one enter submit sends and wait any completion
+        if (ring.submit_and_wait(1) < 0) {
+            ring_failed = true;
+            break;
+        }
+        if (queued > 0 || dropped > 0) {
+            std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+            tx_stats_.kicks += queued > 0;
+            tx_stats_.failed += dropped;
+        }
+        uint32_t count = 0;
+        uint64_t sent = 0;
+        uint64_t failed = 0;
+        while ((count = ring.peek_cqes(cqes, def::max_skb_batch)) > 0) {
+            for (uint32_t index = 0; index < count; index++) {
+                auto cqe = cqes[index];
+                uint64_t tag = cqe->user_data & uring_tag_mask;
+                if (tag == uring_wake_tag) {
+                    wake_armed = false;
+                } else if (tag == uring_send_tag) {
+                    uint32_t slot = cqe->user_data & ~uring_tag_mask;
+                    if (cqe->res < 0) {
+                        std::cout << "write macvlan ring buffer failed, err: " << std::strerror(-cqe->res) << std::endl;
+                        failed++;
+                    } else {
+                        sent++;
+                    }
+                    flow::skb_tx_done(tx_slots[slot].buffer);
+                    tx_slots[slot].buffer.reset();
+                    free_slots.push_back(slot);
+                } else if (tag == uring_recv_tag) {
+                    if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+                        recv_armed = false;
+                    // out of posted buffers or interrupted, recv is armed again on next loop
+                    if (cqe->res < 0 && recv_done && (cqe->res == -ENOBUFS || cqe->res == -EINTR))
+                        continue;
+                    if (cqe->res < 0) {
+                        std::cout << "read macvlan ring buffer failed, err: " << std::strerror(-cqe->res) << std::endl;
+                        recv_failed = true;
+                        continue;
+                    }
+                    recv_done = true;
+                    if ((cqe->flags & IORING_CQE_F_BUFFER) == 0)
+                        continue;
+                    uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    auto& skb = rx_slots[id];
+                    auto out = reinterpret_cast<struct io_uring_recvmsg_out*>(skb->data + skb->data_begin - meta_size);
+                    // control data is read before frame is accepted and headroom reused
+                    struct msghdr msg;
+                    memset(&msg, 0, sizeof(msg));
+                    // name room is sized by submitted name len, out namelen is real address len and may differ
+                    msg.msg_control = reinterpret_cast<uint8_t*>(out + 1) + recv_msg.msg_namelen;
+                    msg.msg_controllen = out->controllen;
+                    uint8_t ip_summed = get_checksum_state(msg);
+                    if (out->flags & MSG_TRUNC) {
+                        std::cout << "drop macvlan frame exceed mtu, size: " << std::dec << out->payloadlen << std::endl;
+                    } else if (out->payloadlen > 0 && accept_rx_frame(skb, out->payloadlen)) {
+                        skb->ip_summed = ip_summed;
+                        batch.push(std::move(skb));
+                        if (batch.full())
+                            flush_read_batch(queue, batch);
+                    }
+                    // dropped frame leave buffer in slot, it is posted again
+                    post_buffer(id);
+                }
+            }
+            ring.advance_cqes(count);
+        }
+        // retry slots pool could not fill
+        auto retry_slots = std::move(empty_slots);
+        empty_slots.clear();
+        for (auto id : retry_slots)
+            post_buffer(id);
+        ring.commit_buffers();
+        flush_read_batch(queue, batch);
+        if (sent > 0 || failed > 0) {
+            std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+            tx_stats_.sent += sent;
+            tx_stats_.failed += failed;
+        }
+    }
+    // sends in flight and wake read point to memory of this thread, reap them before ring is closed
+    if (!ring_failed && wake_armed) {
+        uint64_t value = 1;
+        if (write(queue.event_fd, &value, sizeof(value)) < 0)
+            std::cout << "wake macvlan ring failed, err: " << std::strerror(errno) << std::endl;
+    }
+    while (!ring_failed && (wake_armed || recv_armed || free_slots.size() < tx_slots.size())) {
+        if (ring.submit_and_wait(1) < 0)
+            break;
+        uint32_t count = 0;
+        while ((count = ring.peek_cqes(cqes, def::max_skb_batch)) > 0) {
+            for (uint32_t index = 0; index < count; index++) {
+                auto cqe = cqes[index];
+                uint64_t tag = cqe->user_data & uring_tag_mask;
+                if (tag == uring_wake_tag) {
+                    wake_armed = false;
+                } else if (tag == uring_send_tag) {
+                    uint32_t slot = cqe->user_data & ~uring_tag_mask;
+                    flow::skb_tx_done(tx_slots[slot].buffer);
+                    tx_slots[slot].buffer.reset();
+                    free_slots.push_back(slot);
+                } else if (tag == uring_recv_tag && (cqe->flags & IORING_CQE_F_MORE) == 0) {
+                    recv_armed = false;
+                }
+            }
+            ring.advance_cqes(count);
+        }
+    }
+    std::cout << "macvlan io_uring stopped, fall back to recvmmsg mode" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(queue.write_mutex);
+        // writer thread take frames left in write head
+        queue.ring_tx = false;
+        queue.ring_waiting = false;
+        queue.ring.reset();
+    }
+    queue.write_cond.notify_one();
+    // kernel may still fill posted buffers of ring it could not drain, keep them out of pool
+    if (!ring_failed)
+        rx_slots.clear();
+    read_mmsg_thread(queue);
+}
+
+// setup rx ring
+bool macvlan_device::setup_rx_ring(macvlan_queue& queue) {
+    int version = TPACKET_V3;
+    if (setsockopt(queue.fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        std::cout << "set packet version failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = rx_config_.block_size;
+    req.tp_block_nr = rx_config_.block_count;
+    req.tp_frame_size = rx_config_.frame_size;
+    req.tp_frame_nr = (rx_config_.block_size / rx_config_.frame_size) * rx_config_.block_count;
+    req.tp_retire_blk_tov = rx_config_.block_timeout;
+    if (setsockopt(queue.fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        std::cout << "set packet rx ring failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    queue.rx_ring_size = size_t(rx_config_.block_size) * rx_config_.block_count;
+    void* ring = mmap(nullptr, queue.rx_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, queue.fd, 0);
+    if (ring == MAP_FAILED) {
+        // locked pages may exceed memlock limit
+        ring = mmap(nullptr, queue.rx_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, queue.fd, 0);
+    }
+    if (ring == MAP_FAILED) {
+        std::cout << "map packet rx ring failed, err: " << std::strerror(errno) << std::endl;
+        queue.rx_ring_size = 0;
+        return false;
     }
+    queue.rx_ring = static_cast<uint8_t*>(ring);
+    std::cout << "setup macvlan rx ring success, blocks: " << std::dec << rx_config_.block_count
+        << ", block size: " << rx_config_.block_size << std::endl;
+    return true;
+}
+
+// alloc rx buffer
+flow::sk_buff::ptr macvlan_device::alloc_rx_buffer() {
+    size_t alloc_size = headroom_ + def::max_ether_header + mtu_;
+    flow::sk_buff::ptr skb = flow::sk_buff::alloc(alloc_size);
+    if (skb == nullptr)
+        return nullptr;
+    flow::skb_reserve(skb, headroom_);
+    return skb;
+}
+
+// filter frame and fill buffer info
+bool macvlan_device::accept_rx_frame(const flow::sk_buff::ptr& skb, size_t size) {
+    // get ether mac 
+    const flow::ether_hdr* hdr = reinterpret_cast<const flow::ether_hdr*>(skb->data + skb->data_begin);
+    // check if should ignore
+    if (!memcmp(mac_address_, hdr->dst, def::mac_len) &&
+        !memcmp(def::broadcast_mac, hdr->dst, def::mac_len))
+        return false;
+    std::cout << "rcv ether msg, " << utils::generic::format_mac_address(hdr->src) << " -> "
+        << utils::generic::format_mac_address(hdr->dst) << std::endl;
+    flow::skb_rx_init(skb, if_index_, size);
+    return true;
+}
+
+// get checksum state reported by kernel
+uint8_t macvlan_device::get_checksum_state(const struct msghdr& msg) {
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level != SOL_PACKET || cmsg->cmsg_type != PACKET_AUXDATA)
+            continue;
+        struct tpacket_auxdata aux_data;
+        memcpy(&aux_data, CMSG_DATA(cmsg), sizeof(aux_data));
+        return get_checksum_state(aux_data.tp_status);
+    }
+    return uint8_t(def::checksum_state::none);
+}
+
+// get checksum state from packet status
+uint8_t macvlan_device::get_checksum_state(uint32_t status) {
+    // frame sent from local host may carry checksum not filled yet, it never cross wire
+    if (status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY))
+        return uint8_t(def::checksum_state::unnecessary);
+    return uint8_t(def::checksum_state::none);
+}
+
+// move rx batch to read queue
+void macvlan_device::flush_read_batch(macvlan_queue& queue, flow::skb_batch& batch) {
+    if (batch.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(queue.read_mutex);
+        for (auto& buffer : batch)
+            queue.read_head.push(std::move(buffer));
+    }
+    queue.read_cond.notify_one();
+    batch.clear();
+}
+
+// write buffer to one socket
+void macvlan_device::write_queue_thread(uint32_t index) {
+    auto& queue = *queues_[index];
+    {
+        // ring thread send frames of write head, writer take over if ring fall back
+        std::unique_lock<std::mutex> lock(queue.write_mutex);
+        queue.write_cond.wait(lock, [&] () { return !queue.ring_tx; });
+    }
+    // io_uring tx mode is left only when ring fall back
+    auto mode = tx_config_.mode == def::device_tx_mode::io_uring ? def::device_tx_mode::mmsg : tx_config_.mode;
+    std::vector<flow::sk_buff::ptr> buffers;
+    buffers.reserve(def::max_skb_batch);
+    while (true) {
+        {
+            // take up to one batch per lock
+            std::unique_lock<std::mutex> lock(queue.write_mutex);
+            queue.write_cond.wait(lock, [&] () { return !queue.write_head.empty(); });
+            while (!queue.write_head.empty() && buffers.size() < def::max_skb_batch) {
+                buffers.push_back(std::move(queue.write_head.front()));
+                queue.write_head.pop();
+            }
+        }
+        if (mode == def::device_tx_mode::packet_ring) {
+            if (!send_ring_batch(queue.fd, buffers))
+                return;
+        } else if (mode == def::device_tx_mode::mmsg) {
+            if (!send_mmsg_batch(queue.fd, buffers))
+                return;
+        } else {
+            for (auto& buffer : buffers) {
+                if (!send_buffer(queue.fd, buffer))
+                    return;
+            }
+        }
+        for (auto& buffer : buffers)
+            flow::skb_tx_done(buffer);
+        // kernel has copied frames, buffers go back to pool here
+        buffers.clear();
+    }
+}
+
+// send one buffer
+bool macvlan_device::send_buffer(int fd, const flow::sk_buff::ptr& buffer) {
+    // gather linear data and payload segments
+    struct iovec iov[def::max_skb_frags + 1];
+    size_t iov_count = flow::skb_fill_iovec(buffer, iov);
+    if (iov_count == 0) {
+        std::cout << "drop macvlan frame, too many segments: " << std::dec << buffer->ext->frags.size() << std::endl;
+        std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+        tx_stats_.failed++;
+        return true;
+    }
+    // write buffer to device
+    ssize_t size = writev(fd, iov, iov_count);
+    if (size < 0) {
+        std::cout << "write macvlan buffer failed" << std::endl;
+        return false;
+    } else if (size == 0) {
+        std::cout << "write macvlan buffer end" << std::endl;
+    }
+    return true;
+}
+
+// send buffers with one syscall
+bool macvlan_device::send_mmsg_batch(int fd, const std::vector<flow::sk_buff::ptr>& buffers) {
+    struct mmsghdr msgs[def::max_skb_batch];
+    struct iovec iov[def::max_skb_batch][def::max_skb_frags + 1];
+    size_t count = 0;
+    uint64_t dropped = 0;
+    for (size_t index = 0; index < std::min<size_t>(buffers.size(), def::max_skb_batch); index++) {
+        auto& buffer = buffers[index];
+        // gather linear data and payload segments
+        size_t iov_count = flow::skb_fill_iovec(buffer, iov[count]);
+        if (iov_count == 0) {
+            std::cout << "drop macvlan frame, too many segments: " << std::dec << buffer->ext->frags.size() << std::endl;
+            dropped++;
+            continue;
+        }
+        memset(&msgs[count].msg_hdr, 0, sizeof(struct msghdr));
+        msgs[count].msg_hdr.msg_iov = iov[count];
+        msgs[count].msg_hdr.msg_iovlen = iov_count;
+        count++;
+    }
+    // kernel may take part of batch, send the rest again
+    size_t sent = 0;
+    while (sent < count) {
+        int size = sendmmsg(fd, msgs + sent, count - sent, 0);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size < 0) {
+            std::cout << "write macvlan batch failed, err: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        sent += size;
+    }
+    std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+    tx_stats_.sent += sent;
+    tx_stats_.failed += dropped;
+    if (count > 0)
+        tx_stats_.kicks++;
+    return true;
+}
+
+// copy buffers to tx ring and kick kernel
+bool macvlan_device::send_ring_batch(int fd, const std::vector<flow::sk_buff::ptr>& buffers) {
+    size_t capacity = tx_config_.frame_size - (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll));
+    uint64_t queued = 0;
+    for (auto& buffer : buffers) {
+        size_t len = flow::skb_len(buffer);
+        if (len > capacity) {
+            // larger than ring frame, like jumbo frame, send by socket
+            if (!send_buffer(fd, buffer))
+                return false;
+            continue;
+        }
+        auto frame = get_tx_frame();
+        if (frame == nullptr)
+            return false;
+        auto data = reinterpret_cast<char*>(frame) + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+        flow::skb_copy_data(buffer, data, len);
+        frame->tp_len = len;
+        __atomic_store_n(&frame->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        tx_frame_index_ = (tx_frame_index_ + 1) % tx_frame_count_;
+        queued++;
+    }
+    if (queued == 0)
+        return true;
+    // one kick for whole batch, completion is collected when frame is reused
+    if (send(tx_ring_fd_, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+        std::cout << "kick macvlan tx ring failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+    tx_stats_.sent += queued;
+    tx_stats_.kicks++;
+    return true;
+}
+
+// get next free tx ring frame
+struct tpacket2_hdr* macvlan_device::get_tx_frame() {
+    auto frame = reinterpret_cast<struct tpacket2_hdr*>(tx_ring_ + (tx_frame_index_ / tx_block_frames_) * tx_block_size_
+        + (tx_frame_index_ % tx_block_frames_) * tx_config_.frame_size);
+    while (true) {
+        auto status = __atomic_load_n(&frame->tp_status, __ATOMIC_ACQUIRE);
+        if (status == TP_STATUS_AVAILABLE)
+            return frame;
+        if (status & TP_STATUS_WRONG_FORMAT) {
+            // kernel reject frame, release it
+            std::cout << "macvlan tx ring frame rejected, len: " << std::dec << frame->tp_len << std::endl;
+            std::lock_guard<std::mutex> lock(tx_stats_mutex_);
+            tx_stats_.failed++;
+            __atomic_store_n(&frame->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+            return frame;
+        }
+        // ring is full, blocking kick return after pending frames are sent
+        if (send(tx_ring_fd_, nullptr, 0, 0) < 0 && errno != EINTR && errno != ENOBUFS) {
+            std::cout << "kick macvlan tx ring failed, err: " << std::strerror(errno) << std::endl;
+            return nullptr;
+        }
+    }
+}
+
+// setup tx ring
+bool macvlan_device::setup_tx_ring() {
+    // protocol 0 socket never receive, so frames are not looped back to ring owner
+    tx_ring_fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (tx_ring_fd_ < 0) {
+        std::cout << "create tx ring socket failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    int version = TPACKET_V2;
+    if (setsockopt(tx_ring_fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        std::cout << "set packet version failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // block must be multiple of page size, it holds whole frames
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    tx_block_size_ = (tx_config_.frame_size + page_size - 1) / page_size * page_size;
+    tx_block_frames_ = tx_block_size_ / tx_config_.frame_size;
+    uint32_t block_count = (tx_config_.frame_count + tx_block_frames_ - 1) / tx_block_frames_;
+    tx_frame_count_ = block_count * tx_block_frames_;
+    struct tpacket_req req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = tx_block_size_;
+    req.tp_block_nr = block_count;
+    req.tp_frame_size = tx_config_.frame_size;
+    req.tp_frame_nr = tx_frame_count_;
+    if (setsockopt(tx_ring_fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        std::cout << "set packet tx ring failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    tx_ring_size_ = tx_block_size_ * block_count;
+    void* ring = mmap(nullptr, tx_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, tx_ring_fd_, 0);
+    if (ring == MAP_FAILED) {
+        std::cout << "map packet tx ring failed, err: " << std::strerror(errno) << std::endl;
+        tx_ring_size_ = 0;
+        return false;
+    }
+    tx_ring_ = static_cast<uint8_t*>(ring);
+    struct sockaddr_ll link;
+    memset(&link, 0, sizeof(struct sockaddr_ll));
+    link.sll_family = AF_PACKET;
+    link.sll_ifindex = if_index_;
+    link.sll_protocol = 0;
+    if (bind(tx_ring_fd_, (struct sockaddr*)&link, sizeof(struct sockaddr_ll)) < 0) {
+        std::cout << "bind tx ring socket failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::cout << "setup macvlan tx ring success, frames: " << std::dec << tx_frame_count_ << std::endl;
+    return true;
 }
 
 // apend buffer
-void macvlan_device::append_buffer_to_write_queue(const flow::sk_buff::ptr buffer) {
+void macvlan_device::append_buffer_to_write_queue(const flow::sk_buff::ptr& buffer) {
+    make_ether_header(buffer);
+    auto& queue = *queues_[select_tx_queue(buffer)];
+    std::unique_lock<std::mutex> lock(queue.write_mutex);
+    queue.write_head.push(buffer);
+    if (queue.ring_tx)
+        wake_ring(queue);
+    else
+        queue.write_cond.notify_one();
+}
+
+// wake ring thread
+void macvlan_device::wake_ring(macvlan_queue& queue) {
+    if (!queue.ring_waiting)
+        return;
+    // one signal per sleep, ring thread take whole write head when it wake
+    queue.ring_waiting = false;
+    uint64_t value = 1;
+    if (write(queue.event_fd, &value, sizeof(value)) < 0)
+        std::cout << "wake macvlan ring failed, err: " << std::strerror(errno) << std::endl;
+}
+
+// make ether header
+void macvlan_device::make_ether_header(const flow::sk_buff::ptr& buffer) {
     // push to ether header
     flow::skb_push(buffer, sizeof(struct flow::ether_hdr));
     // create ether header
@@ -173,9 +1151,9 @@ void macvlan_device::append_buffer_to_write_queue(const flow::sk_buff::ptr buffe
     ether_hdr->protocol = htons(buffer->protocol);
     memcpy(ether_hdr->src, mac_address_, def::mac_len);
     memcpy(ether_hdr->dst, std::get<std::array<uint8_t, def::mac_len>>(buffer->dst).data(), def::mac_len);
-    std::unique_lock<std::mutex> lock(write_mutex_);
-    write_head_.push(buffer);
-    write_cond_.notify_one();
+    // write thread hold reference from now on
+    flow::skb_set_shared(buffer);
+    flow::skb_set_owner(buffer, def::skb_owner::device_tx);
 }
 
 
@@ -4,17 +4,115 @@
 #include "def.hpp"
 #include "flow.hpp"
 #include "interface.hpp"
-
+#include "uring.hpp"
 
 #include <condition_variable>
 #include <cstdint>
-#include <queue>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+
 namespace driver {
 
+/**
+ * @file macvlan_device.hpp
+ * @brief macvlan_device receive config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct macvlan_rx_config {
+    /// receive mode, fall back to socket if not supported
+    def::device_rx_mode mode = def::device_rx_mode::socket;
+    /// ring block size, must be multiple of page size
+    uint32_t block_size = 1 << 20;
+    /// ring block count
+    uint32_t block_count = 16;
+    /// ring frame size, only used to fill kernel request in block mode
+    uint32_t frame_size = 2048;
+    /// ms before kernel retire a block not full
+    uint32_t block_timeout = 10;
+    /// frames per recvmmsg call, up to one batch
+    uint32_t mmsg_count = def::max_skb_batch;
+    /// sockets in fanout group, each has own reader, writer and stack thread
+    uint32_t fanout_count = 1;
+    /// how kernel spread frames over fanout sockets
+    def::fanout_mode fanout_mode = def::fanout_mode::ebpf;
+    /// pool buffers posted to io_uring per socket, power of two
+    uint32_t uring_buffer_count = 256;
+};
+
+/**
+ * @file macvlan_device.hpp
+ * @brief macvlan_device transmit config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct macvlan_tx_config {
+    /// transmit mode, fall back to socket if not supported
+    def::device_tx_mode mode = def::device_tx_mode::socket;
+    /// ring frame size, include frame header
+    uint32_t frame_size = 2048;
+    /// ring frame count
+    uint32_t frame_count = 256;
+    /// sends in flight per socket in io_uring mode
+    uint32_t uring_depth = 256;
+};
+
+/**
+ * @file macvlan_device.hpp
+ * @brief macvlan_device transmit completion
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct macvlan_tx_stats {
+    /// frames handed to kernel
+    uint64_t sent = 0;
+    /// frames kernel failed to send
+    uint64_t failed = 0;
+    /// kernel kick count
+    uint64_t kicks = 0;
+};
+
+/**
+ * @file macvlan_device.hpp
+ * @brief one raw socket of macvlan_device, it has own reader and writer
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct macvlan_queue {
+    /// raw socket
+    int fd = -1;
+    /// mmapped rx ring, nullptr if not used
+    uint8_t* rx_ring = nullptr;
+    /// mmapped rx ring size
+    size_t rx_ring_size = 0;
+    /// read buffer head
+    flow::skb_queue read_head;
+    /// read share mutex
+    std::mutex read_mutex;
+    /// read share condition
+    std::condition_variable read_cond;
+    /// write buffer head
+    flow::skb_queue write_head;
+    /// write share mutex
+    std::mutex write_mutex;
+    /// write share condition
+    std::condition_variable write_cond;
+    /// io_uring of socket, nullptr if not used
+    uring::ptr ring;
+    /// wake ring thread when write head is filled, -1 if not used
+    int event_fd = -1;
+    /// ring thread sleep in kernel, writer must signal event fd, guarded by write mutex
+    bool ring_waiting = false;
+    /// ring thread send frames of write head, cleared when ring fall back, guarded by write mutex
+    bool ring_tx = false;
+};
+
 /**
  * @file macvlan_device.hpp
  * @brief read and write skbuf to macvlan_device device
@@ -28,8 +126,16 @@ public:
     /**
      * @brief Construct a new macvlan_device device object
      * @param[in] dev_name macvlan_device device name
+     * @param[in] ip_address device ip
+     * @param[in] mac_address device mac
+     * @param[in] mtu device mtu, rx buffer is sized by it
+     * @param[in] headroom headroom reserved before ether header of rx buffer
+     * @param[in] rx_config receive mode config
+     * @param[in] tx_config transmit mode config
      */
-    macvlan_device(const std::string& dev_name, const std::string& ip_address = "", const std::string& mac_address = "");
+    macvlan_device(const std::string& dev_name, const std::string& ip_address = "", const std::string& mac_address = "",
+        uint16_t mtu = def::default_mtu, uint16_t headroom = def::skb_rx_headroom, const macvlan_rx_config& rx_config = {},
+        const macvlan_tx_config& tx_config = {});
 
     /**
      * @brief Destroy the macvlan_device device object
@@ -60,7 +166,29 @@ public:
      * @param[in] len write buffer length
      * @return write buffer length
      */
-    virtual int write_to_device(flow::sk_buff::ptr buffer);
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief read buffers from first socket of macvlan_device device, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch);
+
+    /**
+     * @brief read buffers from one socket, block until one buffer is ready
+     * @param[in] queue socket index
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_queue(uint32_t queue, flow::skb_batch& batch);
+
+    /**
+     * @brief write buffers to macvlan_device device, each queue lock is taken once
+     * @param[in] batch write buffers
+     * @return write buffer count
+     */
+    virtual int write_to_device(flow::skb_batch& batch);
 
     /**
      * @brief get net_device mac
@@ -80,6 +208,18 @@ public:
      */
     virtual uint8_t get_device_ifindex();
 
+    /**
+     * @brief get socket count, one per fanout member
+     * @return socket count
+     */
+    virtual uint32_t get_queue_count();
+
+    /**
+     * @brief get transmit completion stats
+     * @return tx stats
+     */
+    macvlan_tx_stats get_tx_stats();
+
 public:
     /**
      * @brief read from macvlan_device device
@@ -93,6 +233,18 @@ public:
      */
     virtual void write_thread();
 
+    /**
+     * @brief read from one socket of macvlan_device device
+     * @param[in] queue socket index
+     */
+    virtual void read_queue_thread(uint32_t queue);
+
+    /**
+     * @brief write to one socket of macvlan_device device
+     * @param[in] queue socket index
+     */
+    virtual void write_queue_thread(uint32_t queue);
+
     /**
      * @brief get macvlan_device device status from kernel status
      * @return bool macvlan_device device status
@@ -110,7 +262,156 @@ private:
      * @brief write buffer to write queue
      * @param[in] buf macvlan_device device 
      */
-    void append_buffer_to_write_queue(const flow::sk_buff::ptr buffer);
+    void append_buffer_to_write_queue(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief create and bind raw socket of one queue
+     * @param[in] queue queue
+     * @return false if socket failed
+     */
+    bool setup_queue(macvlan_queue& queue);
+
+    /**
+     * @brief join socket to fanout group of device
+     * @param[in] queue queue
+     * @return false if fanout not supported
+     */
+    bool setup_fanout(macvlan_queue& queue);
+
+    /**
+     * @brief load fanout program, it hash frames like stack flow hash
+     * @return false if program rejected
+     */
+    bool load_fanout_program();
+
+    /**
+     * @brief choose tx socket by flow hash, same as fanout program
+     * @param[in] buffer buffer
+     * @return queue index
+     */
+    uint32_t select_tx_queue(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief push ether header before buffer is queued
+     * @param[in] buffer buffer
+     */
+    void make_ether_header(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief get checksum state from packet auxdata
+     * @param[in] msg received msg with control data
+     * @return checksum state of buffer
+     */
+    uint8_t get_checksum_state(const struct msghdr& msg);
+
+    /**
+     * @brief get checksum state from packet status
+     * @param[in] status packet status reported by kernel
+     * @return checksum state of buffer
+     */
+    uint8_t get_checksum_state(uint32_t status);
+
+    /**
+     * @brief alloc rx buffer, headroom is reserved
+     * @return rx buffer, nullptr if pool exhausted
+     */
+    flow::sk_buff::ptr alloc_rx_buffer();
+
+    /**
+     * @brief filter received frame by dst mac and fill buffer info
+     * @param[in] skb rx buffer, frame is stored at data begin
+     * @param[in] size frame size
+     * @return false if frame is not for this device
+     */
+    bool accept_rx_frame(const flow::sk_buff::ptr& skb, size_t size);
+
+    /**
+     * @brief setup mmapped rx ring, must be called before bind
+     * @param[in] queue queue
+     * @return false if ring not supported
+     */
+    bool setup_rx_ring(macvlan_queue& queue);
+
+    /**
+     * @brief read frames with recvmsg, one frame per call
+     * @param[in] queue queue
+     */
+    void read_socket_thread(macvlan_queue& queue);
+
+    /**
+     * @brief read frames from rx ring, block by block
+     * @param[in] queue queue
+     */
+    void read_ring_thread(macvlan_queue& queue);
+
+    /**
+     * @brief read frames with recvmmsg, one batch per call
+     * @param[in] queue queue
+     */
+    void read_mmsg_thread(macvlan_queue& queue);
+
+    /**
+     * @brief create io_uring of socket, register socket and rx buffer ring
+     * @param[in] queue queue
+     * @return false if io_uring not supported
+     */
+    bool setup_uring(macvlan_queue& queue);
+
+    /**
+     * @brief reap rx and tx completions of socket io_uring, one thread per socket,
+     * fall back to recvmmsg and hand sends to writer if kernel reject recv
+     * @param[in] queue queue
+     */
+    void read_uring_thread(macvlan_queue& queue);
+
+    /**
+     * @brief wake ring thread if it sleep, caller hold write mutex
+     * @param[in] queue queue
+     */
+    void wake_ring(macvlan_queue& queue);
+
+    /**
+     * @brief move rx batch to read queue
+     * @param[in] queue queue
+     * @param[in] batch rx buffers
+     */
+    void flush_read_batch(macvlan_queue& queue, flow::skb_batch& batch);
+
+    /**
+     * @brief send one buffer to device
+     * @param[in] fd socket
+     * @param[in] buffer buffer
+     * @return false if device broken
+     */
+    bool send_buffer(int fd, const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief send buffers with one sendmmsg call
+     * @param[in] fd socket
+     * @param[in] buffers buffers
+     * @return false if device broken
+     */
+    bool send_mmsg_batch(int fd, const std::vector<flow::sk_buff::ptr>& buffers);
+
+    /**
+     * @brief copy buffers to tx ring, then kick kernel once
+     * @param[in] fd socket frames too large for ring are sent by
+     * @param[in] buffers buffers
+     * @return false if device broken
+     */
+    bool send_ring_batch(int fd, const std::vector<flow::sk_buff::ptr>& buffers);
+
+    /**
+     * @brief get tx ring frame, wait kernel if it is still in flight
+     * @return frame header, nullptr if device broken
+     */
+    struct tpacket2_hdr* get_tx_frame();
+
+    /**
+     * @brief setup mmapped tx ring on dedicated socket
+     * @return false if ring not supported
+     */
+    bool setup_tx_ring();
 
 private:
     /// device name
@@ -123,22 +424,36 @@ private:
     uint8_t if_index_;
     /// thread to read and write 
     std::vector<std::thread> thread_vec_;
-    /// macvlan_device device fd
-    uint8_t macvlan_fd_;
+    /// raw sockets, more than one in fanout group
+    std::vector<std::unique_ptr<macvlan_queue>> queues_;
+    /// fanout program, -1 if not loaded
+    int fanout_prog_fd_;
     /// macvlan_device device mtu
     uint16_t mtu_;
-    /// read buffer head
-    std::queue<flow::sk_buff::ptr> read_head_;
-    /// read share mutex
-    std::mutex read_mutex_;
-    /// read share condition
-    std::condition_variable read_cond_;
-    /// write buffer head
-    std::queue<flow::sk_buff::ptr> write_head_;
-    /// write share mutex
-    std::mutex write_mutex_;
-    /// write share condition
-    std::condition_variable write_cond_;
+    /// rx buffer headroom
+    uint16_t headroom_;
+    /// receive mode config
+    macvlan_rx_config rx_config_;
+    /// transmit mode config
+    macvlan_tx_config tx_config_;
+    /// tx ring socket, ring owner must not receive
+    int tx_ring_fd_;
+    /// mmapped tx ring, nullptr if not used
+    uint8_t* tx_ring_;
+    /// mmapped tx ring size
+    size_t tx_ring_size_;
+    /// tx ring block size
+    size_t tx_block_size_;
+    /// tx ring frames per block
+    uint32_t tx_block_frames_;
+    /// next tx ring frame
+    uint32_t tx_frame_index_;
+    /// frames in tx ring, may be more than config to fill blocks
+    uint32_t tx_frame_count_;
+    /// transmit completion
+    macvlan_tx_stats tx_stats_;
+    /// transmit completion lock
+    std::mutex tx_stats_mutex_;
     /// device status
     def::device_status status_;
 };
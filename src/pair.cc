@@ -0,0 +1,291 @@
+#include "pair.hpp"
+#include "def.hpp"
+#include "flow.hpp"
+#include "sock.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <arpa/inet.h>
+
+namespace driver {
+
+pair_device::pair_device(const std::string& dev_name, uint8_t ifindex, const std::string& ip_address,
+    const std::string& mac_address, uint16_t mtu, uint16_t headroom, const pair_device_config& config)
+    : dev_name_(dev_name), if_index_(ifindex), mtu_(mtu), headroom_(headroom), config_(config), tx_frames_(0),
+    rx_frames_(0), drop_frames_(0), status_(def::device_status::down) {
+    utils::generic::convert_string_to_mac(mac_address, mac_address_);
+    utils::generic::convert_string_to_ip(ip_address, &ip_address_);
+    // queues are created here, count is known before device is registered
+    for (uint32_t index = 0; index < std::max<uint32_t>(config_.queue_count, 1); index++)
+        queues_.push_back(std::unique_ptr<pair_queue>(new pair_queue(config_.ring_size)));
+}
+
+pair_device::~pair_device() {
+    down();
+}
+
+// connect two devices
+void pair_device::connect(const pair_device::ptr& first, const pair_device::ptr& second) {
+    first->peer_ = second;
+    second->peer_ = first;
+}
+
+bool pair_device::up() {
+    if (peer_.expired()) {
+        std::cout << "up pair device failed, device not connected, device name: " << dev_name_ << std::endl;
+        return false;
+    }
+    status_ = def::device_status::up;
+    std::cout << "up pair device success, device name: " << dev_name_ << ", ifindex: " << (int)if_index_
+        << ", mac: " << utils::generic::format_mac_address(mac_address_)
+        << ", ip: " << utils::generic::format_ip_address(ip_address_)
+        << ", queues: " << std::dec << queues_.size() << ", ring size: " << queues_.front()->wire.capacity() << std::endl;
+    return true;
+}
+
+bool pair_device::down() {
+    status_ = def::device_status::down;
+    return true;
+}
+
+// read buffer from device
+flow::sk_buff::ptr pair_device::read_from_device() {
+    auto& queue = *queues_.front();
+    while (true) {
+        auto buffer = queue.rx.pop();
+        if (buffer != nullptr) {
+            flow::skb_set_owner(buffer, def::skb_owner::stack);
+            return buffer;
+        }
+        wait_ring(queue.rx, queue.rx_waiter);
+    }
+}
+
+// write buffer to peer
+int pair_device::write_to_device(const flow::sk_buff::ptr& buffer) {
+    make_ether_header(buffer);
+    auto queue = select_tx_queue(buffer);
+    if (deliver(queue, buffer))
+        notify_wire(queue);
+    return 0;
+}
+
+// read buffer batch from device
+size_t pair_device::read_from_device(flow::skb_batch& batch) {
+    return read_from_queue(0, batch);
+}
+
+// read buffer batch from queue
+size_t pair_device::read_from_queue(uint32_t index, flow::skb_batch& batch) {
+    auto& queue = *queues_[index];
+    while (queue.rx.pop(batch) == 0)
+        wait_ring(queue.rx, queue.rx_waiter);
+    for (auto& buffer : batch)
+        flow::skb_set_owner(buffer, def::skb_owner::stack);
+    return batch.size();
+}
+
+// write buffer batch to peer
+int pair_device::write_to_device(flow::skb_batch& batch) {
+    // peer queue is woken once per batch, batch touch at most max_skb_batch queues
+    std::array<uint32_t, def::max_skb_batch> pushed;
+    size_t pushed_count = 0;
+    for (auto& buffer : batch) {
+        make_ether_header(buffer);
+        auto queue = select_tx_queue(buffer);
+        if (!deliver(queue, buffer))
+            continue;
+        auto end = pushed.begin() + pushed_count;
+        if (std::find(pushed.begin(), end, queue) == end)
+            pushed[pushed_count++] = queue;
+    }
+    for (size_t index = 0; index < pushed_count; index++)
+        notify_wire(pushed[index]);
+    return batch.size();
+}
+
+// put frame on wire ring of peer
+bool pair_device::deliver(uint32_t queue, const flow::sk_buff::ptr& buffer) {
+    auto peer = peer_.lock();
+    if (peer == nullptr || peer->status_ != def::device_status::up) {
+        drop_frames_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // ring hold its own reference, caller keep buffer
+    flow::sk_buff::ptr frame = buffer;
+    auto& ring = peer->queues_[queue % peer->queues_.size()]->wire;
+    if (!ring.push(frame)) {
+        // wire never block writer, like full nic queue
+        drop_frames_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    tx_frames_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// wake read thread of peer queue
+void pair_device::notify_wire(uint32_t queue) {
+    auto peer = peer_.lock();
+    if (peer == nullptr)
+        return;
+    notify_ring(peer->queues_[queue % peer->queues_.size()]->wire_waiter);
+}
+
+// wait until ring has buffer
+void pair_device::wait_ring(flow::skb_ring& ring, pair_waiter& waiter) {
+    for (uint32_t spin = 0; spin < config_.spin_count; spin++) {
+        if (!ring.empty())
+            return;
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(waiter.mutex);
+    waiter.waiting.store(true, std::memory_order_relaxed);
+    // pair with fence in notify_ring, either producer see waiting or consumer see buffer
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    waiter.cond.wait(lock, [&] { return !ring.empty(); });
+    waiter.waiting.store(false, std::memory_order_relaxed);
+}
+
+// wake consumer if it sleep
+void pair_device::notify_ring(pair_waiter& waiter) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiter.waiting.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(waiter.mutex);
+    waiter.cond.notify_one();
+}
+
+// choose peer queue by flow hash
+uint32_t pair_device::select_tx_queue(const flow::sk_buff::ptr& buffer) {
+    if (queues_.size() == 1)
+        return 0;
+    // reply reuse rx hash, buffer from sock get hash from its key
+    uint32_t hash = buffer->hash;
+    if (hash == 0 && buffer->ext != nullptr && buffer->ext->key != nullptr) {
+        auto& key = buffer->ext->key;
+        hash = flow::get_flow_hash(key->local_ip, key->local_port, key->remote_ip, key->remote_port);
+    }
+    return hash % queues_.size();
+}
+
+// get pair device mac
+uint8_t* pair_device::get_device_mac() {
+    return mac_address_;
+}
+
+// get pair device ip
+uint32_t pair_device::get_device_ip() {
+    return ip_address_;
+}
+
+// get device index
+uint8_t pair_device::get_device_ifindex() {
+    return if_index_;
+}
+
+// get queue count
+uint32_t pair_device::get_queue_count() {
+    return queues_.size();
+}
+
+// get frame counters
+pair_device_stats pair_device::get_stats() {
+    pair_device_stats stats;
+    stats.tx = tx_frames_.load(std::memory_order_relaxed);
+    stats.rx = rx_frames_.load(std::memory_order_relaxed);
+    stats.drops = drop_frames_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void pair_device::read_thread() {
+    read_queue_thread(0);
+}
+
+void pair_device::write_thread() {
+    write_queue_thread(0);
+}
+
+// move frames of one queue to stack
+void pair_device::read_queue_thread(uint32_t index) {
+    auto& queue = *queues_[index];
+    flow::skb_batch frames;
+    while (true) {
+        frames.clear();
+        while (queue.wire.pop(frames) == 0)
+            wait_ring(queue.wire, queue.wire_waiter);
+        // rx buffer is allocated here, so it come from arena bound to this thread
+        bool pushed = false;
+        for (auto& frame : frames) {
+            auto skb = copy_rx_frame(frame);
+            flow::skb_tx_done(frame);
+            frame.reset();
+            if (skb == nullptr)
+                continue;
+            if (!queue.rx.push(skb)) {
+                drop_frames_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            rx_frames_.fetch_add(1, std::memory_order_relaxed);
+            pushed = true;
+        }
+        if (pushed)
+            notify_ring(queue.rx_waiter);
+    }
+}
+
+void pair_device::write_queue_thread(uint32_t /* queue */) {
+    // writer put frames on peer ring in place, no thread needed
+}
+
+// copy frame to rx buffer
+flow::sk_buff::ptr pair_device::copy_rx_frame(const flow::sk_buff::ptr& frame) {
+    size_t size = flow::skb_len(frame);
+    size_t frame_size = def::max_ether_header + mtu_;
+    if (size < sizeof(struct flow::ether_hdr) || size > frame_size) {
+        std::cout << "drop pair frame exceed mtu, size: " << std::dec << size << std::endl;
+        drop_frames_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    // frame hold ether header at data begin
+    auto hdr = reinterpret_cast<const flow::ether_hdr*>(frame->get_data());
+    if (memcmp(mac_address_, hdr->dst, def::mac_len) != 0 &&
+        memcmp(def::broadcast_mac, hdr->dst, def::mac_len) != 0) {
+        drop_frames_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    flow::sk_buff::ptr skb = flow::sk_buff::alloc(headroom_ + frame_size);
+    if (skb == nullptr) {
+        std::cout << "alloc pair rx buffer failed" << std::endl;
+        drop_frames_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    flow::skb_reserve(skb, headroom_);
+    flow::skb_copy_data(frame, reinterpret_cast<char*>(skb->data + skb->data_begin), size);
+    flow::skb_rx_init(skb, if_index_, size);
+    if (config_.trust_checksum)
+        skb->ip_summed = uint8_t(def::checksum_state::unnecessary);
+    return skb;
+}
+
+// make ether header
+void pair_device::make_ether_header(const flow::sk_buff::ptr& buffer) {
+    // push to ether header
+    flow::skb_push(buffer, sizeof(struct flow::ether_hdr));
+    // create ether header
+    struct flow::ether_hdr* ether_hdr = reinterpret_cast<struct flow::ether_hdr*>(buffer->get_data());
+    ether_hdr->protocol = htons(buffer->protocol);
+    memcpy(ether_hdr->src, mac_address_, def::mac_len);
+    memcpy(ether_hdr->dst, std::get<std::array<uint8_t, def::mac_len>>(buffer->dst).data(), def::mac_len);
+    // peer read thread hold reference from now on
+    flow::skb_set_shared(buffer);
+    flow::skb_set_owner(buffer, def::skb_owner::device_tx);
+}
+
+}
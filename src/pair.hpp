@@ -0,0 +1,315 @@
+#ifndef __PAIR_H__
+#define __PAIR_H__
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "interface.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace driver {
+
+/**
+ * @file pair.hpp
+ * @brief in memory pair device config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pair_device_config {
+    /// queue count, frames of one flow always use the same queue
+    uint32_t queue_count = 1;
+    /// frames each ring hold, rounded up to power of two, frames are dropped when full
+    uint32_t ring_size = 1024;
+    /// times reader check ring before sleep, more spin lower latency but burn cpu
+    uint32_t spin_count = 64;
+    /// frames never cross wire, skip software checksum verify like veth
+    bool trust_checksum = true;
+};
+
+/**
+ * @file pair.hpp
+ * @brief in memory pair device counters
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pair_device_stats {
+    /// frames handed to peer
+    uint64_t tx = 0;
+    /// frames passed to stack
+    uint64_t rx = 0;
+    /// frames dropped by full ring or filter
+    uint64_t drops = 0;
+};
+
+/**
+ * @file pair.hpp
+ * @brief sleep point of ring consumer, producer only lock when consumer sleep
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pair_waiter {
+    /// consumer is sleeping or about to
+    std::atomic<bool> waiting {false};
+    /// sleep mutex
+    std::mutex mutex;
+    /// sleep condition
+    std::condition_variable cond;
+};
+
+/**
+ * @file pair.hpp
+ * @brief one queue of pair device, peer write to wire ring, read thread move frames to rx ring
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pair_queue {
+    /**
+     * @brief Construct a new pair queue
+     * @param[in] ring_size frames each ring hold
+     */
+    explicit pair_queue(size_t ring_size) : wire(ring_size), rx(ring_size) {}
+
+    /// frames written by peer stack
+    flow::skb_ring wire;
+    /// read thread wait here
+    pair_waiter wire_waiter;
+    /// rx buffers wait for stack
+    flow::skb_ring rx;
+    /// stack wait here
+    pair_waiter rx_waiter;
+};
+
+/**
+ * @file pair.hpp
+ * @brief in memory device, frames written to one device are read from its peer, no kernel and no privilege needed
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class pair_device: public interface::net_device, public std::enable_shared_from_this<pair_device> {
+public:
+    typedef std::shared_ptr<pair_device> ptr;
+
+    /**
+     * @brief Construct a new pair device object
+     * @param[in] dev_name device name, only used in log
+     * @param[in] ifindex device index, no kernel device so it must be unique in stack
+     * @param[in] ip_address stack ip
+     * @param[in] mac_address stack mac
+     * @param[in] mtu device mtu, rx buffer is sized by it
+     * @param[in] headroom headroom reserved before ether header of rx buffer
+     * @param[in] config ring config
+     */
+    pair_device(const std::string& dev_name, uint8_t ifindex, const std::string& ip_address, const std::string& mac_address,
+        uint16_t mtu = def::default_mtu, uint16_t headroom = def::skb_rx_headroom, const pair_device_config& config = {});
+
+    /**
+     * @brief Destroy the pair device object
+     */
+    virtual ~pair_device();
+
+    /**
+     * @brief connect two devices like cable, device connected to itself is loopback
+     * @param[in] first one end
+     * @param[in] second other end
+     */
+    static void connect(const pair_device::ptr& first, const pair_device::ptr& second);
+
+    /**
+     * @brief up pair device
+     * @return false if device has no peer
+     */
+    virtual bool up();
+
+    /**
+     * @brief down pair device, frames written to it are dropped
+     * @return true if success
+     */
+    virtual bool down();
+
+    /**
+     * @brief read from first queue of pair device
+     * @return read buffer
+     */
+    virtual flow::sk_buff::ptr read_from_device();
+
+    /**
+     * @brief write to peer device, queue is chosen by flow hash
+     * @param[in] buffer write buffer
+     * @return 0 success
+     */
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief read buffers from first queue of pair device, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch);
+
+    /**
+     * @brief read buffers from one queue, block until one buffer is ready
+     * @param[in] queue queue index
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_queue(uint32_t queue, flow::skb_batch& batch);
+
+    /**
+     * @brief write buffers to peer device, each peer queue is woken once
+     * @param[in] batch write buffers
+     * @return write buffer count
+     */
+    virtual int write_to_device(flow::skb_batch& batch);
+
+    /**
+     * @brief get net_device mac
+     * @return device mac
+     */
+    virtual uint8_t* get_device_mac();
+
+    /**
+     * @brief get net_device ip
+     * @return device ip
+     */
+    virtual uint32_t get_device_ip();
+
+    /**
+     * @brief get net_device ifindex
+     * @return device ifindex
+     */
+    virtual uint8_t get_device_ifindex();
+
+    /**
+     * @brief get queue count
+     * @return queue count
+     */
+    virtual uint32_t get_queue_count();
+
+    /**
+     * @brief get frame counters
+     * @return counters
+     */
+    pair_device_stats get_stats();
+
+public:
+    /**
+     * @brief move frames of first queue to stack
+     */
+    virtual void read_thread();
+
+    /**
+     * @brief frames are handed to peer by writer, nothing to do
+     */
+    virtual void write_thread();
+
+    /**
+     * @brief move frames written by peer to rx buffers of this device
+     * @param[in] queue queue index
+     */
+    virtual void read_queue_thread(uint32_t queue);
+
+    /**
+     * @brief frames are handed to peer by writer, nothing to do
+     * @param[in] queue queue index
+     */
+    virtual void write_queue_thread(uint32_t queue);
+
+    /**
+     * @brief get pair device status from kernel status
+     * @return bool pair device status
+     */
+    virtual bool kernel_device_status() { return false; };
+
+    /**
+     * @brief get pair device status from user status
+     * @return bool pair device status
+     */
+    virtual bool user_device_status() { return status_ == def::device_status::up; };
+
+private:
+    /**
+     * @brief put frame on wire ring of queue, frame is dropped if ring is full
+     * @param[in] queue queue index, taken modulo queue count
+     * @param[in] buffer frame, start at ether header
+     * @return false if dropped
+     */
+    bool deliver(uint32_t queue, const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief wake read thread of queue if it sleep
+     * @param[in] queue queue index
+     */
+    void notify_wire(uint32_t queue);
+
+    /**
+     * @brief spin then sleep until ring has buffer
+     * @param[in] ring ring
+     * @param[in] waiter sleep point of ring
+     */
+    void wait_ring(flow::skb_ring& ring, pair_waiter& waiter);
+
+    /**
+     * @brief wake ring consumer if it sleep
+     * @param[in] waiter sleep point of ring
+     */
+    void notify_ring(pair_waiter& waiter);
+
+    /**
+     * @brief choose queue of peer, same as tap and macvlan
+     * @param[in] buffer buffer
+     * @return queue index
+     */
+    uint32_t select_tx_queue(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief copy frame written by peer to rx buffer, so peer keep its buffer for retransmit
+     * @param[in] frame frame written by peer
+     * @return rx buffer, nullptr if dropped
+     */
+    flow::sk_buff::ptr copy_rx_frame(const flow::sk_buff::ptr& frame);
+
+    /**
+     * @brief push ether header before buffer is queued
+     * @param[in] buffer buffer
+     */
+    void make_ether_header(const flow::sk_buff::ptr& buffer);
+
+private:
+    /// device name
+    std::string dev_name_;
+    /// device index
+    uint8_t if_index_;
+    /// stack address
+    uint32_t ip_address_;
+    /// stack mac
+    uint8_t mac_address_[def::mac_len];
+    /// device mtu
+    uint16_t mtu_;
+    /// rx buffer headroom
+    uint16_t headroom_;
+    /// ring config
+    pair_device_config config_;
+    /// other end, weak so loopback and pair dont keep each other alive
+    std::weak_ptr<pair_device> peer_;
+    /// device queues, at least one
+    std::vector<std::unique_ptr<pair_queue>> queues_;
+    /// frames handed to peer
+    std::atomic<uint64_t> tx_frames_;
+    /// frames passed to stack
+    std::atomic<uint64_t> rx_frames_;
+    /// dropped frames
+    std::atomic<uint64_t> drop_frames_;
+    /// device status
+    std::atomic<def::device_status> status_;
+};
+
+
+}
+
+#endif // __PAIR_H__
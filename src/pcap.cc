@@ -0,0 +1,514 @@
+#include "pcap.hpp"
+#include "def.hpp"
+#include "flow.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <arpa/inet.h>
+
+namespace driver {
+
+namespace {
+
+// pcapng block header, type and total length
+const size_t pcapng_block_hdr_size = 8;
+// pcapng block trailer, total length again
+const size_t pcapng_block_trailer_size = 4;
+// pcapng option carry timestamp unit of interface
+const uint16_t pcapng_option_ts_resol = 9;
+// pcapng option end
+const uint16_t pcapng_option_end = 0;
+// pcapng default timestamp unit, usec
+const uint64_t pcapng_default_ts_units = 1000000;
+// ns per second
+const uint64_t ns_per_sec = 1000000000;
+
+/**
+ * @brief get monotonic time
+ * @return time in ns
+ */
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief get traffic class of rx buffer, buffer start at network header
+ * @param[in] buffer rx buffer
+ * @return traffic class
+ */
+def::traffic_class classify_buffer(const flow::sk_buff::ptr& buffer) {
+    if (buffer->protocol == uint16_t(def::network_protocol::arp))
+        return def::traffic_class::arp;
+    if (buffer->protocol != uint16_t(def::network_protocol::ip) || buffer->get_data_len() < sizeof(struct flow::ip_hdr))
+        return def::traffic_class::other;
+    auto hdr = reinterpret_cast<const flow::ip_hdr*>(buffer->get_data());
+    // more fragment flag or offset set
+    if (ntohs(hdr->flag_and_fragoffset) & 0x3fff)
+        return def::traffic_class::ip_fragment;
+    size_t head_len = (hdr->version_and_head_len & 0xf) * 4;
+    switch (hdr->protocol) {
+    case uint8_t(def::transport_protocol::tcp): {
+        if (buffer->get_data_len() < head_len + sizeof(struct flow::tcp_hdr))
+            return def::traffic_class::tcp;
+        auto tcp = reinterpret_cast<const flow::tcp_hdr*>(buffer->get_data() + head_len);
+        return tcp->syn && !tcp->ack ? def::traffic_class::tcp_syn : def::traffic_class::tcp;
+    }
+    case uint8_t(def::transport_protocol::udp):
+        return def::traffic_class::udp;
+    case uint8_t(def::network_protocol::icmp):
+        return def::traffic_class::icmp;
+    default:
+        return def::traffic_class::other;
+    }
+}
+
+}
+
+// open pcap file
+pcap_reader::ptr pcap_reader::open(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        std::cout << "open pcap file failed, path: " << path << ", err: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    auto reader = pcap_reader::ptr(new pcap_reader(file, path));
+    if (!reader->read_file_header())
+        return nullptr;
+    return reader;
+}
+
+pcap_reader::pcap_reader(FILE* file, const std::string& path)
+    : file_(file), path_(path), pcapng_(false), swapped_(false), nsec_(false), link_type_(0) {
+}
+
+pcap_reader::~pcap_reader() {
+    if (file_ != nullptr)
+        fclose(file_);
+}
+
+// read file header
+bool pcap_reader::read_file_header() {
+    uint32_t magic = 0;
+    if (fread(&magic, sizeof(magic), 1, file_) != 1) {
+        std::cout << "read pcap file header failed, path: " << path_ << std::endl;
+        return false;
+    }
+    // section header is parsed with other blocks, a file may hold many sections
+    if (magic == def::pcapng_section_block) {
+        pcapng_ = true;
+        return fseek(file_, 0, SEEK_SET) == 0;
+    }
+    struct pcap_file_hdr hdr;
+    hdr.magic = magic;
+    if (fread(reinterpret_cast<uint8_t*>(&hdr) + sizeof(magic), sizeof(hdr) - sizeof(magic), 1, file_) != 1) {
+        std::cout << "read pcap file header failed, path: " << path_ << std::endl;
+        return false;
+    }
+    swapped_ = magic == __builtin_bswap32(def::pcap_magic_usec) || magic == __builtin_bswap32(def::pcap_magic_nsec);
+    magic = swap32(magic);
+    if (magic != def::pcap_magic_usec && magic != def::pcap_magic_nsec) {
+        std::cout << "unknown pcap file format, path: " << path_ << ", magic: " << std::hex << magic << std::endl;
+        return false;
+    }
+    nsec_ = magic == def::pcap_magic_nsec;
+    link_type_ = swap32(hdr.link_type);
+    if (link_type_ != def::pcap_linktype_ether) {
+        std::cout << "pcap link type not ether, path: " << path_ << ", link type: " << std::dec << link_type_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// read next frame
+const std::vector<uint8_t>* pcap_reader::next(uint64_t* timestamp) {
+    bool found = pcapng_ ? next_pcapng_frame(timestamp) : next_pcap_frame(timestamp);
+    return found ? &frame_ : nullptr;
+}
+
+// go back to first frame
+bool pcap_reader::rewind() {
+    if (pcapng_) {
+        if_link_types_.clear();
+        if_ts_units_.clear();
+        return fseek(file_, 0, SEEK_SET) == 0;
+    }
+    return fseek(file_, sizeof(struct pcap_file_hdr), SEEK_SET) == 0;
+}
+
+// read next pcap frame
+bool pcap_reader::next_pcap_frame(uint64_t* timestamp) {
+    struct pcap_record_hdr hdr;
+    if (fread(&hdr, sizeof(hdr), 1, file_) != 1)
+        return false;
+    uint32_t cap_len = swap32(hdr.cap_len);
+    if (cap_len > def::pcap_snap_len) {
+        std::cout << "pcap record corrupted, path: " << path_ << ", len: " << std::dec << cap_len << std::endl;
+        return false;
+    }
+    frame_.resize(cap_len);
+    if (cap_len > 0 && fread(frame_.data(), cap_len, 1, file_) != 1)
+        return false;
+    *timestamp = uint64_t(swap32(hdr.ts_sec)) * ns_per_sec + uint64_t(swap32(hdr.ts_frac)) * (nsec_ ? 1 : 1000);
+    return true;
+}
+
+// read next pcapng frame
+bool pcap_reader::next_pcapng_frame(uint64_t* timestamp) {
+    std::vector<uint8_t> block;
+    while (true) {
+        uint32_t hdr[2];
+        if (fread(hdr, sizeof(hdr), 1, file_) != 1)
+            return false;
+        uint32_t total_len = hdr[1];
+        // section header type read the same on any endian, byte order magic follow it
+        if (hdr[0] == def::pcapng_section_block) {
+            uint32_t magic = 0;
+            if (fread(&magic, sizeof(magic), 1, file_) != 1)
+                return false;
+            if (magic != def::pcapng_byte_order_magic && magic != __builtin_bswap32(def::pcapng_byte_order_magic)) {
+                std::cout << "unknown pcapng byte order, path: " << path_ << std::endl;
+                return false;
+            }
+            swapped_ = magic != def::pcapng_byte_order_magic;
+            // interface id count again in each section
+            if_link_types_.clear();
+            if_ts_units_.clear();
+            total_len = swap32(total_len);
+            size_t rest = pcapng_block_hdr_size + sizeof(magic);
+            if (total_len < rest || fseek(file_, total_len - rest, SEEK_CUR) != 0)
+                return false;
+            continue;
+        }
+        uint32_t type = swap32(hdr[0]);
+        total_len = swap32(total_len);
+        if (total_len < pcapng_block_hdr_size + pcapng_block_trailer_size || total_len > def::pcap_snap_len * 2) {
+            std::cout << "pcapng block corrupted, path: " << path_ << ", len: " << std::dec << total_len << std::endl;
+            return false;
+        }
+        block.resize(total_len - pcapng_block_hdr_size);
+        if (fread(block.data(), block.size(), 1, file_) != 1)
+            return false;
+        block.resize(block.size() - pcapng_block_trailer_size);
+        if (type == def::pcapng_interface_block) {
+            read_interface_block(block);
+        } else if (type == def::pcapng_enhanced_block && block.size() >= 5 * sizeof(uint32_t)) {
+            uint32_t fields[5];
+            memcpy(fields, block.data(), sizeof(fields));
+            uint32_t if_id = swap32(fields[0]);
+            uint32_t cap_len = swap32(fields[3]);
+            if (if_id >= if_link_types_.size() || if_link_types_[if_id] != def::pcap_linktype_ether ||
+                cap_len > block.size() - sizeof(fields))
+                continue;
+            // timestamp is counted in unit of interface
+            uint64_t ts = (uint64_t(swap32(fields[1])) << 32) | swap32(fields[2]);
+            *timestamp = uint64_t((unsigned __int128)ts * ns_per_sec / if_ts_units_[if_id]);
+            frame_.assign(block.begin() + sizeof(fields), block.begin() + sizeof(fields) + cap_len);
+            return true;
+        } else if (type == def::pcapng_simple_block && block.size() >= sizeof(uint32_t)) {
+            // simple packet belong to first interface, and has no timestamp
+            if (if_link_types_.empty() || if_link_types_[0] != def::pcap_linktype_ether)
+                continue;
+            uint32_t orig_len = 0;
+            memcpy(&orig_len, block.data(), sizeof(orig_len));
+            size_t cap_len = std::min<size_t>(swap32(orig_len), block.size() - sizeof(orig_len));
+            *timestamp = 0;
+            frame_.assign(block.begin() + sizeof(orig_len), block.begin() + sizeof(orig_len) + cap_len);
+            return true;
+        }
+        // statistics, name resolution and custom blocks are skipped
+    }
+}
+
+// read pcapng interface block
+void pcap_reader::read_interface_block(const std::vector<uint8_t>& body) {
+    uint16_t link_type = 0;
+    if (body.size() >= sizeof(link_type))
+        memcpy(&link_type, body.data(), sizeof(link_type));
+    uint64_t units = pcapng_default_ts_units;
+    // options follow link type, reserved and snap len
+    size_t offset = 2 * sizeof(uint32_t);
+    while (offset + 2 * sizeof(uint16_t) <= body.size()) {
+        uint16_t option[2];
+        memcpy(option, body.data() + offset, sizeof(option));
+        uint16_t code = swap16(option[0]);
+        uint16_t len = swap16(option[1]);
+        offset += sizeof(option);
+        if (code == pcapng_option_end || offset + len > body.size())
+            break;
+        if (code == pcapng_option_ts_resol && len >= 1) {
+            // high bit choose power of two, otherwise power of ten
+            uint8_t resol = body[offset];
+            units = 1;
+            for (uint8_t index = 0; index < (resol & 0x7f); index++)
+                units *= (resol & 0x80) ? 2 : 10;
+        }
+        // option value is padded to 32 bits
+        offset += (len + 3) & ~size_t(3);
+    }
+    if_link_types_.push_back(swap16(link_type));
+    if_ts_units_.push_back(units);
+}
+
+// create pcap file
+pcap_writer::ptr pcap_writer::open(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cout << "create pcap file failed, path: " << path << ", err: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    auto writer = pcap_writer::ptr(new pcap_writer(file));
+    struct pcap_file_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = def::pcap_magic_nsec;
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.snap_len = def::pcap_snap_len;
+    hdr.link_type = def::pcap_linktype_ether;
+    if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+        std::cout << "write pcap file header failed, path: " << path << std::endl;
+        return nullptr;
+    }
+    return writer;
+}
+
+pcap_writer::pcap_writer(FILE* file) : file_(file) {
+}
+
+pcap_writer::~pcap_writer() {
+    if (file_ != nullptr)
+        fclose(file_);
+}
+
+// write one frame
+bool pcap_writer::write_frame(const struct iovec* iov, int count) {
+    size_t total = 0;
+    for (int index = 0; index < count; index++)
+        total += iov[index].iov_len;
+    // wall time, so capture line up with other tools
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    struct pcap_record_hdr hdr;
+    hdr.ts_sec = now / ns_per_sec;
+    hdr.ts_frac = now % ns_per_sec;
+    hdr.cap_len = std::min<size_t>(total, def::pcap_snap_len);
+    hdr.orig_len = total;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fwrite(&hdr, sizeof(hdr), 1, file_) != 1)
+        return false;
+    size_t left = hdr.cap_len;
+    for (int index = 0; index < count && left > 0; index++) {
+        size_t len = std::min(left, iov[index].iov_len);
+        if (len > 0 && fwrite(iov[index].iov_base, len, 1, file_) != 1)
+            return false;
+        left -= len;
+    }
+    return true;
+}
+
+// flush buffered frames
+void pcap_writer::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fflush(file_);
+}
+
+pcap_device::pcap_device(const std::string& dev_name, uint8_t ifindex, const std::string& ip_address,
+    const std::string& mac_address, uint16_t mtu, uint16_t headroom, const pcap_device_config& config)
+    : dev_name_(dev_name), if_index_(ifindex), mtu_(mtu), headroom_(headroom), config_(config), start_time_(0),
+    last_take_time_(0), tx_frames_(0), status_(def::device_status::down) {
+    utils::generic::convert_string_to_mac(mac_address, mac_address_);
+    utils::generic::convert_string_to_ip(ip_address, &ip_address_);
+}
+
+pcap_device::~pcap_device() {
+    down();
+}
+
+bool pcap_device::up() {
+    reader_ = pcap_reader::open(config_.path);
+    if (reader_ == nullptr) {
+        std::cout << "up pcap device failed, device name: " << dev_name_ << ", path: " << config_.path << std::endl;
+        return false;
+    }
+    status_ = def::device_status::up;
+    std::cout << "up pcap device success, device name: " << dev_name_ << ", ifindex: " << (int)if_index_
+        << ", mac: " << utils::generic::format_mac_address(mac_address_)
+        << ", ip: " << utils::generic::format_ip_address(ip_address_) << ", path: " << config_.path << std::endl;
+    return true;
+}
+
+bool pcap_device::down() {
+    status_ = def::device_status::down;
+    // wake reader waiting for room
+    std::lock_guard<std::mutex> lock(read_mutex_);
+    space_cond_.notify_all();
+    return true;
+}
+
+// read buffer from device
+flow::sk_buff::ptr pcap_device::read_from_device() {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    read_cond_.wait(lock, [this] { return !this->read_head_.empty(); });
+    auto buffer = std::move(read_head_.front());
+    read_head_.pop();
+    last_take_time_ = now_ns();
+    space_cond_.notify_one();
+    flow::skb_set_owner(buffer, def::skb_owner::stack);
+    return buffer;
+}
+
+// discard buffer written by stack
+int pcap_device::write_to_device(const flow::sk_buff::ptr& /* buffer */) {
+    tx_frames_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+// read buffer batch from device
+size_t pcap_device::read_from_device(flow::skb_batch& batch) {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    read_cond_.wait(lock, [this] { return !this->read_head_.empty(); });
+    while (!read_head_.empty() && !batch.full()) {
+        flow::skb_set_owner(read_head_.front(), def::skb_owner::stack);
+        batch.push(std::move(read_head_.front()));
+        read_head_.pop();
+    }
+    last_take_time_ = now_ns();
+    space_cond_.notify_one();
+    return batch.size();
+}
+
+// get pcap device mac
+uint8_t* pcap_device::get_device_mac() {
+    return mac_address_;
+}
+
+// get pcap device ip
+uint32_t pcap_device::get_device_ip() {
+    return ip_address_;
+}
+
+// get device index
+uint8_t pcap_device::get_device_ifindex() {
+    return if_index_;
+}
+
+// get replay counters
+pcap_replay_stats pcap_device::get_stats() {
+    std::lock_guard<std::mutex> lock(read_mutex_);
+    pcap_replay_stats stats = stats_;
+    if (start_time_ != 0 && last_take_time_ > start_time_)
+        stats.elapsed = last_take_time_ - start_time_;
+    stats.tx = tx_frames_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// replay file into read queue
+void pcap_device::read_thread() {
+    flow::skb_batch batch;
+    uint64_t timestamp = 0;
+    for (uint32_t loop = 0; config_.loop_count == 0 || loop < config_.loop_count; loop++) {
+        if (loop > 0 && !reader_->rewind()) {
+            std::cout << "rewind pcap file failed, path: " << config_.path << std::endl;
+            break;
+        }
+        // gap is measured from first frame of each loop
+        uint64_t first = 0;
+        uint64_t start = 0;
+        while (status_ == def::device_status::up) {
+            auto frame = reader_->next(&timestamp);
+            if (frame == nullptr)
+                break;
+            if (config_.mode == def::replay_mode::timed) {
+                if (start == 0) {
+                    first = timestamp;
+                    start = now_ns();
+                }
+                wait_replay_time(timestamp, first, start);
+            }
+            auto skb = copy_rx_frame(*frame);
+            if (skb == nullptr)
+                continue;
+            batch.push(std::move(skb));
+            // timed frame is passed alone, or it wait for frames behind it
+            if (batch.full() || config_.mode == def::replay_mode::timed)
+                flush_read_batch(batch);
+        }
+        if (status_ != def::device_status::up)
+            break;
+    }
+    flush_read_batch(batch);
+    std::lock_guard<std::mutex> lock(read_mutex_);
+    stats_.finished = true;
+    std::cout << "pcap replay finished, device name: " << dev_name_ << std::endl;
+}
+
+void pcap_device::write_thread() {
+    // frames written by stack are discarded in place, no thread needed
+}
+
+// wait replay time of frame
+void pcap_device::wait_replay_time(uint64_t timestamp, uint64_t first, uint64_t start) {
+    // capture may be out of order, late frame is sent right away
+    if (timestamp <= first || config_.speed <= 0)
+        return;
+    uint64_t target = start + uint64_t((timestamp - first) / config_.speed);
+    uint64_t now = now_ns();
+    if (target > now)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(target - now));
+}
+
+// copy frame to rx buffer
+flow::sk_buff::ptr pcap_device::copy_rx_frame(const std::vector<uint8_t>& frame) {
+    size_t frame_size = def::max_ether_header + mtu_;
+    if (frame.size() < sizeof(struct flow::ether_hdr) || frame.size() > frame_size) {
+        std::lock_guard<std::mutex> lock(read_mutex_);
+        stats_.drops++;
+        return nullptr;
+    }
+    auto hdr = reinterpret_cast<const flow::ether_hdr*>(frame.data());
+    if (!config_.promiscuous && memcmp(mac_address_, hdr->dst, def::mac_len) != 0 &&
+        memcmp(def::broadcast_mac, hdr->dst, def::mac_len) != 0) {
+        std::lock_guard<std::mutex> lock(read_mutex_);
+        stats_.drops++;
+        return nullptr;
+    }
+    flow::sk_buff::ptr skb = flow::sk_buff::alloc(headroom_ + frame_size);
+    if (skb == nullptr) {
+        std::cout << "alloc pcap rx buffer failed" << std::endl;
+        return nullptr;
+    }
+    flow::skb_reserve(skb, headroom_);
+    memcpy(skb->data + skb->data_begin, frame.data(), frame.size());
+    flow::skb_rx_init(skb, if_index_, frame.size());
+    return skb;
+}
+
+// move rx batch to read queue
+void pcap_device::flush_read_batch(flow::skb_batch& batch) {
+    if (batch.empty())
+        return;
+    {
+        // stack is slower than file, bound frames waiting for it
+        std::unique_lock<std::mutex> lock(read_mutex_);
+        space_cond_.wait(lock, [this] {
+            return read_head_.size() < config_.max_pending || status_ != def::device_status::up;
+        });
+        if (start_time_ == 0)
+            start_time_ = now_ns();
+        for (auto& buffer : batch) {
+            stats_.frames[uint8_t(classify_buffer(buffer))]++;
+            stats_.bytes += flow::get_ether_offset() + flow::skb_len(buffer);
+            read_head_.push(std::move(buffer));
+        }
+    }
+    read_cond_.notify_one();
+    batch.clear();
+}
+
+}
@@ -0,0 +1,407 @@
+#ifndef __PCAP_H__
+#define __PCAP_H__
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "interface.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace driver {
+
+/**
+ * @file pcap.hpp
+ * @brief pcap file header
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ * @link https://www.ietf.org/archive/id/draft-ietf-opsawg-pcap-04.html
+ */
+struct pcap_file_hdr {
+    /// def::pcap_magic_usec or def::pcap_magic_nsec, byte swapped if written on other endian
+    uint32_t magic;
+    /// major version
+    uint16_t version_major;
+    /// minor version
+    uint16_t version_minor;
+    /// not used
+    int32_t this_zone;
+    /// not used
+    uint32_t sig_figs;
+    /// max captured frame size
+    uint32_t snap_len;
+    /// link type
+    uint32_t link_type;
+} __attribute__((packed));
+
+/**
+ * @file pcap.hpp
+ * @brief pcap record header, one before each frame
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pcap_record_hdr {
+    /// timestamp second
+    uint32_t ts_sec;
+    /// timestamp usec or nsec, see file magic
+    uint32_t ts_frac;
+    /// captured size
+    uint32_t cap_len;
+    /// size on wire
+    uint32_t orig_len;
+} __attribute__((packed));
+
+/**
+ * @file pcap.hpp
+ * @brief read ether frames from pcap or pcapng file
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class pcap_reader {
+public:
+    typedef std::shared_ptr<pcap_reader> ptr;
+
+    /**
+     * @brief open file and read file header
+     * @param[in] path file path
+     * @return nullptr if file is not pcap or pcapng
+     */
+    static pcap_reader::ptr open(const std::string& path);
+
+    /**
+     * @brief Destroy the pcap reader object
+     */
+    ~pcap_reader();
+
+    /**
+     * @brief read next ether frame, frames of other link type are skipped
+     * @param[out] timestamp capture time in ns
+     * @return frame, valid until next call, empty at file end
+     */
+    const std::vector<uint8_t>* next(uint64_t* timestamp);
+
+    /**
+     * @brief go back to first frame
+     * @return false if file can not seek
+     */
+    bool rewind();
+
+private:
+    pcap_reader(FILE* file, const std::string& path);
+
+    /**
+     * @brief read file header, pcapng section is read block by block later
+     * @return false if format unknown
+     */
+    bool read_file_header();
+
+    /**
+     * @brief read next frame of pcap file
+     * @param[out] timestamp capture time in ns
+     * @return false at file end
+     */
+    bool next_pcap_frame(uint64_t* timestamp);
+
+    /**
+     * @brief read next frame of pcapng file, other blocks are parsed or skipped
+     * @param[out] timestamp capture time in ns
+     * @return false at file end
+     */
+    bool next_pcapng_frame(uint64_t* timestamp);
+
+    /**
+     * @brief read pcapng interface block, link type and timestamp unit are kept
+     * @param[in] body block body
+     */
+    void read_interface_block(const std::vector<uint8_t>& body);
+
+    uint16_t swap16(uint16_t value) const { return swapped_ ? __builtin_bswap16(value) : value; }
+    uint32_t swap32(uint32_t value) const { return swapped_ ? __builtin_bswap32(value) : value; }
+
+private:
+    /// file
+    FILE* file_;
+    /// file path
+    std::string path_;
+    /// file is pcapng
+    bool pcapng_;
+    /// file is written on other endian
+    bool swapped_;
+    /// pcap timestamp fraction is nsec
+    bool nsec_;
+    /// pcap link type
+    uint32_t link_type_;
+    /// pcapng link type per interface
+    std::vector<uint16_t> if_link_types_;
+    /// pcapng timestamp units per second per interface
+    std::vector<uint64_t> if_ts_units_;
+    /// last frame
+    std::vector<uint8_t> frame_;
+};
+
+/**
+ * @file pcap.hpp
+ * @brief write frames to pcap file with nsec timestamp, any thread may write
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class pcap_writer {
+public:
+    typedef std::shared_ptr<pcap_writer> ptr;
+
+    /**
+     * @brief create file and write file header
+     * @param[in] path file path, truncated if exist
+     * @return nullptr if file can not be created
+     */
+    static pcap_writer::ptr open(const std::string& path);
+
+    /**
+     * @brief Destroy the pcap writer object, buffered frames are flushed
+     */
+    ~pcap_writer();
+
+    /**
+     * @brief write one frame gathered from segments, timestamp is now
+     * @param[in] iov frame segments, start at ether header
+     * @param[in] count segment count
+     * @return false if write failed
+     */
+    bool write_frame(const struct iovec* iov, int count);
+
+    /**
+     * @brief flush buffered frames to file
+     */
+    void flush();
+
+private:
+    explicit pcap_writer(FILE* file);
+
+private:
+    /// file
+    FILE* file_;
+    /// write lock, rx and tx threads share file
+    std::mutex mutex_;
+};
+
+/**
+ * @file pcap.hpp
+ * @brief pcap device replay config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pcap_device_config {
+    /// pcap or pcapng file
+    std::string path;
+    /// pace of replay
+    def::replay_mode mode = def::replay_mode::fast;
+    /// gap of timed mode is divided by it
+    double speed = 1.0;
+    /// times file is replayed, 0 replay forever
+    uint32_t loop_count = 1;
+    /// frames waiting for stack, reader wait when full so memory is bound
+    uint32_t max_pending = 4096;
+    /// accept frames for any dst mac, captured frames are rarely sent to stack mac
+    bool promiscuous = true;
+};
+
+/**
+ * @file pcap.hpp
+ * @brief pcap device replay counters
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct pcap_replay_stats {
+    /// frames passed to stack per def::traffic_class
+    std::array<uint64_t, def::traffic_class_count> frames {};
+    /// bytes passed to stack
+    uint64_t bytes = 0;
+    /// frames filtered or too large
+    uint64_t drops = 0;
+    /// frames written by stack, they are discarded
+    uint64_t tx = 0;
+    /// ns from first frame queued to last frame taken by stack, pps is frames divided by it
+    uint64_t elapsed = 0;
+    /// all loops are replayed
+    bool finished = false;
+};
+
+/**
+ * @file pcap.hpp
+ * @brief replay pcap file into stack, frames written by stack are discarded
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class pcap_device: public interface::net_device, public std::enable_shared_from_this<pcap_device> {
+public:
+    typedef std::shared_ptr<pcap_device> ptr;
+
+    /**
+     * @brief Construct a new pcap device object
+     * @param[in] dev_name device name, only used in log
+     * @param[in] ifindex device index, no kernel device so it must be unique in stack
+     * @param[in] ip_address stack ip
+     * @param[in] mac_address stack mac
+     * @param[in] mtu device mtu, larger frames are dropped
+     * @param[in] headroom headroom reserved before ether header of rx buffer
+     * @param[in] config replay config
+     */
+    pcap_device(const std::string& dev_name, uint8_t ifindex, const std::string& ip_address, const std::string& mac_address,
+        uint16_t mtu = def::default_mtu, uint16_t headroom = def::skb_rx_headroom, const pcap_device_config& config = {});
+
+    /**
+     * @brief Destroy the pcap device object
+     */
+    virtual ~pcap_device();
+
+    /**
+     * @brief open pcap file
+     * @return false if file is not pcap or pcapng
+     */
+    virtual bool up();
+
+    /**
+     * @brief stop replay
+     * @return true if success
+     */
+    virtual bool down();
+
+    /**
+     * @brief read replayed frame
+     * @return read buffer
+     */
+    virtual flow::sk_buff::ptr read_from_device();
+
+    /**
+     * @brief discard buffer written by stack
+     * @param[in] buffer write buffer
+     * @return 0 success
+     */
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief read replayed frames, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch);
+
+    /**
+     * @brief get net_device mac
+     * @return device mac
+     */
+    virtual uint8_t* get_device_mac();
+
+    /**
+     * @brief get net_device ip
+     * @return device ip
+     */
+    virtual uint32_t get_device_ip();
+
+    /**
+     * @brief get net_device ifindex
+     * @return device ifindex
+     */
+    virtual uint8_t get_device_ifindex();
+
+    /**
+     * @brief get replay counters
+     * @return counters
+     */
+    pcap_replay_stats get_stats();
+
+public:
+    /**
+     * @brief replay file into read queue
+     */
+    virtual void read_thread();
+
+    /**
+     * @brief frames written by stack are discarded in place, nothing to do
+     */
+    virtual void write_thread();
+
+    /**
+     * @brief get pcap device status from kernel status
+     * @return bool pcap device status
+     */
+    virtual bool kernel_device_status() { return false; };
+
+    /**
+     * @brief get pcap device status from user status
+     * @return bool pcap device status
+     */
+    virtual bool user_device_status() { return status_ == def::device_status::up; };
+
+private:
+    /**
+     * @brief copy frame to rx buffer and fill buffer info
+     * @param[in] frame frame, start at ether header
+     * @return rx buffer, nullptr if dropped
+     */
+    flow::sk_buff::ptr copy_rx_frame(const std::vector<uint8_t>& frame);
+
+    /**
+     * @brief wait until gap since first frame is reached in timed mode
+     * @param[in] timestamp capture time of frame
+     * @param[in] first capture time of first frame of loop
+     * @param[in] start time first frame of loop is replayed
+     */
+    void wait_replay_time(uint64_t timestamp, uint64_t first, uint64_t start);
+
+    /**
+     * @brief move rx batch to read queue, wait if too many frames are pending
+     * @param[in] batch rx buffers
+     */
+    void flush_read_batch(flow::skb_batch& batch);
+
+private:
+    /// device name
+    std::string dev_name_;
+    /// device index
+    uint8_t if_index_;
+    /// stack address
+    uint32_t ip_address_;
+    /// stack mac
+    uint8_t mac_address_[def::mac_len];
+    /// device mtu
+    uint16_t mtu_;
+    /// rx buffer headroom
+    uint16_t headroom_;
+    /// replay config
+    pcap_device_config config_;
+    /// replayed file
+    pcap_reader::ptr reader_;
+    /// read buffer head
+    flow::skb_queue read_head_;
+    /// read share mutex
+    std::mutex read_mutex_;
+    /// read share condition
+    std::condition_variable read_cond_;
+    /// reader wait here when too many frames are pending
+    std::condition_variable space_cond_;
+    /// replay counters, guarded by read mutex
+    pcap_replay_stats stats_;
+    /// time first frame is queued, 0 before replay
+    uint64_t start_time_;
+    /// time stack take frames last
+    uint64_t last_take_time_;
+    /// frames written by stack
+    std::atomic<uint64_t> tx_frames_;
+    /// device status
+    std::atomic<def::device_status> status_;
+};
+
+
+}
+
+#endif // __PCAP_H__
@@ -0,0 +1,357 @@
+#include "pool.hpp"
+#include "def.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace flow {
+
+namespace {
+
+// size class count
+const uint8_t pool_class_count = def::skb_pool_class_count;
+
+// oversize block, not cached
+const uint8_t pool_class_oversize = 0xff;
+
+// block size of each class, include block header
+const size_t pool_class_size[pool_class_count] = { 128, 256, 512, 2048, 16384, 65536 + 1024 };
+
+// max cached block of each class per thread
+const uint32_t pool_class_max_cache[pool_class_count] = { 1024, 1024, 1024, 512, 64, 16 };
+
+struct thread_cache;
+
+/**
+ * @file pool.cc
+ * @brief block header, store before user memory, keep user memory cache line aligned
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct alignas(def::cache_line_size) pool_block {
+    /// next free block
+    pool_block* next;
+    /// owner thread cache
+    thread_cache* owner;
+    /// arena own the memory, nullptr if from malloc
+    skb_arena* arena;
+    /// size class
+    uint8_t size_class;
+};
+
+/**
+ * @file pool.cc
+ * @brief per thread free lists, cache is never deleted so owner stays valid
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct thread_cache {
+    /// free list of each class
+    pool_block* free_list[pool_class_count] = {};
+    /// free list len of each class
+    uint32_t free_count[pool_class_count] = {};
+    /// block freed by other threads
+    std::atomic<pool_block*> remote_list { nullptr };
+    /// owner thread alive
+    std::atomic<bool> alive { true };
+    /// statistic, only owner write hit and miss
+    std::atomic<uint64_t> hit { 0 };
+    std::atomic<uint64_t> miss { 0 };
+    std::atomic<uint64_t> remote_free { 0 };
+    std::atomic<uint64_t> release { 0 };
+    /// arena used on miss, only owner access it
+    skb_arena::ptr arena;
+};
+
+/// registry mutex
+std::mutex registry_mutex;
+/// all thread caches, used for statistic
+std::vector<thread_cache*> registry;
+
+/**
+ * @brief release block to arena or system
+ * @param[in] cache cache to account
+ * @param[in] block block
+ */
+void release_block(thread_cache* cache, pool_block* block) {
+    if (block->arena != nullptr)
+        block->arena->free_block(block->size_class, block);
+    else
+        std::free(block);
+    cache->release.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief release block chain to system
+ * @param[in] cache cache to account
+ * @param[in] block block chain
+ */
+void release_chain(thread_cache* cache, pool_block* block) {
+    while (block != nullptr) {
+        auto next = block->next;
+        release_block(cache, block);
+        block = next;
+    }
+}
+
+/**
+ * @file pool.cc
+ * @brief thread local holder, mark cache dead when thread exit
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct thread_cache_holder {
+    thread_cache_holder() : cache(new thread_cache()) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(cache);
+    }
+
+    ~thread_cache_holder() {
+        cache->alive.store(false);
+        for (uint8_t index = 0; index < pool_class_count; index++) {
+            release_chain(cache, cache->free_list[index]);
+            cache->free_list[index] = nullptr;
+            cache->free_count[index] = 0;
+        }
+        // late remote free will see dead owner and release itself
+        release_chain(cache, cache->remote_list.exchange(nullptr));
+    }
+
+    /// thread cache
+    thread_cache* cache;
+};
+
+/**
+ * @brief get current thread cache
+ * @return thread cache
+ */
+thread_cache* local_cache() {
+    static thread_local thread_cache_holder holder;
+    return holder.cache;
+}
+
+/**
+ * @brief move remote freed blocks to local free lists
+ * @param[in] cache current thread cache
+ */
+void drain_remote(thread_cache* cache) {
+    auto block = cache->remote_list.exchange(nullptr, std::memory_order_acquire);
+    while (block != nullptr) {
+        auto next = block->next;
+        auto size_class = block->size_class;
+        if (cache->free_count[size_class] < pool_class_max_cache[size_class]) {
+            block->next = cache->free_list[size_class];
+            cache->free_list[size_class] = block;
+            cache->free_count[size_class]++;
+        } else {
+            release_block(cache, block);
+        }
+        block = next;
+    }
+}
+
+/**
+ * @brief get size class
+ * @param[in] size block size include header
+ * @return size class
+ */
+uint8_t get_size_class(size_t size) {
+    for (uint8_t index = 0; index < pool_class_count; index++) {
+        if (size <= pool_class_size[index])
+            return index;
+    }
+    return pool_class_oversize;
+}
+
+}
+
+// alloc block
+void* skb_pool::alloc(size_t size) {
+    auto cache = local_cache();
+    auto size_class = get_size_class(size + sizeof(struct pool_block));
+    pool_block* block = nullptr;
+    if (size_class != pool_class_oversize) {
+        // try local list first, then collect blocks freed by other threads
+        if (cache->free_list[size_class] == nullptr)
+            drain_remote(cache);
+        block = cache->free_list[size_class];
+        if (block != nullptr) {
+            cache->free_list[size_class] = block->next;
+            cache->free_count[size_class]--;
+            cache->hit.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (block == nullptr) {
+        size_t alloc_size = 0;
+        if (size_class == pool_class_oversize) {
+            alloc_size = size + sizeof(struct pool_block);
+            alloc_size = (alloc_size + def::cache_line_size - 1) / def::cache_line_size * def::cache_line_size;
+        } else {
+            alloc_size = pool_class_size[size_class];
+        }
+        // carve from arena first, fall back to malloc when exhausted
+        skb_arena* arena = nullptr;
+        if (cache->arena != nullptr && size_class != pool_class_oversize) {
+            block = static_cast<pool_block*>(cache->arena->alloc_block(size_class, alloc_size));
+            if (block != nullptr)
+                arena = cache->arena.get();
+        }
+        if (block == nullptr)
+            block = static_cast<pool_block*>(std::aligned_alloc(def::cache_line_size, alloc_size));
+        if (block == nullptr)
+            return nullptr;
+        block->arena = arena;
+        cache->miss.fetch_add(1, std::memory_order_relaxed);
+    }
+    block->next = nullptr;
+    block->owner = cache;
+    block->size_class = size_class;
+    return block + 1;
+}
+
+// free block
+void skb_pool::free(void* ptr) {
+    if (ptr == nullptr)
+        return;
+    auto block = static_cast<pool_block*>(ptr) - 1;
+    auto owner = block->owner;
+    // oversize block dont cache
+    if (block->size_class == pool_class_oversize) {
+        std::free(block);
+        owner->release.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto cache = local_cache();
+    if (owner == cache && cache->alive.load(std::memory_order_relaxed)) {
+        auto size_class = block->size_class;
+        if (cache->free_count[size_class] >= pool_class_max_cache[size_class]) {
+            release_block(cache, block);
+            return;
+        }
+        block->next = cache->free_list[size_class];
+        cache->free_list[size_class] = block;
+        cache->free_count[size_class]++;
+        return;
+    }
+    // push back to owner, owner drain it on next miss
+    owner->remote_free.fetch_add(1, std::memory_order_relaxed);
+    auto head = owner->remote_list.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!owner->remote_list.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+    // owner may exit after push, release for it
+    if (!owner->alive.load())
+        release_chain(owner, owner->remote_list.exchange(nullptr));
+}
+
+// get pool statistic
+skb_pool_stats skb_pool::get_stats() {
+    skb_pool_stats stats = {};
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto cache : registry) {
+        stats.hit += cache->hit.load(std::memory_order_relaxed);
+        stats.miss += cache->miss.load(std::memory_order_relaxed);
+        stats.remote_free += cache->remote_free.load(std::memory_order_relaxed);
+        stats.release += cache->release.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+// bind arena to current thread
+void skb_pool::bind_arena(const skb_arena::ptr& arena) {
+    local_cache()->arena = arena;
+}
+
+// create arena
+skb_arena::ptr skb_arena::create(const skb_arena_config& config) {
+    size_t size = (config.size + def::hugepage_size - 1) / def::hugepage_size * def::hugepage_size;
+    bool hugepage = false;
+    void* memory = MAP_FAILED;
+    // hugetlb pages need to be reserved by system
+    if (config.hugepage) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        hugepage = memory != MAP_FAILED;
+    }
+    if (memory == MAP_FAILED) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            std::cout << "map skb arena failed, size: " << std::dec << size << std::endl;
+            return nullptr;
+        }
+        // let kernel back it with transparent hugepage
+        if (config.hugepage)
+            madvise(memory, size, MADV_HUGEPAGE);
+    }
+    // bind to node before first touch
+    int numa_node = config.numa_node;
+    if (numa_node < 0) {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+            numa_node = node;
+    }
+    if (numa_node >= 0 && numa_node < int(sizeof(unsigned long) * 8)) {
+        unsigned long node_mask = 1UL << numa_node;
+        if (syscall(SYS_mbind, memory, size, MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8, 0) != 0)
+            numa_node = -1;
+    }
+    auto arena = skb_arena::ptr(new skb_arena(static_cast<char*>(memory), size, hugepage, numa_node));
+    std::cout << "create skb arena, size: " << std::dec << size << ", hugepage: " << hugepage 
+        << ", numa node: " << numa_node << std::endl;
+    return arena;
+}
+
+skb_arena::skb_arena(char* memory, size_t size, bool hugepage, int numa_node) 
+    : memory_(memory), size_(size), used_(0), cached_(0), hugepage_(hugepage), numa_node_(numa_node), free_list_() {}
+
+skb_arena::~skb_arena() {
+    munmap(memory_, size_);
+}
+
+// alloc block from arena
+void* skb_arena::alloc_block(uint8_t size_class, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // reuse returned block first
+    auto block = static_cast<pool_block*>(free_list_[size_class]);
+    if (block != nullptr) {
+        free_list_[size_class] = block->next;
+        cached_ -= size;
+        return block;
+    }
+    // power of 2 block is aligned to its size, so it never cross page or af_xdp chunk
+    size_t offset = used_;
+    if ((size & (size - 1)) == 0)
+        offset = (offset + size - 1) & ~(size - 1);
+    if (offset + size > size_)
+        return nullptr;
+    auto memory = memory_ + offset;
+    used_ = offset + size;
+    return memory;
+}
+
+// return block to arena
+void skb_arena::free_block(uint8_t size_class, void* block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    static_cast<pool_block*>(block)->next = static_cast<pool_block*>(free_list_[size_class]);
+    free_list_[size_class] = block;
+    cached_ += pool_class_size[size_class];
+}
+
+// get arena memory footprint
+skb_arena_stats skb_arena::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return skb_arena_stats{ size_, used_, cached_, hugepage_, numa_node_ };
+}
+
+}
@@ -0,0 +1,195 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include "def.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace flow {
+
+/**
+ * @file pool.hpp
+ * @brief sk buff pool statistic
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_pool_stats {
+    /// alloc served from thread cache
+    uint64_t hit;
+    /// alloc fall back to malloc
+    uint64_t miss;
+    /// block freed by non owner thread
+    uint64_t remote_free;
+    /// block returned to system
+    uint64_t release;
+};
+
+/**
+ * @file pool.hpp
+ * @brief packet buffer arena config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_arena_config {
+    /// use arena for device rx thread
+    bool enable = false;
+    /// arena size, round up to hugepage size
+    size_t size = 64 << 20;
+    /// numa node, -1 means node of the thread bind to arena
+    int numa_node = -1;
+    /// try 2M hugepage first
+    bool hugepage = true;
+};
+
+/**
+ * @file pool.hpp
+ * @brief packet buffer arena memory footprint
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct skb_arena_stats {
+    /// mapped bytes
+    size_t reserved;
+    /// bytes carved to blocks
+    size_t used;
+    /// bytes of blocks returned to arena
+    size_t cached;
+    /// backed by hugetlb pages
+    bool hugepage;
+    /// bound numa node, -1 if not bound
+    int numa_node;
+};
+
+/**
+ * @file pool.hpp
+ * @brief hugepage backed memory bound to numa node, blocks are carved for pool miss
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class skb_arena {
+public:
+    typedef std::shared_ptr<skb_arena> ptr;
+
+    /**
+     * @brief map arena memory, fall back to normal pages if hugepage not available
+     * @param[in] config arena config
+     * @return arena, nullptr if map failed
+     */
+    static skb_arena::ptr create(const skb_arena_config& config);
+
+    /**
+     * @brief unmap arena memory
+     */
+    ~skb_arena();
+
+    /**
+     * @brief alloc block from arena
+     * @param[in] size_class size class
+     * @param[in] size block size
+     * @return block memory, nullptr if arena exhausted
+     */
+    void* alloc_block(uint8_t size_class, size_t size);
+
+    /**
+     * @brief return block to arena
+     * @param[in] size_class size class
+     * @param[in] block block memory
+     */
+    void free_block(uint8_t size_class, void* block);
+
+    /**
+     * @brief get arena memory footprint
+     * @return arena statistic
+     */
+    skb_arena_stats get_stats();
+
+    /**
+     * @brief get arena memory, used to register it to kernel like af_xdp umem
+     * @return mapped memory
+     */
+    char* get_memory() { return memory_; }
+
+    /**
+     * @brief get arena size
+     * @return mapped size
+     */
+    size_t get_size() { return size_; }
+
+    /**
+     * @brief check if memory is carved from arena
+     * @param[in] ptr memory
+     * @return true if ptr is in arena
+     */
+    bool contains(const void* ptr) { return ptr >= memory_ && ptr < memory_ + size_; }
+
+private:
+    /**
+     * @brief create arena with mapped memory
+     */
+    skb_arena(char* memory, size_t size, bool hugepage, int numa_node);
+
+private:
+    /// arena lock, only taken on pool miss and overflow
+    std::mutex mutex_;
+    /// mapped memory
+    char* memory_;
+    /// mapped size
+    size_t size_;
+    /// carved size
+    size_t used_;
+    /// returned block size
+    size_t cached_;
+    /// backed by hugetlb pages
+    bool hugepage_;
+    /// bound numa node
+    int numa_node_;
+    /// returned blocks of each class
+    void* free_list_[def::skb_pool_class_count];
+};
+
+/**
+ * @file pool.hpp
+ * @brief size classed per thread block pool, used to alloc sk buff
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class skb_pool {
+public:
+    /**
+     * @brief alloc block from current thread cache
+     * @param[in] size block size
+     * @return block memory, nullptr if system out of memory
+     */
+    static void* alloc(size_t size);
+
+    /**
+     * @brief free block, return to owner thread cache
+     * @param[in] ptr block memory
+     */
+    static void free(void* ptr);
+
+    /**
+     * @brief get pool statistic of all threads
+     * @return pool statistic
+     */
+    static skb_pool_stats get_stats();
+
+    /**
+     * @brief refill current thread cache from arena, cache keep arena alive
+     * @param[in] arena arena, nullptr to use malloc
+     */
+    static void bind_arena(const skb_arena::ptr& arena);
+
+private:
+    /**
+     * @brief not allow to create pool obj
+     */
+    skb_pool() = delete;
+};
+
+}
+
+#endif // __POOL_H__
@@ -19,6 +19,7 @@
 #include <thread>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -33,6 +34,11 @@ raw_stack::ptr raw_stack::get_instance() {
     return instance;
 }
 
+// create raw_stack apart from instance
+raw_stack::ptr raw_stack::create() {
+    return raw_stack::ptr(new raw_stack());
+}
+
 raw_stack::raw_stack() {
     neighbor_table_ = flow_table::neighbor_table::create();
     udp_sock_table_ = flow_table::sock_table::create();
@@ -42,9 +48,14 @@ raw_stack::raw_stack() {
 // init raw_stack
 void raw_stack::init() {
     srand((unsigned)time(NULL));
-    auto tcp_handler = protocol::tcp::create(weak_from_this());
     // register macvlan device
     register_device(driver::macvlan_device::ptr(new driver::macvlan_device("new_eth0", "172.17.0.253", "f6:34:95:26:90:66")));
+    register_handlers();
+}
+
+// register protocol handlers
+void raw_stack::register_handlers() {
+    auto tcp_handler = protocol::tcp::create(weak_from_this());
     // register network handler
     register_network_handler(protocol::arp::create(weak_from_this()));
     register_network_handler(protocol::ip::create(weak_from_this()));
@@ -56,7 +67,11 @@ void raw_stack::init() {
 }
 
 // write buffer to device
-void raw_stack::write_to_device(flow::sk_buff::ptr buffer) {
+void raw_stack::write_to_device(const flow::sk_buff::ptr& buffer) {
+    // children refer to parent page, take them out to break reference cycle
+    std::vector<flow::sk_buff::ptr> child_frags;
+    if (flow::skb_has_frags(buffer))
+        child_frags = std::move(buffer->ext->child_frags);
     // look for dst mac address
     if (std::holds_alternative<uint32_t>(buffer->dst)) {
         auto ip_address = std::get<uint32_t>(buffer->dst);
@@ -68,34 +83,40 @@ void raw_stack::write_to_device(flow::sk_buff::ptr buffer) {
         std::array<uint8_t, def::mac_len> dst;
         memcpy(dst.data(), neigh.value()->mac_address, def::mac_len);
         buffer->dst = dst;
-    }
-    if (!buffer->child_frags.empty()) {
-        for (auto iter : buffer->child_frags) {
-            // look for dst mac address
-            if (std::holds_alternative<uint32_t>(iter->dst)) {
-                auto ip_address = std::get<uint32_t>(iter->dst);
-                auto neigh = neighbor_table_->get(ip_address);
-                if (!neigh.has_value()) {
-                    std::cout << "cant find neigh, ip: " << std::hex << ip_address << std::endl;
-                    return; 
-                }
-                std::array<uint8_t, def::mac_len> dst;
-                memcpy(dst.data(), neigh.value()->mac_address, def::mac_len);
-                iter->dst = dst;
-            }
-        }
+        // children share the same dst
+        for (auto& iter : child_frags)
+            iter->dst = dst;
     }
     // check if device exist
-    if (!buffer->dev.expired()) {
-        auto dev = buffer->dev.lock();
+    auto dev = get_tx_device(buffer->dev_index);
+    if (dev == nullptr)
+        return;
+    if (child_frags.empty()) {
         dev->write_to_device(buffer);
         return;
     }
+    // queue buffer and children per batch
+    flow::skb_batch batch;
+    batch.push(buffer);
+    for (auto& iter : child_frags) {
+        if (batch.full()) {
+            dev->write_to_device(batch);
+            batch.clear();
+        }
+        batch.push(iter);
+    }
+    dev->write_to_device(batch);
+}
+
+// get device buffer is written to
+interface::net_device::ptr raw_stack::get_tx_device(uint8_t ifindex) {
+    auto dev = get_device(ifindex);
+    if (dev != nullptr)
+        return dev;
     // find device
     if (device_map_.empty())
-        return;
-
-    device_map_.begin()->second->write_to_device(buffer);
+        return nullptr;
+    return device_map_.begin()->second;
 }
 
 void raw_stack::run() {
@@ -115,7 +136,7 @@ void raw_stack::wait() {
 }
 
 // update neighbor info 
-void raw_stack::update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device::ptr dev) {
+void raw_stack::update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device* dev) {
     // check if arp is empty
     if (hdr == nullptr)
         return;
@@ -131,55 +152,152 @@ void raw_stack::update_neighbor(const struct flow::arp_hdr* hdr, interface::net_
 void raw_stack::run_read_device() {
     for (auto& device : device_map_) {
         device.second->up();
-        // read buffer from device
-        thread_vec_.push_back(std::thread(&interface::net_device::read_thread, device.second));
-        // write buffer from device
-        thread_vec_.push_back(std::thread(&interface::net_device::write_thread, device.second));
+        for (uint32_t queue = 0; queue < device.second->get_queue_count(); queue++) {
+            // read buffer from device
+            thread_vec_.push_back(std::thread(&raw_stack::read_device_thread, this, device.second, queue));
+            // write buffer from device
+            thread_vec_.push_back(std::thread(&interface::net_device::write_queue_thread, device.second, queue));
+        }
+    }
+}
+
+// read device queue with arena bound
+void raw_stack::read_device_thread(interface::net_device::ptr device, uint32_t queue) {
+    auto ifindex = device->get_device_ifindex();
+    auto config = arena_config_map_.find(ifindex);
+    if (config != arena_config_map_.end() && config->second.enable) {
+        auto arena = flow::skb_arena::create(config->second);
+        if (arena != nullptr) {
+            flow::skb_pool::bind_arena(arena);
+            std::lock_guard<std::mutex> lock(arena_mutex_);
+            arena_map_[ifindex].push_back(arena);
+        }
+    }
+    device->read_queue_thread(queue);
+}
+
+// get device arena footprint
+std::optional<flow::skb_arena_stats> raw_stack::get_device_arena_stats(uint8_t ifindex) {
+    std::lock_guard<std::mutex> lock(arena_mutex_);
+    auto elem = arena_map_.find(ifindex);
+    if (elem == arena_map_.end() || elem->second.empty())
+        return std::nullopt;
+    // queues share config, only sizes differ
+    auto stats = elem->second.front()->get_stats();
+    for (size_t index = 1; index < elem->second.size(); index++) {
+        auto queue_stats = elem->second[index]->get_stats();
+        stats.reserved += queue_stats.reserved;
+        stats.used += queue_stats.used;
+        stats.cached += queue_stats.cached;
     }
+    return stats;
 }
 
 void raw_stack::handle_packege() {
-    // handle all packages
+    // handle all packages, one pipeline per device queue
     for (auto& device : device_map_) {
-        auto thread = std::thread([&] {
-            while (true) {
-                // read from device
-                auto buffer = device.second->read_from_device();
-                if (buffer == nullptr)
-                    continue;
-                buffer->stack = weak_from_this();
-                // search handle 
-                if (!handle_network_package(buffer))
-                    continue;
-                // check if is icmp request, if is, need send to network layer
-                if (def::network_protocol(buffer->protocol) == def::network_protocol::icmp) {
-                    handle_network_package(buffer);
-                    continue;
-                }
-                if (!handle_transport_package(buffer))
-                    continue;
-                // search for socket
-                if (def::transport_protocol(buffer->protocol) == def::transport_protocol::udp) {
-                    // get full key
-                    auto key = buffer->key;
-                    auto sock = udp_sock_table_->sock_get(key);
-                    if (sock == nullptr) {
-                        sock = udp_sock_table_->sock_get(std::make_shared<flow_table::sock_key>(0, key->local_port, 
-                            0, 0, def::transport_protocol::udp));
-                    }
-                    if (sock == nullptr) {
-                        std::cout << "recv udp sock unsaved" << std::endl;
+        auto dev = device.second;
+        for (uint32_t queue = 0; queue < dev->get_queue_count(); queue++) {
+            auto thread = std::thread([this, dev, queue] {
+                flow::skb_batch batch;
+                while (true) {
+                    // read from device queue, one lock per batch
+                    batch.clear();
+                    if (dev->read_from_queue(queue, batch) == 0)
                         continue;
-                    }
-                    sock->write_buffer_to_queue(buffer);
-                } else if (def::transport_protocol(buffer->protocol) == def::transport_protocol::tcp) {
-                    std::cout << "current sock is tcp protocol" << std::endl;
-                    
+                    // search handle, only buffers need next handle are kept
+                    handle_network_batch(batch);
+                    handle_transport_batch(batch);
+                    // search for socket
+                    deliver_udp_batch(batch);
                 }
-            }
+            });
+            thread_vec_.push_back(std::move(thread));
+        }
+    }
+}
+
+// handle network batch
+void raw_stack::handle_network_batch(flow::skb_batch& batch) {
+    flow::skb_batch next;
+    while (!batch.empty()) {
+        // group by protocol, handler is dispatched once per group
+        auto protocol = batch[0]->protocol;
+        flow::skb_batch group;
+        batch.take_if(group, [protocol] (flow::sk_buff::ptr& buffer) { return buffer->protocol == protocol; });
+        auto handler = network_handler_map_.find(def::network_protocol(protocol));
+        if (handler == network_handler_map_.end()) {
+            std::cout << "recv unknown network protocol flow, protocol: " << std::hex << protocol << std::endl;
+            continue;
+        }
+        handler->second->unpack_batch(group);
+        // icmp request need send to network layer again
+        group.take_if(batch, [] (flow::sk_buff::ptr& buffer) {
+            return def::network_protocol(buffer->protocol) == def::network_protocol::icmp;
         });
-        thread_vec_.push_back(std::move(thread));
+        group.take_all(next);
+    }
+    next.take_all(batch);
+}
+
+// handle transport batch
+void raw_stack::handle_transport_batch(flow::skb_batch& batch) {
+    flow::skb_batch next;
+    while (!batch.empty()) {
+        auto protocol = batch[0]->protocol;
+        flow::skb_batch group;
+        batch.take_if(group, [protocol] (flow::sk_buff::ptr& buffer) { return buffer->protocol == protocol; });
+        auto handler = transport_handler_map_.find(def::transport_protocol(protocol));
+        if (handler == transport_handler_map_.end()) {
+            std::cout << "recv unknown transport protocol flow, protocol: " << std::hex << protocol << std::endl;
+            continue;
+        }
+        handler->second->unpack_batch(group);
+        group.take_all(next);
     }
+    next.take_all(batch);
+}
+
+// deliver udp batch to socks
+void raw_stack::deliver_udp_batch(flow::skb_batch& batch) {
+    flow_table::sock::ptr last_sock;
+    flow::flow_key last_key = {};
+    uint32_t last_hash = 0;
+    // consecutive buffers of one flow are queued under one lock
+    flow::skb_batch pending;
+    for (auto& buffer : batch) {
+        if (def::transport_protocol(buffer->protocol) != def::transport_protocol::udp)
+            continue;
+        // get full key, filled by udp unpack
+        const auto& key = buffer->ext->flow;
+        // broadcast and multicast go to every sock on port
+        if (key.local_ip == def::broadcast_ip || (key.local_ip >> 28) == def::multicast_ip_prefix) {
+            deliver_to_socks(udp_sock_table_->sock_get_by_port(key.local_port), buffer);
+            continue;
+        }
+        // same flow as last buffer, skip table lookup
+        if (last_sock != nullptr && buffer->hash == last_hash && key == last_key) {
+            pending.push(buffer);
+            continue;
+        }
+        auto sock = udp_sock_table_->sock_get(key);
+        if (sock == nullptr)
+            sock = udp_sock_table_->sock_get(flow::flow_key{ 0, 0, key.local_port, 0, def::transport_protocol::udp });
+        if (sock == nullptr) {
+            std::cout << "recv udp sock unsaved" << std::endl;
+            continue;
+        }
+        if (sock != last_sock && last_sock != nullptr) {
+            last_sock->write_batch_to_queue(pending);
+            pending.clear();
+        }
+        last_sock = sock;
+        last_key = key;
+        last_hash = buffer->hash;
+        pending.push(buffer);
+    }
+    if (last_sock != nullptr)
+        last_sock->write_batch_to_queue(pending);
 }
 
 // write transport package
@@ -217,8 +335,27 @@ void raw_stack::handle_sock_buffer_package() {
     return;
 }
 
+// deliver one buffer to many socks
+void raw_stack::deliver_to_socks(const std::vector<flow_table::sock::ptr>& socks, const flow::sk_buff::ptr& buffer) {
+    if (socks.empty()) {
+        std::cout << "recv udp sock unsaved" << std::endl;
+        return;
+    }
+    // clone before any sock see the buffer, each clone share the payload
+    std::vector<flow::sk_buff::ptr> clones;
+    for (size_t index = 1; index < socks.size(); index++) {
+        auto clone = flow::skb_clone(buffer, 0);
+        if (clone == nullptr)
+            break;
+        clones.push_back(std::move(clone));
+    }
+    socks.front()->write_buffer_to_queue(buffer);
+    for (size_t index = 0; index < clones.size(); index++)
+        socks[index + 1]->write_buffer_to_queue(clones[index]);
+}
+
 // handle network package
-bool raw_stack::handle_network_package(flow::sk_buff::ptr buffer) {
+bool raw_stack::handle_network_package(flow::sk_buff::ptr& buffer) {
     // get network handler
     auto handler = network_handler_map_.find(def::network_protocol(buffer->protocol));
     if (handler == network_handler_map_.end()) {
@@ -231,7 +368,7 @@ bool raw_stack::handle_network_package(flow::sk_buff::ptr buffer) {
 
 
 // handle transport package
-bool raw_stack::handle_transport_package(flow::sk_buff::ptr buffer) {
+bool raw_stack::handle_transport_package(const flow::sk_buff::ptr& buffer) {
     // get transport handler
     auto handler = transport_handler_map_.find(def::transport_protocol(buffer->protocol));
     if (handler == transport_handler_map_.end()) {
@@ -242,13 +379,13 @@ bool raw_stack::handle_transport_package(flow::sk_buff::ptr buffer) {
     if (!handler->second->unpack_flow(buffer))
         return false;
     // check if key exist
-    if (buffer->key == nullptr)
+    if (buffer->ext == nullptr || buffer->ext->key == nullptr)
         return true;
     return true;
 }
 
 // write network package
-bool raw_stack::write_network_package(flow::sk_buff::ptr buffer) {
+bool raw_stack::write_network_package(const flow::sk_buff::ptr& buffer) {
     auto protocol = def::network_protocol::none;
     switch (buffer->protocol) {
     case uint16_t(def::network_protocol::icmp):
@@ -274,7 +411,7 @@ bool raw_stack::write_network_package(flow::sk_buff::ptr buffer) {
 }
 
 // write transport package
-bool raw_stack::write_transport_package(flow::sk_buff::ptr buffer) {
+bool raw_stack::write_transport_package(const flow::sk_buff::ptr& buffer) {
     // get network handler
     auto handler = transport_handler_map_.find(def::transport_protocol(buffer->protocol));
     if (handler == transport_handler_map_.end()) {
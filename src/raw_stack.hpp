@@ -11,6 +11,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <thread>
@@ -39,19 +41,58 @@ public:
      */
     static raw_stack::ptr get_instance();
 
+    /**
+     * @brief create raw_stack apart from instance, like two stacks connected by pair device in one process
+     * @return raw_stack, no device or handler registered
+     */
+    static raw_stack::ptr create();
+
     /**
      * @brief init raw_stack
      */
     virtual void init();
 
+    /**
+     * @brief register arp, ip, icmp, udp and tcp handlers
+     */
+    virtual void register_handlers();
+
     /**
      * @brief register device to raw_stack
      * @param[in] device device
+     * @param[in] arena_config buffer arena of device rx thread
      */
-    virtual void register_device(interface::net_device::ptr device) {
+    virtual void register_device(interface::net_device::ptr device, const flow::skb_arena_config& arena_config = {}) {
         device_map_.insert(std::make_pair(device->get_device_ifindex(), device));
+        arena_config_map_.insert(std::make_pair(device->get_device_ifindex(), arena_config));
+    }
+
+    /**
+     * @brief get buffer arena memory footprint of device, all queues included
+     * @param[in] ifindex device index
+     * @return arena statistic, nullopt if device use malloc
+     */
+    std::optional<flow::skb_arena_stats> get_device_arena_stats(uint8_t ifindex);
+
+    /**
+     * @brief get device by index
+     * @param[in] ifindex device index
+     * @return device, nullptr if not exist
+     */
+    virtual interface::net_device::ptr get_device(uint8_t ifindex) {
+        auto elem = device_map_.find(ifindex);
+        if (elem == device_map_.end())
+            return nullptr;
+        return elem->second;
     }
 
+    /**
+     * @brief get device buffer is written to, first device if buffer has no device
+     * @param[in] ifindex device index of buffer, 0 if buffer has no device
+     * @return device, nullptr if no device
+     */
+    virtual interface::net_device::ptr get_tx_device(uint8_t ifindex);
+
     /**
      * @brief register network handler to raw_stack
      * @param[in] handler network handler
@@ -80,41 +121,41 @@ public:
      * @brief write to device
      * @param[in] buffer write buffer
      */
-    virtual void write_to_device(flow::sk_buff::ptr buffer);
+    virtual void write_to_device(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief update neighbor info
      * @param[in] hdr arp hdr
      */
-    virtual void update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device::ptr dev);
+    virtual void update_neighbor(const struct flow::arp_hdr* hdr, interface::net_device* dev);
 
     /**
      * @brief handle network layer buffer
      * @param[in] buffer buffer remove ether header
      * @return if need next handle
      */
-    virtual bool handle_network_package(flow::sk_buff::ptr buffer);
+    virtual bool handle_network_package(flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle transport layer buffer
      * @param[in] buffer buffer remove network header
      * @return if need next handle
      */    
-    virtual bool handle_transport_package(flow::sk_buff::ptr buffer);
+    virtual bool handle_transport_package(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief write to network
      * @param[in] buffer buffer remove ether header
      * @return if need next handle
      */
-    virtual bool write_network_package(flow::sk_buff::ptr buffer);
+    virtual bool write_network_package(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief write to transport
      * @param[in] buffer write transport
      * @return if need next handle
      */
-    virtual bool write_transport_package(flow::sk_buff::ptr buffer);
+    virtual bool write_transport_package(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief read and handle buffer
@@ -251,6 +292,38 @@ private:
      */
     void handle_sock_buffer_package();
 
+    /**
+     * @brief deliver buffer to socks, payload is shared by clones
+     * @param[in] socks socks to deliver
+     * @param[in] buffer buffer
+     */
+    void deliver_to_socks(const std::vector<flow_table::sock::ptr>& socks, const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief handle network layer batch
+     * @param[in,out] batch buffers remove ether header, only buffers need transport handle are kept
+     */
+    void handle_network_batch(flow::skb_batch& batch);
+
+    /**
+     * @brief handle transport layer batch
+     * @param[in,out] batch buffers remove network header, only buffers need sock delivery are kept
+     */
+    void handle_transport_batch(flow::skb_batch& batch);
+
+    /**
+     * @brief deliver udp buffers to sock queue
+     * @param[in] batch buffers remove transport header
+     */
+    void deliver_udp_batch(flow::skb_batch& batch);
+
+    /**
+     * @brief read device queue in current thread, arena is created on node of this thread
+     * @param[in] device device
+     * @param[in] queue queue index
+     */
+    void read_device_thread(interface::net_device::ptr device, uint32_t queue);
+
 private:
     /// network handler map
     std::unordered_map<def::network_protocol, interface::network_handler::ptr> network_handler_map_;
@@ -260,6 +333,12 @@ private:
     std::unordered_map<def::transport_protocol, interface::sock_handler::ptr> sock_handler_map_;
     /// device map
     std::unordered_map<uint8_t, interface::net_device::ptr> device_map_;
+    /// device arena config
+    std::unordered_map<uint8_t, flow::skb_arena_config> arena_config_map_;
+    /// device arena, created by rx thread of each queue
+    std::unordered_map<uint8_t, std::vector<flow::skb_arena::ptr>> arena_map_;
+    /// arena map mutex
+    std::mutex arena_mutex_;
     /// thread vector
     std::vector<std::thread> thread_vec_;
     /// neighbor flow 
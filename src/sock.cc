@@ -33,17 +33,20 @@ size_t sock::read(char* buf, size_t size) {
     // get buffer
     auto buffer = read_queue.front();
     // save key first
-    buffer->key = key;
-    if (buffer->get_data_len() > size) {
-        // copy data to bufer
-        memcpy(buf, buffer->get_data(), size);
-        skb_pull(buffer, size);
+    auto ext = buffer->get_ext();
+    if (ext != nullptr)
+        ext->key = key;
+    auto data_len = flow::skb_len(buffer);
+    if (data_len > size) {
+        // copy data to bufer, payload segments included
+        flow::skb_copy_data(buffer, buf, size);
+        flow::skb_consume(buffer, size);
         return size;
     } else {
         // read all data and pop this buffer
-        memcpy(buf, buffer->get_data(), buffer->get_data_len());
+        flow::skb_copy_data(buffer, buf, data_len);
         read_queue.pop();
-        return buffer->get_data_len();
+        return data_len;
     }
     return size;
 }
@@ -63,19 +66,21 @@ size_t sock::readfrom(char* buf, size_t size, struct sockaddr* addr, socklen_t*
     // get buffer
     auto buffer = read_queue.front();
     auto remote_addr = reinterpret_cast<struct sockaddr_in*>(addr);
-    remote_addr->sin_addr.s_addr = htonl(buffer->key->remote_ip);
-    remote_addr->sin_port = htons(buffer->key->remote_port);
+    // flow is filled by udp unpack
+    remote_addr->sin_addr.s_addr = htonl(buffer->ext->flow.remote_ip);
+    remote_addr->sin_port = htons(buffer->ext->flow.remote_port);
     *len = sizeof(struct sockaddr_in);
-    if (buffer->get_data_len() > size) {
-        // copy data to bufer
-        memcpy(buf, buffer->get_data(), size);
-        skb_pull(buffer, size);
+    auto data_len = flow::skb_len(buffer);
+    if (data_len > size) {
+        // copy data to bufer, payload segments included
+        flow::skb_copy_data(buffer, buf, size);
+        flow::skb_consume(buffer, size);
         return size;
     } else {
         // read all data and pop this buffer
-        memcpy(buf, buffer->get_data(), buffer->get_data_len());
+        flow::skb_copy_data(buffer, buf, data_len);
         read_queue.pop();
-        return buffer->get_data_len();
+        return data_len;
     }
     return size;
 }
@@ -89,6 +94,7 @@ flow::sk_buff::ptr sock::read_buffer_from_queue() {
         return nullptr;
     auto buffer = write_queue.front();
     write_queue.pop();
+    flow::skb_set_owner(buffer, def::skb_owner::stack);
     return buffer;
 }
 
@@ -109,13 +115,17 @@ size_t sock::writeto(char* buf, size_t size, struct sockaddr* addr, socklen_t le
         ntohl(remote_addr->sin_addr.s_addr), ntohs(remote_addr->sin_port), key->protocol));
     // alloc buffer size
     flow::sk_buff::ptr buffer = flow::sk_buff::alloc(offset_size + size);
-    buffer->key = send_key;
-    buffer->protocol = uint16_t(buffer->key->protocol);
+    auto ext = buffer != nullptr ? buffer->get_ext() : nullptr;
+    if (ext == nullptr)
+        return 0;
+    ext->key = send_key;
+    buffer->protocol = uint16_t(send_key->protocol);
     buffer->mtu = 1500;
     skb_reserve(buffer, offset_size);
-    // copy to buffer
-    buffer->store_data(buf, size);
+    // copy to buffer, payload is summed in the same pass
+    buffer->store_data_checksum(buf, size);
     flow::skb_put(buffer, size);
+    flow::skb_set_owner(buffer, def::skb_owner::sock_write);
     write_queue.push(buffer);
     write_cond.notify_one();
     return size;
@@ -133,25 +143,47 @@ size_t sock::write(char* buf, size_t size) {
     } 
     // alloc buffer size
     flow::sk_buff::ptr buffer = flow::sk_buff::alloc(offset_size + size);
+    auto ext = buffer != nullptr ? buffer->get_ext() : nullptr;
+    if (ext == nullptr)
+        return 0;
     skb_reserve(buffer, offset_size);
-    // copy to buffer
-    buffer->store_data(buf, size);
-    buffer->key = key;
-    buffer->protocol = uint16_t(buffer->key->protocol);
+    // copy to buffer, payload is summed in the same pass
+    buffer->store_data_checksum(buf, size);
+    ext->key = key;
+    buffer->protocol = uint16_t(key->protocol);
     buffer->mtu = 1500;
     flow::skb_put(buffer, size);
+    flow::skb_set_owner(buffer, def::skb_owner::sock_write);
     write_queue.push(buffer);
     write_cond.notify_one();
     return size;
 }
 
 // write buffer to queue
-void sock::write_buffer_to_queue(flow::sk_buff::ptr buffer) {
+void sock::write_buffer_to_queue(const flow::sk_buff::ptr& buffer) {
+    // user thread hold reference from now on
+    flow::skb_set_shared(buffer);
+    flow::skb_set_owner(buffer, def::skb_owner::sock_read);
     std::unique_lock<std::mutex> lock(read_mutex);
     read_queue.push(buffer);
     read_cond.notify_one();
 }
 
+// write buffer batch to queue
+void sock::write_batch_to_queue(flow::skb_batch& batch) {
+    if (batch.empty())
+        return;
+    // user thread hold reference from now on
+    for (auto& buffer : batch) {
+        flow::skb_set_shared(buffer);
+        flow::skb_set_owner(buffer, def::skb_owner::sock_read);
+    }
+    std::unique_lock<std::mutex> lock(read_mutex);
+    for (auto& buffer : batch)
+        read_queue.push(buffer);
+    read_cond.notify_one();
+}
+
 // sock clone
 sock::ptr sock_clone(sock::ptr src_sock) {
     // create dst sock
@@ -172,7 +204,7 @@ sock_table::ptr sock_table::create() {
 sock::ptr sock_table::sock_create(sock_key::ptr key) {
     auto elem = sock::ptr(new sock(key, weak_from_this()));
     std::lock_guard<std::shared_mutex> lock(sock_mutex_);
-    sock_map_.insert(std::make_pair(key, elem));
+    sock_map_.insert(std::make_pair(key->get_flow_key(), elem));
     std::cout << "create sock, local ip: " << key->local_ip << ", local port: " << key->local_port
         << ", protocol: " << uint16_t(key->protocol) << std::endl;
     return elem;
@@ -181,12 +213,17 @@ sock::ptr sock_table::sock_create(sock_key::ptr key) {
 // store sock
 sock_key::ptr sock_table::sock_store(sock::ptr sock) {
     std::lock_guard<std::shared_mutex> lock(sock_mutex_);
-    sock_map_.insert(std::make_pair(sock->key, sock));
+    sock_map_.insert(std::make_pair(sock->key->get_flow_key(), sock));
     return sock->key;
 }
 
 // get key sock ptr
 sock::ptr sock_table::sock_get(sock_key::ptr key) {
+    return sock_get(key->get_flow_key());
+}
+
+// get sock by packed key
+sock::ptr sock_table::sock_get(const flow::flow_key& key) {
     std::shared_lock<std::shared_mutex> lock(sock_mutex_);
     auto elem = sock_map_.find(key);
     if (elem == sock_map_.end())
@@ -194,10 +231,21 @@ sock::ptr sock_table::sock_get(sock_key::ptr key) {
     return elem->second;
 }
 
+// get sock by local port
+std::vector<sock::ptr> sock_table::sock_get_by_port(uint16_t local_port) {
+    std::vector<sock::ptr> socks;
+    std::shared_lock<std::shared_mutex> lock(sock_mutex_);
+    for (auto& elem : sock_map_) {
+        if (elem.first.local_port == local_port)
+            socks.push_back(elem.second);
+    }
+    return socks;
+}
+
 // delete sock key
 void sock_table::sock_delete(sock_key::ptr key) {
     std::lock_guard<std::shared_mutex> lock(sock_mutex_);
-    sock_map_.erase(sock_map_.find(key));
+    sock_map_.erase(sock_map_.find(key->get_flow_key()));
 }
 
 flow::sk_buff::ptr sock_table::read_buffer() {
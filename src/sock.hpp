@@ -10,8 +10,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
-#include <queue>
 #include <unordered_map>
+#include <vector>
 #include <shared_mutex>
 
 #include <netinet/in.h>
@@ -41,6 +41,14 @@ struct sock_key : std::enable_shared_from_this<sock_key> {
     */
     sock_key() = delete;
 
+    /**
+    * @brief get packed key used by sock table
+    * @return flow key
+    */
+    flow::flow_key get_flow_key() const {
+        return flow::flow_key{ local_ip, remote_ip, local_port, uint16_t(remote_port), protocol };
+    }
+
     /// source ip
     uint32_t local_ip;
     /// source port
@@ -72,6 +80,15 @@ struct hash_sock_get_key {
         auto key = utils::generic::jhash_3words(sock->local_ip, sock->remote_ip, port);
         return key;
     }
+
+    /**
+    * @brief get jenkins hash key of packed key
+    * @param[in] key flow key
+    * @return hash result
+    */
+    size_t operator() (const flow::flow_key& key) const {
+        return flow::get_flow_hash(key.local_ip, key.local_port, key.remote_ip, key.remote_port);
+    }
 };
 
 /**
@@ -182,7 +199,13 @@ public:
     * @brief write data to sock
     * @param[in] buffer write buf
     */ 
-    virtual void write_buffer_to_queue(flow::sk_buff::ptr buffer);
+    virtual void write_buffer_to_queue(const flow::sk_buff::ptr& buffer);
+
+    /**
+    * @brief write buffers to read queue, lock is taken once
+    * @param[in] batch buffers
+    */
+    virtual void write_batch_to_queue(flow::skb_batch& batch);
 
     /**
     * @brief release sock
@@ -195,13 +218,13 @@ public:
     /// sock table
     std::weak_ptr<sock_table> table;
     /// write buffer queue
-    std::queue<flow::sk_buff::ptr> write_queue;
+    flow::skb_queue write_queue;
     /// write buffer condition
     std::condition_variable_any write_cond;
     /// write share lock 
     std::mutex write_mutex;
     /// read buffer queue
-    std::queue<flow::sk_buff::ptr> read_queue;
+    flow::skb_queue read_queue;
     /// read buffer condition
     std::condition_variable_any read_cond;
     /// read share lock
@@ -273,6 +296,20 @@ public:
     */
     sock::ptr sock_get(sock_key::ptr key);
 
+    /**
+    * @brief get sock by packed key, no alloc
+    * @param[in] key flow key
+    * @return sock 
+    */
+    sock::ptr sock_get(const flow::flow_key& key);
+
+    /**
+    * @brief get all sock bind to local port
+    * @param[in] local_port local port
+    * @return sock list
+    */
+    std::vector<sock::ptr> sock_get_by_port(uint16_t local_port);
+
     /**
     * @brief delete sock
     * @param[in] key sock key
@@ -296,7 +333,7 @@ private:
     /// sock mutex
     std::shared_mutex sock_mutex_;
     /// socket map to get socket
-    std::unordered_map<sock_key::ptr, sock::ptr, hash_sock_get_key, hash_sock_equal_key> sock_map_;
+    std::unordered_map<flow::flow_key, sock::ptr, hash_sock_get_key> sock_map_;
 };
 
 /**
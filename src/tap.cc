@@ -1,18 +1,57 @@
 #include "tap.hpp"
 #include "def.hpp"
+#include "flow.hpp"
+#include "sock.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cerrno>
+#include <cstddef>
 #include <cstring>
 #include <iostream>
+#include <mutex>
+
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <linux/if_tun.h>
 
 namespace driver {
 
-tap_device::tap_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address)
-    : dev_name_(dev_name), ip_address_(ip_address), mac_address_(mac_address), status_(def::device_status::down) {
-    
+tap_device::tap_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address,
+    uint16_t mtu, uint16_t headroom, const tap_device_config& config)
+    : dev_name_(dev_name), if_index_(0), mtu_(mtu), headroom_(headroom), config_(config), vnet_hdr_size_(0),
+    gso_size_(0), status_(def::device_status::down) {
+    utils::generic::convert_string_to_mac(mac_address, mac_address_);
+    utils::generic::convert_string_to_ip(ip_address, &ip_address_);
+    // create tap device, virtio net header must be chosen on create
+    uint16_t flags = config_.vnet_hdr ? IFF_VNET_HDR : 0;
+    if (config_.queue_count > 1)
+        flags |= IFF_MULTI_QUEUE;
+    // each open attach one more queue to the same device
+    for (uint32_t index = 0; index < std::max<uint32_t>(config_.queue_count, 1); index++) {
+        auto fd = utils::device::create_kernel_device(dev_name_, "/dev/net/tun", def::device_type::tap, flags);
+        if (!fd.has_value()) {
+            std::cout << "create tap queue failed, queue: " << index << ", err: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        auto queue = std::unique_ptr<tap_queue>(new tap_queue());
+        queue->fd = fd.value();
+        queues_.push_back(std::move(queue));
+    }
+    if (queues_.empty())
+        return;
+    // get ifindex by device name
+    if_index_ = if_nametoindex(dev_name_.c_str());
+    if (if_index_ == 0) {
+        std::cout << "get tap ifindex failed, err: " << std::strerror(errno) << std::endl;
+    }
 }
 
 tap_device::~tap_device() {
@@ -20,69 +59,387 @@ tap_device::~tap_device() {
 }
 
 bool tap_device::up() {
-    // create tap device 
-    auto fd = utils::device::create_kernel_device(dev_name_, "/dev/net/tun", def::device_type::tap);
-    if (!fd.has_value()) {
-        std::cout << "create device failed, err: " << std::strerror(errno) << std::endl;
+    if (queues_.empty()) {
+        std::cout << "up tap device failed, device not created" << std::endl;
         return false;
     }
-    tap_fd_ = fd.value();
-    std::cout << "create device success" << std::endl;
+    for (auto& queue : queues_) {
+        if (config_.vnet_hdr && !setup_offload(queue->fd))
+            return false;
+        // read thread drain fd until empty, then poll
+        int flags = fcntl(queue->fd, F_GETFL);
+        if (flags < 0 || fcntl(queue->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            std::cout << "set tap device non block failed, err: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    // kernel may pass ip frame up to 65535 bytes plus ether header, larger than rx buffer can hold,
+    // ask it to segment such frame before pass to tap
+    if (gso_size_ && !utils::device::set_kernel_device_gso_max_size(dev_name_, get_max_rx_frame_size()).has_value())
+        std::cout << "set tap gso max size failed, super frame exceed rx buffer is dropped, err: " << std::strerror(errno) << std::endl;
     // set tap device up
     if (!utils::device::set_kernel_device_status(dev_name_, def::device_status::up).has_value()) {
-        std::cout << "set device up failed, err: " << std::strerror(errno) << std::endl;
+        std::cout << "set tap device up failed, err: " << std::strerror(errno) << std::endl;
         return false;
     }
-    std::cout << "set device up success" << std::endl;
-    return 0;
+    status_ = def::device_status::up;
+    std::cout << "up tap device success, device name: " << dev_name_ << ", ifindex: " << (int)if_index_
+        << ", mac: " << utils::generic::format_mac_address(mac_address_)
+        << ", ip: " << utils::generic::format_ip_address(ip_address_) << ", gso size: " << std::dec << gso_size_
+        << ", queues: " << queues_.size() << std::endl;
+    return true;
 }
 
 bool tap_device::down() {
-    if (tap_fd_ != 0)
-        close(tap_fd_); 
-    return 0;
+    for (auto& queue : queues_) {
+        if (queue->fd >= 0) {
+            close(queue->fd);
+            queue->fd = -1;
+        }
+    }
+    status_ = def::device_status::down;
+    return true;
 }
 
-int tap_device::read_from_device(void* buf, int len) {
+// set virtio net header and offload
+bool tap_device::setup_offload(int fd) {
+    int hdr_size = sizeof(flow::vnet_hdr);
+    if (ioctl(fd, TUNSETVNETHDRSZ, &hdr_size) < 0) {
+        std::cout << "set tap vnet header size failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    vnet_hdr_size_ = hdr_size;
+    // kernel may pass frame with checksum not filled, and super frame if tso is on
+    unsigned long offload = TUN_F_CSUM;
+    if (config_.tso)
+        offload |= TUN_F_TSO4;
+    if (ioctl(fd, TUNSETOFFLOAD, offload) < 0) {
+        std::cout << "set tap offload failed, stack sum and segment itself, err: " << std::strerror(errno) << std::endl;
+        return true;
+    }
+    if (config_.tso)
+        gso_size_ = def::max_gso_size;
+    return true;
+}
 
+// read buffer from device
+flow::sk_buff::ptr tap_device::read_from_device() {
+    auto& queue = *queues_.front();
+    std::unique_lock<std::mutex> lock(queue.read_mutex);
+    queue.read_cond.wait(lock, [&] { return !queue.read_head.empty(); });
+    // get buffer
+    auto buffer = std::move(queue.read_head.front());
+    queue.read_head.pop();
+    flow::skb_set_owner(buffer, def::skb_owner::stack);
+    return buffer;
+}
 
+// write buffer to device
+int tap_device::write_to_device(const flow::sk_buff::ptr& buffer) {
+    make_ether_header(buffer);
+    auto& queue = *queues_[select_tx_queue(buffer)];
+    std::unique_lock<std::mutex> lock(queue.write_mutex);
+    queue.write_head.push(buffer);
+    queue.write_cond.notify_one();
     return 0;
 }
 
-int tap_device::write_to_device(const void* buf, int len) {
-    return 0;
+// read buffer batch from device
+size_t tap_device::read_from_device(flow::skb_batch& batch) {
+    return read_from_queue(0, batch);
+}
+
+// read buffer batch from queue
+size_t tap_device::read_from_queue(uint32_t index, flow::skb_batch& batch) {
+    auto& queue = *queues_[index];
+    std::unique_lock<std::mutex> lock(queue.read_mutex);
+    queue.read_cond.wait(lock, [&] { return !queue.read_head.empty(); });
+    while (!queue.read_head.empty() && !batch.full()) {
+        flow::skb_set_owner(queue.read_head.front(), def::skb_owner::stack);
+        batch.push(std::move(queue.read_head.front()));
+        queue.read_head.pop();
+    }
+    return batch.size();
+}
+
+// write buffer batch to device
+int tap_device::write_to_device(flow::skb_batch& batch) {
+    uint32_t queue_index[def::max_skb_batch];
+    for (size_t index = 0; index < batch.size(); index++) {
+        make_ether_header(batch[index]);
+        queue_index[index] = select_tx_queue(batch[index]);
+    }
+    // each queue lock is taken once per batch
+    for (uint32_t index = 0; index < queues_.size(); index++) {
+        auto& queue = *queues_[index];
+        bool pushed = false;
+        {
+            std::lock_guard<std::mutex> lock(queue.write_mutex);
+            for (size_t elem = 0; elem < batch.size(); elem++) {
+                if (queue_index[elem] != index)
+                    continue;
+                queue.write_head.push(batch[elem]);
+                pushed = true;
+            }
+        }
+        if (pushed)
+            queue.write_cond.notify_one();
+    }
+    return batch.size();
+}
+
+// choose tx queue by flow hash
+uint32_t tap_device::select_tx_queue(const flow::sk_buff::ptr& buffer) {
+    if (queues_.size() == 1)
+        return 0;
+    // reply reuse rx hash, buffer from sock get hash from its key
+    uint32_t hash = buffer->hash;
+    if (hash == 0 && buffer->ext != nullptr && buffer->ext->key != nullptr) {
+        auto& key = buffer->ext->key;
+        hash = flow::get_flow_hash(key->local_ip, key->local_port, key->remote_ip, key->remote_port);
+    }
+    return hash % queues_.size();
+}
+
+// get tap device mac
+uint8_t* tap_device::get_device_mac() {
+    return mac_address_;
+}
+
+// get tap device ip
+uint32_t tap_device::get_device_ip() {
+    return ip_address_;
+}
+
+// get device index
+uint8_t tap_device::get_device_ifindex() {
+    return if_index_;
+}
+
+// get max super frame
+uint32_t tap_device::get_device_gso_size() {
+    return gso_size_;
+}
+
+// get queue count
+uint32_t tap_device::get_queue_count() {
+    return queues_.size();
 }
 
 void tap_device::read_thread() {
+    read_queue_thread(0);
+}
+
+void tap_device::write_thread() {
+    write_queue_thread(0);
+}
+
+// read frames from one queue
+void tap_device::read_queue_thread(uint32_t index) {
+    auto& queue = *queues_[index];
     // check if fd is valid
-    assert(tap_fd_ != 0);
-    char msg[218];
+    assert(queue.fd >= 0);
+    size_t frame_size = def::max_ether_header + mtu_;
+    // super frame may come at any time with tso, so read into largest buffer, kernel is capped to it on up
+    size_t rx_size = gso_size_ ? get_max_rx_frame_size() : frame_size;
+    flow::skb_batch batch;
+    flow::sk_buff::ptr skb;
+    flow::vnet_hdr vnet_hdr;
+    struct iovec iov[2];
+    struct pollfd poll_fd;
+    poll_fd.fd = queue.fd;
+    poll_fd.events = POLLIN;
     while (true) {
-        size_t size = read(tap_fd_, msg, 218);
-        if (size < 0) {
-            std::cout << "read tap buffer failed" << std::endl;
+        if (skb == nullptr) {
+            skb = alloc_rx_buffer(rx_size);
+            if (skb == nullptr) {
+                std::cout << "alloc tap rx buffer failed" << std::endl;
+                break;
+            }
+        }
+        // virtio net header is read before frame in the same call
+        iov[0].iov_base = &vnet_hdr;
+        iov[0].iov_len = vnet_hdr_size_;
+        iov[1].iov_base = skb->data + skb->data_begin;
+        iov[1].iov_len = rx_size;
+        ssize_t size = vnet_hdr_size_ ? readv(queue.fd, iov, 2) : readv(queue.fd, iov + 1, 1);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            flush_read_batch(queue, batch);
+            if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+                std::cout << "poll tap device failed, err: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        } else if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size < 0) {
+            std::cout << "read tap buffer failed, err: " << std::strerror(errno) << std::endl;
             break;
-        } else if (size == 0) {
-            std::cout << "read tap buffer end" << std::endl;
+        } else if (size_t(size) <= vnet_hdr_size_) {
+            continue;
+        }
+        size -= vnet_hdr_size_;
+        // kernel report full frame len even if it is cut to buffer
+        if (size_t(size) > rx_size) {
+            std::cout << "drop tap frame exceed buffer, size: " << std::dec << size << std::endl;
+            continue;
         }
-        std::cout << "read tap buffer success, buf: " << msg << std::endl;
+        flow::sk_buff::ptr frame;
+        if (rx_size > frame_size && size_t(size) <= frame_size) {
+            // copy small frame out, so large buffer is not held by ack or arp
+            frame = alloc_rx_buffer(frame_size);
+            if (frame == nullptr) {
+                std::cout << "alloc tap rx buffer failed" << std::endl;
+                break;
+            }
+            memcpy(frame->data + frame->data_begin, skb->data + skb->data_begin, size);
+        } else {
+            frame = std::move(skb);
+            skb = nullptr;
+        }
+        if (!accept_rx_frame(frame, size))
+            continue;
+        if (vnet_hdr_size_)
+            frame->ip_summed = get_checksum_state(vnet_hdr);
+        batch.push(std::move(frame));
+        if (batch.full())
+            flush_read_batch(queue, batch);
     }
 }
 
-void tap_device::write_thread() {
-    // check if fd is valid
-    assert(tap_fd_ != 0);
-    char buf[512] = "Hello tap";
+// get largest frame rx buffer hold
+size_t tap_device::get_max_rx_frame_size() {
+    return def::flow_buffer_size - headroom_;
+}
+
+// alloc rx buffer
+flow::sk_buff::ptr tap_device::alloc_rx_buffer(size_t size) {
+    flow::sk_buff::ptr skb = flow::sk_buff::alloc(headroom_ + size);
+    if (skb == nullptr)
+        return nullptr;
+    flow::skb_reserve(skb, headroom_);
+    return skb;
+}
+
+// filter frame and fill buffer info
+bool tap_device::accept_rx_frame(const flow::sk_buff::ptr& skb, size_t size) {
+    // get ether mac
+    const flow::ether_hdr* hdr = reinterpret_cast<const flow::ether_hdr*>(skb->data + skb->data_begin);
+    // kernel side send multicast too, like ipv6 discovery
+    if (memcmp(mac_address_, hdr->dst, def::mac_len) != 0 &&
+        memcmp(def::broadcast_mac, hdr->dst, def::mac_len) != 0)
+        return false;
+    flow::skb_rx_init(skb, if_index_, size);
+    return true;
+}
+
+// get checksum state reported by kernel
+uint8_t tap_device::get_checksum_state(const flow::vnet_hdr& hdr) {
+    // frame with checksum not filled come from local host, it never cross wire
+    if (hdr.flags & (uint8_t(def::vnet_hdr_flag::data_valid) | uint8_t(def::vnet_hdr_flag::needs_csum)))
+        return uint8_t(def::checksum_state::unnecessary);
+    return uint8_t(def::checksum_state::none);
+}
+
+// move rx batch to read queue
+void tap_device::flush_read_batch(tap_queue& queue, flow::skb_batch& batch) {
+    if (batch.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(queue.read_mutex);
+        for (auto& buffer : batch)
+            queue.read_head.push(std::move(buffer));
+    }
+    queue.read_cond.notify_one();
+    batch.clear();
+}
+
+// write buffer to one queue
+void tap_device::write_queue_thread(uint32_t index) {
+    auto& queue = *queues_[index];
+    std::vector<flow::sk_buff::ptr> buffers;
+    buffers.reserve(def::max_skb_batch);
     while (true) {
-        size_t size = write(tap_fd_, buf, 512);
-        if (size < 0) {
-            std::cout << "write tap buffer failed" << std::endl;
-            break;
-        } else if (size == 0) {
-            std::cout << "write tap buffer end" << std::endl;
-        } 
-        std::cout << "write tap buffer, buf: " << std::endl;
+        {
+            // take up to one batch per lock
+            std::unique_lock<std::mutex> lock(queue.write_mutex);
+            queue.write_cond.wait(lock, [&] () { return !queue.write_head.empty(); });
+            while (!queue.write_head.empty() && buffers.size() < def::max_skb_batch) {
+                buffers.push_back(std::move(queue.write_head.front()));
+                queue.write_head.pop();
+            }
+        }
+        for (auto& buffer : buffers) {
+            if (!send_buffer(queue.fd, buffer))
+                return;
+        }
+        for (auto& buffer : buffers)
+            flow::skb_tx_done(buffer);
+        // kernel has copied frames, buffers go back to pool here
+        buffers.clear();
+    }
+}
+
+// send one buffer
+bool tap_device::send_buffer(int fd, const flow::sk_buff::ptr& buffer) {
+    flow::vnet_hdr vnet_hdr;
+    // gather virtio net header, linear data and payload segments
+    struct iovec iov[def::max_skb_frags + 2];
+    size_t iov_count = 0;
+    if (vnet_hdr_size_) {
+        make_vnet_header(buffer, vnet_hdr);
+        iov[iov_count].iov_base = &vnet_hdr;
+        iov[iov_count++].iov_len = vnet_hdr_size_;
+    }
+    size_t frame_count = flow::skb_fill_iovec(buffer, iov + iov_count);
+    if (frame_count == 0) {
+        // kernel would segment and sum frame without its tail
+        std::cout << "drop tap frame, too many segments: " << std::dec << buffer->ext->frags.size() << std::endl;
+        return true;
     }
+    iov_count += frame_count;
+    // write buffer to device
+    ssize_t size = writev(fd, iov, iov_count);
+    if (size < 0 && (errno == EAGAIN || errno == EINVAL || errno == EMSGSIZE)) {
+        // kernel reject this frame only, device is still fine
+        std::cout << "drop tap frame, err: " << std::strerror(errno) << std::endl;
+    } else if (size < 0) {
+        std::cout << "write tap buffer failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
 }
 
-}
\ No newline at end of file
+// make virtio net header
+void tap_device::make_vnet_header(const flow::sk_buff::ptr& buffer, flow::vnet_hdr& hdr) {
+    memset(&hdr, 0, sizeof(hdr));
+    // frame fit in mtu is summed by stack already
+    if (flow::skb_gso_size(buffer) == 0)
+        return;
+    auto ip_hdr = reinterpret_cast<const flow::ip_hdr*>(buffer->get_data() + flow::get_ether_offset());
+    size_t ip_len = (ip_hdr->version_and_head_len & 0b00001111) * def::ip_len;
+    auto tcp_hdr = reinterpret_cast<const flow::tcp_hdr*>(reinterpret_cast<const char*>(ip_hdr) + ip_len);
+    // kernel cut payload by gso size, then sum each segment from csum start
+    hdr.flags = uint8_t(def::vnet_hdr_flag::needs_csum);
+    hdr.gso_type = uint8_t(def::vnet_gso_type::tcpv4);
+    hdr.gso_size = flow::skb_gso_size(buffer);
+    hdr.csum_start = flow::get_ether_offset() + ip_len;
+    hdr.csum_offset = offsetof(struct flow::tcp_hdr, tcp_checksum);
+    hdr.hdr_len = hdr.csum_start + tcp_hdr->header_len * 4;
+}
+
+// make ether header
+void tap_device::make_ether_header(const flow::sk_buff::ptr& buffer) {
+    // push to ether header
+    flow::skb_push(buffer, sizeof(struct flow::ether_hdr));
+    // create ether header
+    struct flow::ether_hdr* ether_hdr = reinterpret_cast<struct flow::ether_hdr*>(buffer->get_data());
+    ether_hdr->protocol = htons(buffer->protocol);
+    memcpy(ether_hdr->src, mac_address_, def::mac_len);
+    memcpy(ether_hdr->dst, std::get<std::array<uint8_t, def::mac_len>>(buffer->dst).data(), def::mac_len);
+    // write thread hold reference from now on
+    flow::skb_set_shared(buffer);
+    flow::skb_set_owner(buffer, def::skb_owner::device_tx);
+}
+
+}
@@ -2,32 +2,77 @@
 #define __TAP_H__
 
 #include "def.hpp"
+#include "flow.hpp"
+#include "interface.hpp"
 
-#include <any>
 #include <condition_variable>
-#include <list>
-#include <shared_mutex>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <thread>
 #include <vector>
 
 namespace driver {
 
+/**
+ * @file tap.hpp
+ * @brief tap device offload config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct tap_device_config {
+    /// exchange virtio net header with kernel, offload need it
+    bool vnet_hdr = true;
+    /// kernel pass gro and tso super frame to stack, and segment super frame from stack
+    bool tso = true;
+    /// queue count, kernel spread flows over queues by hash if more than one
+    uint32_t queue_count = 1;
+};
+
+/**
+ * @file tap.hpp
+ * @brief one queue of tap device, it has own fd, reader and writer
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct tap_queue {
+    /// queue fd
+    int fd = -1;
+    /// read buffer head
+    flow::skb_queue read_head;
+    /// read share mutex
+    std::mutex read_mutex;
+    /// read share condition
+    std::condition_variable read_cond;
+    /// write buffer head
+    flow::skb_queue write_head;
+    /// write share mutex
+    std::mutex write_mutex;
+    /// write share condition
+    std::condition_variable write_cond;
+};
+
 /**
  * @file tap.hpp
  * @brief read and write skbuf to tap device
  * @author ArisAachen
  * @copyright Copyright (c) 2024 aris All rights reserved
  */
-class tap_device: public std::enable_shared_from_this<tap_device> {
+class tap_device: public interface::net_device, public std::enable_shared_from_this<tap_device> {
 public:
     typedef std::shared_ptr<tap_device> ptr;
 
     /**
-     * @brief Construct a new tap device object
+     * @brief Construct a new tap device object, kernel device is created here so ifindex is known when registered
      * @param[in] dev_name tap device name
+     * @param[in] ip_address stack ip
+     * @param[in] mac_address stack mac
+     * @param[in] mtu device mtu, rx buffer without offload is sized by it
+     * @param[in] headroom headroom reserved before ether header of rx buffer
+     * @param[in] config offload config
      */
-    tap_device(const std::string& dev_name, const std::string& ip_address = "", const std::string& mac_address = "");
+    tap_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address,
+        uint16_t mtu = def::default_mtu, uint16_t headroom = def::skb_rx_headroom, const tap_device_config& config = {});
 
     /**
      * @brief Destroy the tap device object
@@ -35,84 +80,209 @@ public:
     virtual ~tap_device();
 
     /**
-     * @brief up tap device
-     * @return 0 success, -1 fail
+     * @brief set offload and up tap device
+     * @return true if success
      */
-    bool up();
+    virtual bool up();
 
     /**
      * @brief down tap device
-     * @return 0 success, -1 fail
+     * @return true if success
+     */
+    virtual bool down();
+
+    /**
+     * @brief read from first queue of tap device
+     * @return read buffer
      */
-    bool down();
+    virtual flow::sk_buff::ptr read_from_device();
 
     /**
-     * @brief read from tap device
-     * @param[out] buf read buffer
-     * @param[in] len read buffer length
-     * @return read buffer length
+     * @brief write to tap device, queue is chosen by flow hash
+     * @param[in] buffer write buffer
+     * @return 0 success
      */
-    int read_from_device(void* buf, int len);
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
 
     /**
-     * @brief write to tap device
-     * @param[in] buf write buffer
-     * @param[in] len write buffer length
-     * @return write buffer length
+     * @brief read buffers from first queue of tap device, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
      */
-    int write_to_device(const void* buf, int len);
+    virtual size_t read_from_device(flow::skb_batch& batch);
 
+    /**
+     * @brief read buffers from one queue, block until one buffer is ready
+     * @param[in] queue queue index
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_queue(uint32_t queue, flow::skb_batch& batch);
+
+    /**
+     * @brief write buffers to tap device, each queue lock is taken once
+     * @param[in] batch write buffers
+     * @return write buffer count
+     */
+    virtual int write_to_device(flow::skb_batch& batch);
+
+    /**
+     * @brief get net_device mac
+     * @return device mac
+     */
+    virtual uint8_t* get_device_mac();
+
+    /**
+     * @brief get net_device ip
+     * @return device ip
+     */
+    virtual uint32_t get_device_ip();
+
+    /**
+     * @brief get net_device ifindex
+     * @return device ifindex
+     */
+    virtual uint8_t get_device_ifindex();
+
+    /**
+     * @brief get max super frame kernel segment for stack
+     * @return max frame size, 0 if tso is not enabled
+     */
+    virtual uint32_t get_device_gso_size();
+
+    /**
+     * @brief get queue count
+     * @return queue count
+     */
+    virtual uint32_t get_queue_count();
 
 public:
     /**
-     * @brief read from tap device
-     * @param[in] buf tap device 
+     * @brief read frames from first queue of tap device
      */
-    void read_thread();
+    virtual void read_thread();
 
     /**
-     * @brief write to tap device
-     * @param[in] buf tap device 
+     * @brief write frames to first queue of tap device
      */
-    void write_thread();
+    virtual void write_thread();
+
+    /**
+     * @brief read frames from one queue
+     * @param[in] queue queue index
+     */
+    virtual void read_queue_thread(uint32_t queue);
+
+    /**
+     * @brief write frames to one queue
+     * @param[in] queue queue index
+     */
+    virtual void write_queue_thread(uint32_t queue);
 
     /**
      * @brief get tap device status from kernel status
      * @return bool tap device status
      */
-    bool kernel_device_status();
+    virtual bool kernel_device_status() { return false; };
 
     /**
      * @brief get tap device status from user status
      * @return bool tap device status
      */
-    bool user_device_status();
+    virtual bool user_device_status() { return false; };
+
+private:
+    /**
+     * @brief set virtio net header size and offload of queue
+     * @param[in] fd queue fd
+     * @return false if kernel has no virtio net header
+     */
+    bool setup_offload(int fd);
+
+    /**
+     * @brief choose tx queue, one flow always use one queue so kernel steer its rx to the same queue
+     * @param[in] buffer buffer
+     * @return queue index
+     */
+    uint32_t select_tx_queue(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief get largest frame rx buffer hold, sk buff offsets are 16 bits so headroom is taken from it
+     * @return frame size, include ether header
+     */
+    size_t get_max_rx_frame_size();
+
+    /**
+     * @brief alloc rx buffer, headroom is reserved
+     * @param[in] size frame room
+     * @return rx buffer, nullptr if pool exhausted
+     */
+    flow::sk_buff::ptr alloc_rx_buffer(size_t size);
+
+    /**
+     * @brief filter received frame by dst mac and fill buffer info
+     * @param[in] skb rx buffer, frame is stored at data begin
+     * @param[in] size frame size
+     * @return false if frame is not for this device
+     */
+    bool accept_rx_frame(const flow::sk_buff::ptr& skb, size_t size);
+
+    /**
+     * @brief get checksum state from virtio net header
+     * @param[in] hdr header read before frame
+     * @return checksum state of buffer
+     */
+    uint8_t get_checksum_state(const flow::vnet_hdr& hdr);
+
+    /**
+     * @brief fill virtio net header, super frame ask kernel to segment and sum it
+     * @param[in] buffer buffer, start at ether header
+     * @param[out] hdr header written before frame
+     */
+    void make_vnet_header(const flow::sk_buff::ptr& buffer, flow::vnet_hdr& hdr);
+
+    /**
+     * @brief move rx batch to read queue
+     * @param[in] queue queue
+     * @param[in] batch rx buffers
+     */
+    void flush_read_batch(tap_queue& queue, flow::skb_batch& batch);
+
+    /**
+     * @brief send one buffer to device
+     * @param[in] fd queue fd
+     * @param[in] buffer buffer
+     * @return false if device broken
+     */
+    bool send_buffer(int fd, const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief push ether header before buffer is queued
+     * @param[in] buffer buffer
+     */
+    void make_ether_header(const flow::sk_buff::ptr& buffer);
 
 private:
     /// device name
     std::string dev_name_;
-    /// device address
-    std::string ip_address_;
-    /// device mac 
-    std::string mac_address_;
-    /// thread to read and write 
-    std::vector<std::thread> thread_vec_;
-    /// tap device fd
-    uint8_t tap_fd_;
+    /// stack address
+    uint32_t ip_address_;
+    /// stack mac
+    uint8_t mac_address_[def::mac_len];
+    /// device index
+    uint8_t if_index_;
     /// tap device mtu
     uint16_t mtu_;
-    /// read buffer
-    std::list<std::any> read_buf_;
-    /// read share mutex
-    std::shared_mutex read_mutex_;
-    /// read share condition
-    std::condition_variable read_cond_;
-    /// write buffer
-    std::list<std::any> write_buf_;
-    /// write share mutex
-    std::shared_mutex write_mutex_;
-    /// write share condition
-    std::condition_variable write_cond_;
+    /// rx buffer headroom
+    uint16_t headroom_;
+    /// offload config
+    tap_device_config config_;
+    /// virtio net header size, 0 if not enabled
+    size_t vnet_hdr_size_;
+    /// max super frame, 0 if tso not enabled
+    uint32_t gso_size_;
+    /// device queues, at least one
+    std::vector<std::unique_ptr<tap_queue>> queues_;
     /// device status
     def::device_status status_;
 };
@@ -120,4 +290,4 @@ private:
 
 }
 
-#endif // __TAP_H__
\ No newline at end of file
+#endif // __TAP_H__
@@ -11,11 +11,32 @@
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+namespace {
+
+/**
+ * @brief get payload size of one frame written to device, super frame if device segment itself
+ * @param[in] stack stack
+ * @param[in] ifindex device index of buffer
+ * @param[in] mtu buffer mtu
+ * @return payload size, multiple of mss
+ */
+size_t get_segment_size(const interface::stack::weak_ptr& stack, uint8_t ifindex, uint16_t mtu) {
+    size_t mss = mtu - sizeof(struct flow::ip_hdr) - sizeof(struct flow::tcp_hdr);
+    auto dev = stack.expired() ? nullptr : stack.lock()->get_tx_device(ifindex);
+    size_t gso_size = dev != nullptr ? dev->get_device_gso_size() : 0;
+    if (gso_size <= mtu)
+        return mss;
+    return (gso_size - sizeof(struct flow::ip_hdr) - sizeof(struct flow::tcp_hdr)) / mss * mss;
+}
+
+}
+
 namespace protocol {
 
 
@@ -33,61 +54,144 @@ def::transport_protocol tcp::get_protocol() {
     return def::transport_protocol::tcp;
 }
 
-bool tcp::pack_flow(flow::sk_buff::ptr buffer) {
+bool tcp::pack_flow(const flow::sk_buff::ptr& buffer) {
+    // buffer without key is not from sock
+    if (buffer->ext == nullptr)
+        return false;
     // get sock
-    auto sock = established_sock_table_->sock_get(buffer->key);
+    auto key = buffer->ext->key;
+    auto sock = established_sock_table_->sock_get(key);
     auto tcp_sock = std::dynamic_pointer_cast<flow_table::tcp_sock>(sock);
     if (tcp_sock == nullptr)
         return false;
     // set buffer src and dst
-    buffer->src = buffer->key->local_ip;
-    buffer->dst = buffer->key->remote_ip;
-    auto buf_len = buffer->get_data_len();
+    buffer->src = key->local_ip;
+    buffer->dst = key->remote_ip;
+    auto buf_len = flow::skb_len(buffer);
+    auto sequence_number = tcp_sock->sequence_number_;
+    // keep payload until acked, clone share it with buffer
+    flow::sk_buff::ptr clone;
+    if (buf_len > 0)
+        clone = flow::skb_clone(buffer);
+    if (!tcp_segment_flow(buffer, key, sequence_number, tcp_sock->ack_number_, tcp_sock->pseudo_sum_))
+        return false;
+    if (clone != nullptr)
+        tcp_sock->retransmit_push(sequence_number, clone);
+    // set sequence number
+    tcp_sock->sequence_number_ += buf_len;
+    return true;
+}
+
+// resend unacked payload
+bool tcp::retransmit(flow_table::sock_key::ptr key) {
+    auto sock = established_sock_table_->sock_get(key);
+    auto tcp_sock = std::dynamic_pointer_cast<flow_table::tcp_sock>(sock);
+    if (tcp_sock == nullptr || stack_.expired())
+        return false;
+    auto stack = stack_.lock();
+    for (auto& elem : tcp_sock->retransmit_get()) {
+        // headers are pushed to clone headroom, queued payload is untouched
+        auto buffer = flow::skb_clone(elem.second);
+        if (buffer == nullptr || !tcp_segment_flow(buffer, key, elem.first, tcp_sock->ack_number_, tcp_sock->pseudo_sum_))
+            return false;
+        stack->write_network_package(buffer);
+    }
+    return true;
+}
+
+// split payload by mss and make tcp flow
+bool tcp::tcp_segment_flow(const flow::sk_buff::ptr& buffer, const flow_table::sock_key::ptr& key, 
+    uint32_t sequence_number, uint32_t ack_number, uint32_t pseudo_sum) {
+    size_t buf_len = flow::skb_len(buffer);
+    size_t mss = buffer->mtu - sizeof(struct flow::ip_hdr) - sizeof(struct flow::tcp_hdr);
+    // device cut super frame by mss itself, stack only split by max super frame
+    size_t seg_size = buffer->mtu ? get_segment_size(stack_, buffer->dev_index, buffer->mtu) : mss;
+    if (!flow::skb_set_gso_size(buffer, seg_size > mss && buf_len > mss ? mss : 0))
+        return false;
+    if (buffer->mtu && buf_len > seg_size) {
+        // segments refer to this buffer data
+        std::vector<flow::sk_buff::ptr> segments;
+        for (size_t offset = seg_size; offset < buf_len; offset += seg_size) {
+            auto seg_len = std::min(seg_size, buf_len - offset);
+            auto alloc_size = flow::get_max_tcp_data_offset();
+            auto segment = flow::sk_buff::alloc(alloc_size);
+            if (segment == nullptr)
+                return false;
+            segment->data_len = alloc_size;
+            flow::skb_reserve(segment, alloc_size);
+            if (!flow::skb_header_clone(buffer, segment) || !flow::skb_add_frag_range(segment, buffer, offset, seg_len)
+                || !flow::skb_set_gso_size(segment, seg_len > mss ? mss : 0))
+                return false;
+            tcp_make_flow(segment, key, sequence_number + offset, ack_number, pseudo_sum);
+            segments.push_back(std::move(segment));
+        }
+        // first segment stay in buffer
+        auto ext = buffer->get_ext();
+        if (ext == nullptr)
+            return false;
+        flow::skb_trim(buffer, seg_size);
+        ext->child_frags = std::move(segments);
+    }
+    tcp_make_flow(buffer, key, sequence_number, ack_number, pseudo_sum);
+    return true;
+}
+
+// make tcp flow
+void tcp::tcp_make_flow(const flow::sk_buff::ptr& buffer, const flow_table::sock_key::ptr& key, 
+    uint32_t sequence_number, uint32_t ack_number, uint32_t pseudo_sum) {
     // get tcp header 
     flow::skb_push(buffer, sizeof(struct flow::tcp_hdr));
     auto hdr = reinterpret_cast<flow::tcp_hdr*>(buffer->get_data());
-    hdr->ack_number = htonl(tcp_sock->ack_number_);
-    hdr->sequence_number = htonl(tcp_sock->sequence_number_);
-    hdr->src_port = ntohs(tcp_sock->key->local_port);
-    hdr->dst_port = ntohs(tcp_sock->key->remote_port);
+    // pool buffer is not zeroed
+    flow::skb_reset(buffer, sizeof(struct flow::tcp_hdr));
+    hdr->ack_number = htonl(ack_number);
+    hdr->sequence_number = htonl(sequence_number);
+    hdr->src_port = ntohs(key->local_port);
+    hdr->dst_port = ntohs(key->remote_port);
     hdr->header_len = 0x5;
     hdr->window_size = htons(def::checksum_max_num);
     hdr->ack = 0b1;
     hdr->tcp_checksum = 0;
-    auto data_len = buffer->get_data_len();
-    // add fake udp header
-    flow::skb_push(buffer, sizeof(struct flow::transport_fake_hdr));
-    auto fake_hdr = reinterpret_cast<flow::transport_fake_hdr*>(buffer->get_data());
-    fake_hdr->src_ip = htonl(buffer->key->local_ip);
-    fake_hdr->dst_ip = htonl(buffer->key->remote_ip);
-    fake_hdr->reserve = 0;
-    fake_hdr->protocol = uint8_t(def::transport_protocol::tcp);
-    fake_hdr->total_len = htons(data_len);
-    // get checksum 
-    hdr->tcp_checksum = htons(flow::compute_checksum(buffer));
-    // drop fake header
-    flow::skb_pull(buffer, sizeof(struct flow::transport_fake_hdr));
-    // set sequence number
-    tcp_sock->sequence_number_ += buf_len;
-    return true;
+    // device sum each segment of super frame, payload is not read here
+    if (flow::skb_gso_size(buffer)) {
+        hdr->tcp_checksum = htons(flow::compute_offload_checksum(buffer, pseudo_sum));
+        return;
+    }
+    // get checksum, payload segments included, payload sum is reused if computed on copy
+    hdr->tcp_checksum = htons(flow::compute_transport_checksum(buffer, sizeof(struct flow::tcp_hdr), pseudo_sum));
+}
+
+// unpack flow batch
+void tcp::unpack_batch(flow::skb_batch& batch) {
+    batch.filter([this] (flow::sk_buff::ptr& buffer) { return tcp::unpack_flow(buffer); });
 }
 
-bool tcp::unpack_flow(flow::sk_buff::ptr buffer) {
+bool tcp::unpack_flow(const flow::sk_buff::ptr& buffer) {
     auto hdr = reinterpret_cast<flow::tcp_hdr*>(buffer->get_data());
+    if (hdr == nullptr)
+        return false;
     auto local_ip = std::get<uint32_t>(buffer->dst);
-    uint16_t local_port = ntohs(hdr->dst_port);
     auto remote_ip = std::get<uint32_t>(buffer->src);
+    if (!flow::verify_transport_checksum(buffer, flow::checksum_pseudo(remote_ip, local_ip, def::transport_protocol::tcp))) {
+        checksum_drops_.fetch_add(1, std::memory_order_relaxed);
+        std::cout << "drop tcp msg, checksum failed" << std::endl;
+        return false;
+    }
+    uint16_t local_port = ntohs(hdr->dst_port);
     uint16_t remote_port = ntohs(hdr->src_port);
+    buffer->hash = flow::get_flow_hash(local_ip, local_port, remote_ip, remote_port);
     std::cout << "rcv tcp message, " << std::dec << remote_port 
         << " -> " << local_port << std::endl;
-    // try to get established table first
-    auto established_key = flow_table::sock_key::ptr(new flow_table::sock_key(local_ip, 
-        local_port, remote_ip, remote_port, def::transport_protocol::tcp));
+    // try to get established table first, keys are packed on stack
+    auto ext = buffer->get_ext();
+    if (ext == nullptr)
+        return false;
+    auto& established_key = ext->flow;
+    established_key = flow::flow_key{ local_ip, remote_ip, local_port, remote_port, def::transport_protocol::tcp };
     auto sock = established_sock_table_->sock_get(established_key);
     if (sock == nullptr) {
         // try to get listen key
-        auto listen_key = flow_table::sock_key::ptr(new flow_table::sock_key(0, 
-            local_port, 0, 0, def::transport_protocol::tcp));
+        flow::flow_key listen_key{ 0, 0, local_port, 0, def::transport_protocol::tcp };
         // get listen sock
         sock = listen_sock_table_->sock_get(listen_key);
     }
@@ -102,15 +206,15 @@ bool tcp::unpack_flow(flow::sk_buff::ptr buffer) {
     return false;
 }
 
-bool tcp::write_buffer_to_sock(flow::sk_buff::ptr buffer) {
+bool tcp::write_buffer_to_sock(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
-bool tcp::tcp_rcv(flow::sk_buff::ptr buffer) {
+bool tcp::tcp_rcv(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
-bool tcp::tcp_send(flow::sk_buff::ptr buffer) {
+bool tcp::tcp_send(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
@@ -214,59 +318,47 @@ tcp_sock::tcp_sock(sock_key::ptr key, sock_table::weak_ptr table, interface::sta
     type_ = type;
     stack_ = stack;
     state_ = def::tcp_connection_state::none;
+    pseudo_sum_ = flow::checksum_pseudo(key->local_ip, key->remote_ip, def::transport_protocol::tcp);
 }
 
-void tcp_sock::handle_connection(flow::sk_buff::ptr buffer) {
+void tcp_sock::handle_connection(const flow::sk_buff::ptr& buffer) {
     // get tcp header
     auto req_hdr = reinterpret_cast<struct flow::tcp_hdr*>(buffer->get_data());
-    auto buf_len = buffer->get_data_len() - req_hdr->header_len * 4;
+    auto buf_len = flow::skb_len(buffer) - req_hdr->header_len * 4;
     // create info 
     auto local_ip = std::get<uint32_t>(buffer->dst);
     auto remote_ip = std::get<uint32_t>(buffer->src);
     auto local_port = ntohs(req_hdr->dst_port);
     auto remote_port = ntohs(req_hdr->src_port);
-    auto dst_key = sock_key::ptr(new sock_key(local_ip, local_port, remote_ip, remote_port, def::transport_protocol::tcp));
-    // create dst sock
-    auto dst_sock = tcp_sock::create(dst_key, this->table, stack_, tcp_sock_type::established);
+    // request header may be overwritten by in place response
+    auto req_sequence_number = ntohl(req_hdr->sequence_number);
+    auto req_ack_number = ntohl(req_hdr->ack_number);
+    auto req_syn = req_hdr->syn;
+    flow::flow_key dst_key{ local_ip, remote_ip, local_port, remote_port, def::transport_protocol::tcp };
     // check syn 
     if (req_hdr->syn && !req_hdr->ack) {
         // check if sock is in listen
         if (type_ != tcp_sock_type::listen || state_ != def::tcp_connection_state::listen)
             return;
+        // only new connection create dst sock
+        auto dst_sock = tcp_sock::create(sock_key::ptr(new sock_key(local_ip, local_port, remote_ip, remote_port, 
+            def::transport_protocol::tcp)), this->table, stack_, tcp_sock_type::established);
         std::cout << "tcp rcv syn: " << remote_port << " -> " << local_port << std::endl;
-        // create response header
-        auto alloc_size = sizeof(struct flow::tcp_hdr) + sizeof(struct flow::ip_hdr) + def::max_ether_header;
-        flow::sk_buff::ptr resp_buffer = flow::sk_buff::alloc(alloc_size);
-        resp_buffer->protocol = uint16_t(def::transport_protocol::tcp);
-        resp_buffer->data_len = alloc_size;
-        resp_buffer->src = buffer->dst;
-        resp_buffer->dst = buffer->src;
-        // append to tcp header
-        flow::skb_reserve(resp_buffer, alloc_size);
-        flow::skb_push(resp_buffer, sizeof(struct flow::tcp_hdr));
+        // syn carry no payload, response is built in place
+        auto resp_buffer = alloc_response_buffer(buffer, true);
         // get response tcp header
         auto resp_hdr = reinterpret_cast<flow::tcp_hdr*>(resp_buffer->get_data());
-        resp_hdr->ack_number = htonl(ntohl(req_hdr->sequence_number) + 1);
-        resp_hdr->src_port = req_hdr->dst_port;
-        resp_hdr->dst_port = req_hdr->src_port;
+        resp_hdr->ack_number = htonl(req_sequence_number + 1);
+        resp_hdr->src_port = htons(local_port);
+        resp_hdr->dst_port = htons(remote_port);
         resp_hdr->sequence_number = htonl(0);
         resp_hdr->syn = 0b1;
         resp_hdr->ack = 0b1;
         resp_hdr->header_len = 0x5;
         resp_hdr->window_size = def::checksum_max_num;
         resp_hdr->tcp_checksum = 0;
-        // add fake udp header
-        flow::skb_push(resp_buffer, sizeof(struct flow::transport_fake_hdr));
-        auto fake_hdr = reinterpret_cast<flow::transport_fake_hdr*>(resp_buffer->get_data());
-        fake_hdr->src_ip = htonl(local_ip);
-        fake_hdr->dst_ip = htonl(remote_ip);
-        fake_hdr->reserve = 0;
-        fake_hdr->protocol = uint8_t(def::transport_protocol::tcp);
-        fake_hdr->total_len = htons(sizeof(struct flow::tcp_hdr));
-        // get checksum 
-        resp_hdr->tcp_checksum = htons(flow::compute_checksum(resp_buffer));
-        // drop fake header
-        flow::skb_pull(resp_buffer, sizeof(struct flow::transport_fake_hdr));
+        // get checksum, pseudo header is summed without writing it
+        resp_hdr->tcp_checksum = htons(flow::compute_transport_checksum(resp_buffer, sizeof(struct flow::tcp_hdr), dst_sock->pseudo_sum_));
         // send stack back
         if (!stack_.expired()) {
             stack_.lock()->write_network_package(resp_buffer);
@@ -279,81 +371,69 @@ void tcp_sock::handle_connection(flow::sk_buff::ptr buffer) {
         if (type_ == tcp_sock_type::listen) {
             std::cout << "tcp rcv ack: " << remote_port << " -> " << local_port << std::endl;
             // look for syn list
-            auto iter = std::find_if(syn_list_.begin(), syn_list_.end(), [dst_key](tcp_sock::ptr elem) {
-                return hash_sock_equal_key()(elem->key, dst_key);
+            auto iter = std::find_if(syn_list_.begin(), syn_list_.end(), [&dst_key](const tcp_sock::ptr& elem) {
+                return elem->key->get_flow_key() == dst_key;
             });
+            tcp_sock::ptr sock;
             // check if in syn list
             if (iter != syn_list_.end()) {
                 std::lock_guard<std::mutex> lock(sock_mutex_);
-                // erase from syn list
-                accept_queue_.push_back(*iter);
+                // keep sock before iter is erased from syn list
+                sock = *iter;
+                accept_queue_.push_back(sock);
                 syn_list_.erase(iter);
                 sock_cond_.notify_one();
-            } else
-                iter = std::find_if(accept_queue_.begin(), accept_queue_.end(), [dst_key](tcp_sock::ptr elem){
-                    return hash_sock_equal_key()(elem->key, dst_key);
+            } else {
+                std::lock_guard<std::mutex> lock(sock_mutex_);
+                auto accept_iter = std::find_if(accept_queue_.begin(), accept_queue_.end(), [&dst_key](const tcp_sock::ptr& elem){
+                    return elem->key->get_flow_key() == dst_key;
                 });
-            // check if elem exist
-            if (*iter == nullptr)
-                return;
-            return (*iter)->handle_connection(buffer);
+                // check if elem exist
+                if (accept_iter == accept_queue_.end())
+                    return;
+                sock = *accept_iter;
+            }
+            return sock->handle_connection(buffer);
         } else if (type_ == tcp_sock_type::established) {
+            retransmit_ack(req_ack_number);
             flow::skb_pull(buffer, sizeof(struct flow::tcp_hdr));
             if (buf_len > 0)
                 write_buffer_to_queue(buffer);
             state_ = def::tcp_connection_state::established;
-            if (req_hdr->syn)
-                ack_number_ = ntohl(req_hdr->sequence_number) + 1;
+            if (req_syn)
+                ack_number_ = req_sequence_number + 1;
             else
-                ack_number_ = ntohl(req_hdr->sequence_number) + buf_len;
+                ack_number_ = req_sequence_number + buf_len;
         }
         // check if need write back buffer
-        if (buf_len > 0 || req_hdr->syn) {
+        if (buf_len > 0 || req_syn) {
             std::cout << "tcp rcv data: " << remote_port << " -> " << local_port << std::endl;
-            // create response header
-            auto alloc_size = sizeof(struct flow::tcp_hdr) + sizeof(struct flow::ip_hdr) + def::max_ether_header;
-            flow::sk_buff::ptr resp_buffer = flow::sk_buff::alloc(alloc_size);
-            resp_buffer->protocol = uint16_t(def::transport_protocol::tcp);
-            resp_buffer->data_len = alloc_size;
-            resp_buffer->src = buffer->dst;
-            resp_buffer->dst = buffer->src;
-            // append to tcp header
-            flow::skb_reserve(resp_buffer, alloc_size);
-            flow::skb_push(resp_buffer, sizeof(struct flow::tcp_hdr));
+            // payload is queued to sock, only pure ack can reuse request buffer
+            auto resp_buffer = alloc_response_buffer(buffer, buf_len == 0);
             // get response tcp header
             auto resp_hdr = reinterpret_cast<flow::tcp_hdr*>(resp_buffer->get_data());
             uint32_t ack_number = 0;
-            if (req_hdr->syn) {
-                ack_number = ntohl(req_hdr->sequence_number) + 1;
+            if (req_syn) {
+                ack_number = req_sequence_number + 1;
             } else {
-                ack_number = ntohl(req_hdr->sequence_number) + buffer->get_data_len();
+                ack_number = req_sequence_number + buf_len;
             }
             resp_hdr->ack_number = htonl(ack_number);
-            resp_hdr->src_port = req_hdr->dst_port;
-            resp_hdr->dst_port = req_hdr->src_port;
+            resp_hdr->src_port = htons(local_port);
+            resp_hdr->dst_port = htons(remote_port);
             resp_hdr->sequence_number = htonl(sequence_number_);
             resp_hdr->ack = 0b1;
             resp_hdr->header_len = 0x5;
             resp_hdr->window_size = def::checksum_max_num;
             resp_hdr->tcp_checksum = 0;
-            // add fake udp header
-            flow::skb_push(resp_buffer, sizeof(struct flow::transport_fake_hdr));
-            auto fake_hdr = reinterpret_cast<flow::transport_fake_hdr*>(resp_buffer->get_data());
-            fake_hdr->src_ip = htonl(local_ip);
-            fake_hdr->dst_ip = htonl(remote_ip);
-            fake_hdr->reserve = 0;
-            fake_hdr->protocol = uint8_t(def::transport_protocol::tcp);
-            fake_hdr->total_len = htons(sizeof(struct flow::tcp_hdr));
-            // get checksum 
-            resp_hdr->tcp_checksum = htons(flow::compute_checksum(resp_buffer));
-            // drop fake header
-            flow::skb_pull(resp_buffer, sizeof(struct flow::transport_fake_hdr));
+            // get checksum, pseudo header is summed without writing it
+            resp_hdr->tcp_checksum = htons(flow::compute_transport_checksum(resp_buffer, sizeof(struct flow::tcp_hdr), pseudo_sum_));
             // send stack back
             if (!stack_.expired()) {
                 stack_.lock()->write_network_package(resp_buffer);
             }
             // check if is syn
-            if (req_hdr->syn && state_ == def::tcp_connection_state::established) {
+            if (req_syn && state_ == def::tcp_connection_state::established) {
                 state_ = def::tcp_connection_state::established;
                 char buf[] = "recv";
                 ::write(connect_wait_fd[1], buf, sizeof(buf));
@@ -362,6 +442,65 @@ void tcp_sock::handle_connection(flow::sk_buff::ptr buffer) {
     }
 }
 
+// get response buffer with tcp header pushed
+flow::sk_buff::ptr tcp_sock::alloc_response_buffer(const flow::sk_buff::ptr& buffer, bool reuse) {
+    flow::sk_buff::ptr resp_buffer;
+    if (reuse && buffer->transport_offset != 0 && !flow::skb_cloned(buffer)) {
+        // write over request header, ip and ether header use headroom
+        resp_buffer = buffer;
+        resp_buffer->data_begin = buffer->transport_offset + sizeof(struct flow::tcp_hdr);
+        resp_buffer->data_tail = resp_buffer->data_begin;
+        if (resp_buffer->ext != nullptr)
+            resp_buffer->ext->frags.clear();
+    } else {
+        auto alloc_size = sizeof(struct flow::tcp_hdr) + sizeof(struct flow::ip_hdr) + def::max_ether_header;
+        resp_buffer = flow::sk_buff::alloc(alloc_size);
+        resp_buffer->data_len = alloc_size;
+        resp_buffer->dev_index = buffer->dev_index;
+        flow::skb_reserve(resp_buffer, alloc_size);
+    }
+    // swap address
+    auto src = buffer->dst;
+    auto dst = buffer->src;
+    resp_buffer->src = src;
+    resp_buffer->dst = dst;
+    resp_buffer->protocol = uint16_t(def::transport_protocol::tcp);
+    // append to tcp header
+    flow::skb_push(resp_buffer, sizeof(struct flow::tcp_hdr));
+    // pool buffer is not zeroed
+    flow::skb_reset(resp_buffer, sizeof(struct flow::tcp_hdr));
+    return resp_buffer;
+}
+
+// save sent payload
+void tcp_sock::retransmit_push(uint32_t sequence_number, const flow::sk_buff::ptr& buffer) {
+    flow::skb_set_owner(buffer, def::skb_owner::tcp_retransmit);
+    std::lock_guard<std::mutex> lock(retransmit_mutex_);
+    retransmit_queue_.push(std::make_pair(sequence_number, buffer));
+}
+
+// drop acked payload
+void tcp_sock::retransmit_ack(uint32_t ack_number) {
+    std::lock_guard<std::mutex> lock(retransmit_mutex_);
+    while (!retransmit_queue_.empty()) {
+        auto& elem = retransmit_queue_.front();
+        // sequence number may wrap
+        if (int32_t(ack_number - (elem.first + flow::skb_len(elem.second))) < 0)
+            break;
+        retransmit_queue_.pop();
+    }
+}
+
+// get unacked payload
+std::vector<std::pair<uint32_t, flow::sk_buff::ptr>> tcp_sock::retransmit_get() {
+    std::lock_guard<std::mutex> lock(retransmit_mutex_);
+    std::vector<std::pair<uint32_t, flow::sk_buff::ptr>> payloads;
+    payloads.reserve(retransmit_queue_.size());
+    for (size_t index = 0; index < retransmit_queue_.size(); index++)
+        payloads.push_back(retransmit_queue_[index]);
+    return payloads;
+}
+
 // upate state
 void tcp_sock::update_connection_state(def::tcp_connection_state state) {
     state_ = state;
@@ -386,11 +525,15 @@ bool tcp_sock::connect() {
     req_buffer->data_len = alloc_size;
     req_buffer->src = key->local_ip;
     req_buffer->dst = key->remote_ip;
+    // address is set by connect after sock created
+    pseudo_sum_ = flow::checksum_pseudo(key->local_ip, key->remote_ip, def::transport_protocol::tcp);
     // append to tcp header
     flow::skb_reserve(req_buffer, alloc_size);
     flow::skb_push(req_buffer, sizeof(struct flow::tcp_hdr));
     // get response tcp header
     auto req_hdr = reinterpret_cast<flow::tcp_hdr*>(req_buffer->get_data());
+    // pool buffer is not zeroed
+    flow::skb_reset(req_buffer, sizeof(struct flow::tcp_hdr));
     req_hdr->ack_number = 0;
     req_hdr->src_port = htons(key->local_port);
     req_hdr->dst_port = htons(key->remote_port);
@@ -400,18 +543,8 @@ bool tcp_sock::connect() {
     req_hdr->header_len = 0x5;
     req_hdr->window_size = def::checksum_max_num;
     req_hdr->tcp_checksum = 0;
-    // add fake udp header
-    flow::skb_push(req_buffer, sizeof(struct flow::transport_fake_hdr));
-    auto fake_hdr = reinterpret_cast<flow::transport_fake_hdr*>(req_buffer->get_data());
-    fake_hdr->src_ip = htonl(key->local_ip);
-    fake_hdr->dst_ip = htonl(key->remote_ip);
-    fake_hdr->reserve = 0;
-    fake_hdr->protocol = uint8_t(def::transport_protocol::tcp);
-    fake_hdr->total_len = htons(sizeof(struct flow::tcp_hdr));
-    // get checksum 
-    req_hdr->tcp_checksum = htons(flow::compute_checksum(req_buffer));
-    // drop fake header
-    flow::skb_pull(req_buffer, sizeof(struct flow::transport_fake_hdr));
+    // get checksum, pseudo header is summed without writing it
+    req_hdr->tcp_checksum = htons(flow::compute_transport_checksum(req_buffer, sizeof(struct flow::tcp_hdr), pseudo_sum_));
     // send stack back
     if (!stack_.expired()) {
         stack_.lock()->write_network_package(req_buffer);
@@ -439,18 +572,30 @@ size_t tcp_sock::write(char* buf, size_t size) {
     } else if (key->protocol == def::transport_protocol::udp) {
         offset_size = flow::get_max_udp_data_offset();
     }
-    // alloc buffer size
-    flow::sk_buff::ptr buffer = flow::sk_buff::alloc(offset_size + size);
-    buffer->key = key;
-    buffer->protocol = uint16_t(buffer->key->protocol);
-    buffer->mtu = 1500;
-    skb_reserve(buffer, offset_size);
-    // copy to buffer
-    buffer->store_data(buf, size);
-    flow::skb_put(buffer, size);
-    write_queue.push(buffer);
+    // one buffer per segment, so payload sum of each segment is computed on copy
+    // segment is super frame if device segment itself, sock buffer has no device yet
+    size_t seg_size = get_segment_size(stack_, 0, def::default_mtu);
+    size_t offset = 0;
+    do {
+        auto seg_len = std::min(seg_size, size - offset);
+        // alloc buffer size
+        flow::sk_buff::ptr buffer = flow::sk_buff::alloc(offset_size + seg_len);
+        auto ext = buffer != nullptr ? buffer->get_ext() : nullptr;
+        if (ext == nullptr)
+            break;
+        ext->key = key;
+        buffer->protocol = uint16_t(key->protocol);
+        buffer->mtu = def::default_mtu;
+        skb_reserve(buffer, offset_size);
+        // copy to buffer
+        buffer->store_data_checksum(buf + offset, seg_len);
+        flow::skb_put(buffer, seg_len);
+        flow::skb_set_owner(buffer, def::skb_owner::sock_write);
+        write_queue.push(buffer);
+        offset += seg_len;
+    } while (offset < size);
     write_cond.notify_one();
-    return size;
+    return offset;
 }
 
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <utility>
 
 namespace flow_table {
     struct tcp_connection_queue;
@@ -56,21 +57,27 @@ public:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr buffer);
+    virtual bool pack_flow(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief package flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool unpack_flow(flow::sk_buff::ptr buffer);
+    virtual bool unpack_flow(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief unpack flow batch, per packet unpack is not dispatched virtually
+     * @param[in,out] batch sk buffers, only buffers need next handle are kept
+     */
+    virtual void unpack_batch(flow::skb_batch& batch);
 
     /**
      * @brief write buffer to sock
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */ 
-    virtual bool write_buffer_to_sock(flow::sk_buff::ptr buffer);
+    virtual bool write_buffer_to_sock(const flow::sk_buff::ptr& buffer);
 
 public:
     /**
@@ -170,6 +177,19 @@ public:
     */
     virtual flow::sk_buff::ptr read_buffer_from_queue();
 
+    /**
+     * @brief resend all unacked payload of sock
+     * @param[in] key sock key
+     * @return false if sock not exist
+     */
+    bool retransmit(flow_table::sock_key::ptr key);
+
+    /**
+     * @brief get count of received buffers dropped by checksum
+     * @return drop count
+     */
+    uint64_t get_checksum_drops() { return checksum_drops_.load(std::memory_order_relaxed); }
+
 private:
     /**
      * @brief create tcp with stack
@@ -183,14 +203,37 @@ private:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool tcp_rcv(flow::sk_buff::ptr buffer);
+    bool tcp_rcv(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle tcp response
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool tcp_send(flow::sk_buff::ptr buffer);
+    bool tcp_send(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief push tcp header and compute checksum, only pseudo header is summed for super frame
+     * @param[in] buffer sk buffer
+     * @param[in] key sock key
+     * @param[in] sequence_number sequence number of first payload byte
+     * @param[in] ack_number ack number
+     * @param[in] pseudo_sum pseudo header sum of connection
+     */
+    void tcp_make_flow(const flow::sk_buff::ptr& buffer, const flow_table::sock_key::ptr& key, 
+        uint32_t sequence_number, uint32_t ack_number, uint32_t pseudo_sum);
+
+    /**
+     * @brief split payload by mss, or by super frame size if device segment itself, then push tcp header to each segment
+     * @param[in] buffer sk buffer, extra segments are stored in child frags
+     * @param[in] key sock key
+     * @param[in] sequence_number sequence number of first payload byte
+     * @param[in] ack_number ack number
+     * @param[in] pseudo_sum pseudo header sum of connection
+     * @return false if out of memory
+     */
+    bool tcp_segment_flow(const flow::sk_buff::ptr& buffer, const flow_table::sock_key::ptr& key, 
+        uint32_t sequence_number, uint32_t ack_number, uint32_t pseudo_sum);
 
 private:
     /// stack
@@ -201,6 +244,8 @@ private:
     flow_table::sock_table::ptr listen_sock_table_;
     /// tcp sock table
     flow_table::sock_table::ptr established_sock_table_;
+    /// received buffers dropped by checksum
+    std::atomic<uint64_t> checksum_drops_ { 0 };
 };
 
 }
@@ -239,7 +284,7 @@ typedef std::shared_ptr<tcp_sock> ptr;
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    virtual void handle_connection(flow::sk_buff::ptr buffer);
+    virtual void handle_connection(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief update tcp connection
@@ -268,6 +313,25 @@ typedef std::shared_ptr<tcp_sock> ptr;
      */
     tcp_sock::ptr accept();
 
+    /**
+     * @brief save sent payload until acked
+     * @param[in] sequence_number sequence number of first payload byte
+     * @param[in] buffer payload clone
+     */
+    void retransmit_push(uint32_t sequence_number, const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief drop payload acked by peer
+     * @param[in] ack_number ack number
+     */
+    void retransmit_ack(uint32_t ack_number);
+
+    /**
+     * @brief get unacked payload
+     * @return sequence number and payload
+     */
+    std::vector<std::pair<uint32_t, flow::sk_buff::ptr>> retransmit_get();
+
 private:
     /**
      * @brief create tcp sock
@@ -277,6 +341,14 @@ private:
      */
     tcp_sock(sock_key::ptr key, sock_table::weak_ptr table, interface::stack::weak_ptr stack, tcp_sock_type type);
 
+    /**
+     * @brief get response buffer with zeroed tcp header pushed
+     * @param[in] buffer request buffer
+     * @param[in] reuse build response in request buffer, only if its payload is not queued
+     * @return response buffer
+     */
+    flow::sk_buff::ptr alloc_response_buffer(const flow::sk_buff::ptr& buffer, bool reuse);
+
 public:
     /// sock type 
     tcp_sock_type type_;
@@ -296,8 +368,14 @@ public:
     uint32_t sequence_number_;
     /// ack number
     uint32_t ack_number_;
+    /// pseudo header sum without length, addresses of established sock are fixed
+    uint32_t pseudo_sum_;
     /// connect wait 
     int connect_wait_fd[2];
+    /// retransmit queue lock
+    std::mutex retransmit_mutex_;
+    /// sent payload not acked yet, slots are reused so queue and ack dont alloc
+    flow::ring_queue<std::pair<uint32_t, flow::sk_buff::ptr>> retransmit_queue_;
 };
 
 /**
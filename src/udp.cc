@@ -3,8 +3,9 @@
 #include "flow.hpp"
 #include "sock.hpp"
 
+#include <algorithm>
 #include <cstdint>
-#include <string>
+#include <iostream>
 
 #include <netinet/in.h>
 
@@ -25,8 +26,11 @@ def::transport_protocol udp::get_protocol() {
     return def::transport_protocol::udp;
 }
 
-bool udp::pack_flow(flow::sk_buff::ptr buffer) {
-    auto key = buffer->key;
+bool udp::pack_flow(const flow::sk_buff::ptr& buffer) {
+    // buffer without key is not from sock
+    if (buffer->ext == nullptr)
+        return false;
+    auto key = buffer->ext->key;
     auto local_ip = key->local_ip;
     // set src and dst
     if (local_ip == 0)
@@ -36,64 +40,71 @@ bool udp::pack_flow(flow::sk_buff::ptr buffer) {
     // get hdr
     flow::skb_push(buffer, sizeof(struct flow::udp_hdr));
     // get udp data len 
-    auto len = buffer->get_data_len();
+    auto len = flow::skb_len(buffer);
     // fix header
     auto hdr = reinterpret_cast<flow::udp_hdr*>(buffer->get_data());
     hdr->src_port = htons(key->local_port);
     hdr->dst_port = htons(key->remote_port);
     hdr->total_len = htons(len);
-    // set checksum
+    // set checksum, pseudo header is summed without touching headroom
     hdr->udp_checksum = 0;
-    // add fake udp header
-    flow::skb_push(buffer, sizeof(struct flow::transport_fake_hdr));
-    auto fake_hdr = reinterpret_cast<flow::transport_fake_hdr*>(buffer->get_data());
-    fake_hdr->src_ip = htonl(local_ip);
-    fake_hdr->dst_ip = htonl(key->remote_ip);
-    fake_hdr->reserve = 0;
-    fake_hdr->protocol = uint8_t(def::transport_protocol::udp);
-    fake_hdr->total_len = htons(len);
-    // get checksum 
-    hdr->udp_checksum = htons(flow::compute_checksum(buffer));
-    // drop fake header
-    flow::skb_pull(buffer, sizeof(struct flow::transport_fake_hdr));
+    auto pseudo_sum = flow::checksum_pseudo(local_ip, key->remote_ip, def::transport_protocol::udp);
+    auto checksum = flow::compute_transport_checksum(buffer, sizeof(struct flow::udp_hdr), pseudo_sum);
+    // zero means no checksum in udp
+    hdr->udp_checksum = htons(checksum == 0 ? def::checksum_max_num : checksum);
     buffer->data_len += sizeof(struct flow::udp_hdr);
     return true;
 }
 
+// unpack flow batch
+void udp::unpack_batch(flow::skb_batch& batch) {
+    batch.filter([this] (flow::sk_buff::ptr& buffer) { return udp::unpack_flow(buffer); });
+}
+
 // unpack udp flow
-bool udp::unpack_flow(flow::sk_buff::ptr buffer) {
+bool udp::unpack_flow(const flow::sk_buff::ptr& buffer) {
     // get udp hdr
     auto hdr = reinterpret_cast<flow::udp_hdr*>(buffer->get_data());
     if (hdr == nullptr)
         return false;
+    // zero checksum means sender skip it
+    auto local_ip = std::get<uint32_t>(buffer->dst);
+    auto remote_ip = std::get<uint32_t>(buffer->src);
+    if (hdr->udp_checksum != 0 && !flow::verify_transport_checksum(buffer, 
+        flow::checksum_pseudo(remote_ip, local_ip, def::transport_protocol::udp))) {
+        checksum_drops_.fetch_add(1, std::memory_order_relaxed);
+        std::cout << "drop udp msg, checksum failed" << std::endl;
+        return false;
+    }
     // get msg
     auto msg_len = ntohs(hdr->total_len) - sizeof(struct flow::udp_hdr);
     flow::skb_pull(buffer, sizeof(struct flow::udp_hdr));
-    auto local_ip = std::get<uint32_t>(buffer->dst);
     auto local_port = ntohs(hdr->dst_port);
-    auto remote_ip = std::get<uint32_t>(buffer->src);
     auto remote_port = ntohs(hdr->src_port);
-    // create key
-    buffer->key = flow_table::sock_key::ptr(new flow_table::sock_key(local_ip, local_port, 
-        remote_ip, remote_port, def::transport_protocol::udp));
+    buffer->hash = flow::get_flow_hash(local_ip, local_port, remote_ip, remote_port);
+    // packed key is stored by value, no alloc per packet
+    auto ext = buffer->get_ext();
+    if (ext == nullptr)
+        return false;
+    ext->flow = flow::flow_key{ local_ip, remote_ip, local_port, remote_port, def::transport_protocol::udp };
     buffer->protocol = uint16_t(def::transport_protocol::udp);
-    // copy message
-    auto msg = std::string(buffer->get_data(), msg_len);
+    // print message in place, only linear part is printed
     std::cout << "rcv udp message, " << std::dec << remote_port << " -> " 
-        << local_port << ", msg: " << "\n" << msg << std::endl;
+        << local_port << ", msg: " << "\n";
+    std::cout.write(buffer->get_data(), std::min<size_t>(msg_len, buffer->get_data_len())) << std::endl;
     return true;
 }
 
-bool udp::write_buffer_to_sock(flow::sk_buff::ptr buffer) {
+bool udp::write_buffer_to_sock(const flow::sk_buff::ptr& buffer) {
     return false;
 }
   
-bool udp::udp_rcv(flow::sk_buff::ptr buffer) {
+bool udp::udp_rcv(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
 
-bool udp::udp_send(flow::sk_buff::ptr buffer) {
+bool udp::udp_send(const flow::sk_buff::ptr& buffer) {
     return false;
 }
 
@@ -47,21 +47,33 @@ public:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool pack_flow(flow::sk_buff::ptr buffer);
+    virtual bool pack_flow(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief package flow
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    virtual bool unpack_flow(flow::sk_buff::ptr buffer);
+    virtual bool unpack_flow(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief unpack flow batch, per packet unpack is not dispatched virtually
+     * @param[in,out] batch sk buffers, only buffers need next handle are kept
+     */
+    virtual void unpack_batch(flow::skb_batch& batch);
 
     /**
      * @brief write buffer to sock
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */ 
-    virtual bool write_buffer_to_sock(flow::sk_buff::ptr buffer);
+    virtual bool write_buffer_to_sock(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief get count of received buffers dropped by checksum
+     * @return drop count
+     */
+    uint64_t get_checksum_drops() { return checksum_drops_.load(std::memory_order_relaxed); }
 
 private:
     /**
@@ -76,20 +88,22 @@ private:
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */    
-    bool udp_rcv(flow::sk_buff::ptr buffer);
+    bool udp_rcv(const flow::sk_buff::ptr& buffer);
 
     /**
      * @brief handle udp response
      * @param[in] skb sk buffer
      * @return return if package is valid, like checksum failed
      */
-    bool udp_send(flow::sk_buff::ptr buffer);
+    bool udp_send(const flow::sk_buff::ptr& buffer);
 
 private:
     /// stack
     interface::stack::weak_ptr stack_;
     /// identification
     std::atomic<uint16_t> identification_;
+    /// received buffers dropped by checksum
+    std::atomic<uint64_t> checksum_drops_ { 0 };
 };
 
 }
@@ -0,0 +1,214 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace driver {
+
+namespace {
+
+int uring_setup(uint32_t entries, struct io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+int uring_register(int fd, uint32_t opcode, const void* arg, uint32_t count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+}
+
+uring::uring()
+    : fd_(-1), sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0), sqes_(nullptr), sqes_size_(0),
+    sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_array_(nullptr), sq_local_tail_(0), cq_head_(nullptr),
+    cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr), buf_ring_(nullptr), buf_ring_size_(0), buf_mask_(0), buf_local_tail_(0) {
+}
+
+uring::~uring() {
+    if (buf_ring_ != nullptr)
+        munmap(buf_ring_, buf_ring_size_);
+    if (sqes_ != nullptr)
+        munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+        munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+// create ring
+uring::ptr uring::create(uint32_t sq_entries, uint32_t cq_entries) {
+    auto ring = uring::ptr(new uring());
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // task work run only when ring thread enter kernel, so completions dont interrupt it
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = std::max(cq_entries, sq_entries);
+    ring->fd_ = uring_setup(sq_entries, &params);
+    if (ring->fd_ < 0 && errno == EINVAL) {
+        // older kernel, keep only flags from 5.5
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = std::max(cq_entries, sq_entries);
+        ring->fd_ = uring_setup(sq_entries, &params);
+    }
+    if (ring->fd_ < 0) {
+        std::cout << "setup io_uring failed, err: " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    if (!ring->map_rings(params))
+        return nullptr;
+    return ring;
+}
+
+// map rings shared with kernel
+bool uring::map_rings(const struct io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // both rings live in one mapping since 5.4
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        std::cout << "map io_uring submission ring failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    cq_ring_ = sq_ring_;
+    if (!single_mmap) {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            std::cout << "map io_uring completion ring failed, err: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        std::cout << "map io_uring sqes failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+    auto sq = static_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+    auto cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// register fds
+bool uring::register_files(const int* fds, uint32_t count) {
+    if (uring_register(fd_, IORING_REGISTER_FILES, fds, count) < 0) {
+        std::cout << "register io_uring files failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// register provided buffer ring
+bool uring::register_buffer_ring(uint16_t group, uint32_t entries) {
+    buf_ring_size_ = entries * sizeof(struct io_uring_buf);
+    void* memory = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cout << "map io_uring buffer ring failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf_ring*>(memory);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        std::cout << "register io_uring buffer ring failed, err: " << std::strerror(errno) << std::endl;
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+        return false;
+    }
+    buf_mask_ = entries - 1;
+    buf_local_tail_ = 0;
+    return true;
+}
+
+// put buffer in buffer ring
+void uring::add_buffer(void* addr, uint32_t len, uint16_t id) {
+    // entries start at ring base, flex array of header is shifted by its empty member in c++
+    auto& buf = reinterpret_cast<struct io_uring_buf*>(buf_ring_)[buf_local_tail_ & buf_mask_];
+    buf.addr = reinterpret_cast<uint64_t>(addr);
+    buf.len = len;
+    buf.bid = id;
+    buf_local_tail_++;
+}
+
+// publish added buffers
+void uring::commit_buffers() {
+    // tail share memory with reserved field of first entry
+    __atomic_store_n(&buf_ring_->tail, buf_local_tail_, __ATOMIC_RELEASE);
+}
+
+// get free sqe
+struct io_uring_sqe* uring::get_sqe() {
+    uint32_t head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head > sq_mask_)
+        return nullptr;
+    uint32_t index = sq_local_tail_ & sq_mask_;
+    sq_array_[index] = index;
+    sq_local_tail_++;
+    memset(&sqes_[index], 0, sizeof(struct io_uring_sqe));
+    return &sqes_[index];
+}
+
+// submit sqes and wait completions
+int uring::submit_and_wait(uint32_t wait_count) {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    // count from kernel head, sqes left by interrupted enter are submitted again
+    uint32_t to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && wait_count == 0)
+        return 0;
+    while (true) {
+        int ret = uring_enter(fd_, to_submit, wait_count, wait_count > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0)
+            return ret;
+        // interrupted, or completion queue is full and must be reaped first
+        if (errno == EINTR && wait_count > 0)
+            continue;
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            return 0;
+        std::cout << "enter io_uring failed, err: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+}
+
+// get ready completions
+uint32_t uring::peek_cqes(struct io_uring_cqe** cqes, uint32_t max) {
+    uint32_t head = *cq_head_;
+    uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    uint32_t count = std::min(tail - head, max);
+    for (uint32_t index = 0; index < count; index++)
+        cqes[index] = &cqes_[(head + index) & cq_mask_];
+    return count;
+}
+
+// return completions to kernel
+void uring::advance_cqes(uint32_t count) {
+    __atomic_store_n(cq_head_, *cq_head_ + count, __ATOMIC_RELEASE);
+}
+
+}
@@ -0,0 +1,146 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+namespace driver {
+
+/**
+ * @file uring.hpp
+ * @brief io_uring with provided buffer ring, driven by raw syscalls, only one thread submit and reap
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class uring {
+public:
+    typedef std::unique_ptr<uring> ptr;
+
+    /**
+     * @brief create ring
+     * @param[in] sq_entries submission entries, rounded up to power of two by kernel
+     * @param[in] cq_entries completion entries, multishot receive post many per submission
+     * @return nullptr if io_uring not supported
+     */
+    static uring::ptr create(uint32_t sq_entries, uint32_t cq_entries);
+
+    /**
+     * @brief Destroy the uring object, ring and buffer ring are unmapped
+     */
+    ~uring();
+
+    /**
+     * @brief register fds, sqe with IOSQE_FIXED_FILE refer to them by index
+     * @param[in] fds fds
+     * @param[in] count fd count
+     * @return false if register failed
+     */
+    bool register_files(const int* fds, uint32_t count);
+
+    /**
+     * @brief register provided buffer ring, kernel pick buffer of it when data arrive
+     * @param[in] group buffer group id
+     * @param[in] entries ring entries, power of two
+     * @return false if register failed
+     */
+    bool register_buffer_ring(uint16_t group, uint32_t entries);
+
+    /**
+     * @brief put buffer in buffer ring, kernel see it after commit_buffers
+     * @param[in] addr buffer address
+     * @param[in] len buffer len
+     * @param[in] id buffer id, reported in cqe flags
+     */
+    void add_buffer(void* addr, uint32_t len, uint16_t id);
+
+    /**
+     * @brief publish buffers added since last commit
+     */
+    void commit_buffers();
+
+    /**
+     * @brief get free sqe, it is zeroed
+     * @return sqe, nullptr if submission queue is full
+     */
+    struct io_uring_sqe* get_sqe();
+
+    /**
+     * @brief submit queued sqes and wait completions
+     * @param[in] wait_count completions to wait, 0 not block
+     * @return submitted count, -1 if ring broken
+     */
+    int submit_and_wait(uint32_t wait_count);
+
+    /**
+     * @brief get ready completions without syscall
+     * @param[out] cqes completions, valid until advance_cqes
+     * @param[in] max max count
+     * @return completion count
+     */
+    uint32_t peek_cqes(struct io_uring_cqe** cqes, uint32_t max);
+
+    /**
+     * @brief return completions to kernel
+     * @param[in] count completion count
+     */
+    void advance_cqes(uint32_t count);
+
+private:
+    uring();
+
+    /**
+     * @brief map rings shared with kernel
+     * @param[in] params params filled by setup
+     * @return false if map failed
+     */
+    bool map_rings(const struct io_uring_params& params);
+
+private:
+    /// ring fd
+    int fd_;
+    /// submission ring memory
+    void* sq_ring_;
+    /// submission ring memory size
+    size_t sq_ring_size_;
+    /// completion ring memory, same as submission ring on single mmap kernel
+    void* cq_ring_;
+    /// completion ring memory size
+    size_t cq_ring_size_;
+    /// sqe array
+    struct io_uring_sqe* sqes_;
+    /// sqe array size
+    size_t sqes_size_;
+    /// submission head, moved by kernel
+    uint32_t* sq_head_;
+    /// submission tail, moved by us
+    uint32_t* sq_tail_;
+    /// submission mask
+    uint32_t sq_mask_;
+    /// submission index array
+    uint32_t* sq_array_;
+    /// sqes taken but not submitted
+    uint32_t sq_local_tail_;
+    /// completion head, moved by us
+    uint32_t* cq_head_;
+    /// completion tail, moved by kernel
+    uint32_t* cq_tail_;
+    /// completion mask
+    uint32_t cq_mask_;
+    /// completion array
+    struct io_uring_cqe* cqes_;
+    /// provided buffer ring, nullptr if not registered
+    struct io_uring_buf_ring* buf_ring_;
+    /// provided buffer ring memory size
+    size_t buf_ring_size_;
+    /// provided buffer ring mask
+    uint32_t buf_mask_;
+    /// buffers added but not committed
+    uint16_t buf_local_tail_;
+};
+
+}
+
+#endif // __URING_H__
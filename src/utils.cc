@@ -14,6 +14,7 @@
 #include <fcntl.h>
 #include <string>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -124,13 +125,15 @@ namespace device {
 
 // pre define
 std::optional<bool> send_nl_request(struct def::netlink_request& request);
-std::optional<int> create_kernel_tap_device(const std::string& dev_name, const std::string& device_path, def::device_type type);
+std::optional<int> create_kernel_tap_device(const std::string& dev_name, const std::string& device_path, def::device_type type,
+    uint16_t flags);
 
 // create kernel tun or tap device
-std::optional<int> create_kernel_device(const std::string& dev_name, const std::string& device_path, def::device_type type) {
+std::optional<int> create_kernel_device(const std::string& dev_name, const std::string& device_path, def::device_type type,
+    uint16_t flags) {
     switch (type) {
     case def::device_type::tap:
-        return create_kernel_tap_device(dev_name, device_path, type);
+        return create_kernel_tap_device(dev_name, device_path, type, flags);
     default:
         return std::nullopt;
     }
@@ -164,6 +167,33 @@ std::optional<bool> set_kernel_device_status(const std::string &device_name, def
     return send_nl_request(request);
 }
 
+// set kernel device gso max size
+std::optional<bool> set_kernel_device_gso_max_size(const std::string& device_name, uint32_t size) {
+    // get interface index by name
+    int ifindex = if_nametoindex(device_name.c_str());
+    if (ifindex == 0)
+        return std::nullopt;
+    // create netlink request
+    struct def::netlink_request request;
+    memset(&request, 0, sizeof(request));
+    // set netlink request 
+    request.hdr.nlmsg_flags = NLM_F_REQUEST;
+    request.hdr.nlmsg_type = RTM_SETLINK;
+    request.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.hdr.nlmsg_seq = getpid();
+    request.hdr.nlmsg_pid =  getpid();
+    // set rtnetlink request 
+    request.info.ifi_family = AF_UNSPEC;
+    request.info.ifi_index = ifindex;
+    // append gso max size attr after ifinfomsg
+    auto attr = reinterpret_cast<struct rtattr*>(reinterpret_cast<char*>(&request) + NLMSG_ALIGN(request.hdr.nlmsg_len));
+    attr->rta_type = IFLA_GSO_MAX_SIZE;
+    attr->rta_len = RTA_LENGTH(sizeof(size));
+    memcpy(RTA_DATA(attr), &size, sizeof(size));
+    request.hdr.nlmsg_len = NLMSG_ALIGN(request.hdr.nlmsg_len) + RTA_ALIGN(attr->rta_len);
+    return send_nl_request(request);
+}
+
 // create kernel macvlan device
 std::optional<int> create_kernel_macvlan_device(const std::string& device_name, def::device_type type) {
     // get interface index by name
@@ -188,7 +218,8 @@ std::optional<int> create_kernel_macvlan_device(const std::string& device_name,
 }
 
 // create kernel tun or tap device
-std::optional<int> create_kernel_tap_device(const std::string& dev_name, const std::string& device_path, def::device_type type) {
+std::optional<int> create_kernel_tap_device(const std::string& dev_name, const std::string& device_path, def::device_type type,
+    uint16_t flags) {
     // try to open tun device
     int fd = open(device_path.c_str(), O_RDWR);
     if (fd < 0)
@@ -198,7 +229,7 @@ std::optional<int> create_kernel_tap_device(const std::string& dev_name, const s
     memset(&ifr, 0, sizeof(ifr));
     // set ifreq
     memcpy(&ifr.ifr_name, dev_name.c_str(), dev_name.length());
-    ifr.ifr_flags |= IFF_NO_PI | IFF_NAPI | IFF_NAPI_FRAGS;
+    ifr.ifr_flags |= IFF_NO_PI | IFF_NAPI | IFF_NAPI_FRAGS | flags;
     // check if device is tun or tap
     if (type == def::device_type::tun) {
         ifr.ifr_flags |= IFF_TUN;
@@ -226,6 +257,27 @@ std::optional<bool> send_nl_request(struct def::netlink_request& request) {
 }
 
 
+}
+
+namespace bpf {
+
+// make bpf instruction
+struct bpf_insn make_insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    struct bpf_insn insn;
+    memset(&insn, 0, sizeof(insn));
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+// call bpf syscall
+int bpf_call(int cmd, union bpf_attr& attr) {
+    return syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
 }
 
 }
\ No newline at end of file
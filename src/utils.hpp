@@ -4,6 +4,8 @@
 #include <optional>
 #include <string>
 
+#include <linux/bpf.h>
+
 namespace utils {
 
 
@@ -63,9 +65,11 @@ std::optional<bool> get_kernel_device_status(const std::string& dev_name);
  * @brief create kernel device
  * @param[in] dev_name device name
  * @param[in] type device type
+ * @param[in] flags extra tun flags, like IFF_VNET_HDR
  * @return ifindex success, std::nullopt fail
  */
-std::optional<int> create_kernel_device(const std::string& dev_name, const std::string& device_path, def::device_type type);
+std::optional<int> create_kernel_device(const std::string& dev_name, const std::string& device_path, def::device_type type,
+    uint16_t flags);
 
 /**
  * @brief set kernel device status
@@ -75,6 +79,38 @@ std::optional<int> create_kernel_device(const std::string& dev_name, const std::
  */
 std::optional<bool> set_kernel_device_status(const std::string& device_name, def::device_status status);
 
+/**
+ * @brief set max super frame kernel pass to device, bigger one is segmented by kernel
+ * @param[in] dev_name device name
+ * @param[in] size max frame size, include ether header
+ * @return true success, std::nullopt fail
+ */
+std::optional<bool> set_kernel_device_gso_max_size(const std::string& device_name, uint32_t size);
+
+}
+
+
+namespace bpf {
+
+/**
+ * @brief make bpf instruction
+ * @param[in] code op code
+ * @param[in] dst dst register
+ * @param[in] src src register
+ * @param[in] off offset
+ * @param[in] imm immediate
+ * @return instruction
+ */
+struct bpf_insn make_insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm);
+
+/**
+ * @brief call bpf syscall
+ * @param[in] cmd bpf command
+ * @param[in] attr command attr
+ * @return fd or result, -1 if failed
+ */
+int bpf_call(int cmd, union bpf_attr& attr);
+
 }
 
 
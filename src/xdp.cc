@@ -0,0 +1,521 @@
+#include "xdp.hpp"
+#include "def.hpp"
+#include "flow.hpp"
+#include "pool.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+namespace driver {
+
+namespace {
+
+// ether type of arp as loaded from packet on little endian host
+const uint16_t arp_ether_type = 0x0608;
+
+// offset of arp target ip in frame
+const uint16_t arp_target_ip_offset = 14 + 24;
+
+// frame len needed to read arp target ip
+const uint16_t arp_frame_len = 14 + 28;
+
+/**
+ * @brief make program, frames to stack mac and arp for stack ip are redirected to socket, others pass to kernel
+ * @param[in] mac stack mac
+ * @param[in] ip stack ip in host order
+ * @param[in] map_fd xsk map
+ * @return program
+ */
+std::vector<struct bpf_insn> make_redirect_program(const uint8_t* mac, uint32_t ip, int map_fd) {
+    // compare values as loaded from packet
+    int32_t mac_low = 0;
+    int16_t mac_high = 0;
+    int32_t ip_value = 0;
+    uint32_t ip_net = htonl(ip);
+    memcpy(&mac_low, mac, sizeof(mac_low));
+    memcpy(&mac_high, mac + sizeof(mac_low), sizeof(mac_high));
+    memcpy(&ip_value, &ip_net, sizeof(ip_value));
+    // jump offset count from next instruction, pass is at 24, not_mac at 11, redirect at 18
+    return {
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0),
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        utils::bpf::make_insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, def::max_ether_header),
+        utils::bpf::make_insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 18, 0),
+        // dst mac
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, 0, 0),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 3, mac_low),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, sizeof(mac_low), 0),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 1, uint16_t(mac_high)),
+        utils::bpf::make_insn(BPF_JMP | BPF_JA, 0, 0, 7, 0),
+        // not_mac: broadcast arp asking stack ip
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        utils::bpf::make_insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, arp_frame_len),
+        utils::bpf::make_insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 10, 0),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 2 * def::mac_len, 0),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 8, arp_ether_type),
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, arp_target_ip_offset, 0),
+        utils::bpf::make_insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, 6, ip_value),
+        // redirect: socket of rx queue, pass if queue has no socket
+        utils::bpf::make_insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+        utils::bpf::make_insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        utils::bpf::make_insn(0, 0, 0, 0, 0),
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        utils::bpf::make_insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        utils::bpf::make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        // pass
+        utils::bpf::make_insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+        utils::bpf::make_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+}
+
+}
+
+xdp_device::xdp_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address,
+    const xdp_device_config& config)
+    : dev_name_(dev_name), ip_address_(0), config_(config), xsk_fd_(-1), map_fd_(-1), prog_fd_(-1), link_fd_(-1) {
+    utils::generic::convert_string_to_mac(mac_address, mac_address_);
+    utils::generic::convert_string_to_ip(ip_address, &ip_address_);
+    // get ifindex by device name
+    if_index_ = if_nametoindex(dev_name_.c_str());
+    if (if_index_ == 0) {
+        std::cout << "get xdp ifindex failed, err: " << std::strerror(errno) << std::endl;
+    }
+}
+
+xdp_device::~xdp_device() {
+    down();
+}
+
+bool xdp_device::up() {
+    // umem is an arena, so chunks are pool blocks and rx buffer need no copy
+    flow::skb_arena_config arena_config;
+    arena_config.size = config_.umem_size;
+    umem_ = flow::skb_arena::create(arena_config);
+    if (umem_ == nullptr)
+        return false;
+    if (!setup_socket())
+        return false;
+    if (!attach_program())
+        return false;
+    std::cout << "up xdp device success, device name: " << dev_name_ << ", ifindex: " << std::dec << if_index_
+        << ", queue: " << config_.queue_id << ", mac: " << std::hex << utils::generic::format_mac_address(mac_address_)
+        << ", ip: " << utils::generic::format_ip_address(ip_address_) << std::endl;
+    return true;
+}
+
+bool xdp_device::down() {
+    // close link first, frames go back to kernel
+    for (auto fd : { &link_fd_, &prog_fd_, &map_fd_, &xsk_fd_ }) {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+    for (auto ring : { &fill_ring_, &comp_ring_, &rx_ring_, &tx_ring_ }) {
+        if (ring->map != nullptr)
+            munmap(ring->map, ring->map_size);
+        *ring = xdp_ring();
+    }
+    return true;
+}
+
+// setup socket and rings
+bool xdp_device::setup_socket() {
+    xsk_fd_ = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk_fd_ < 0) {
+        std::cout << "create xdp socket failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // register whole arena, chunk is aligned to pool block
+    struct xdp_umem_reg umem_reg;
+    memset(&umem_reg, 0, sizeof(umem_reg));
+    umem_reg.addr = reinterpret_cast<uint64_t>(umem_->get_memory());
+    umem_reg.len = umem_->get_size();
+    umem_reg.chunk_size = def::xdp_chunk_size;
+    umem_reg.headroom = 0;
+    if (setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)) < 0) {
+        std::cout << "register xdp umem failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    for (auto option : { XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING }) {
+        if (setsockopt(xsk_fd_, SOL_XDP, option, &config_.ring_size, sizeof(config_.ring_size)) < 0) {
+            std::cout << "set xdp ring size failed, err: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    struct xdp_mmap_offsets offsets;
+    socklen_t len = sizeof(offsets);
+    if (getsockopt(xsk_fd_, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &len) < 0) {
+        std::cout << "get xdp ring offsets failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (!map_ring(fill_ring_, offsets.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t)) ||
+        !map_ring(comp_ring_, offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t)) ||
+        !map_ring(rx_ring_, offsets.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) ||
+        !map_ring(tx_ring_, offsets.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)))
+        return false;
+    size_t chunk_count = umem_->get_size() / def::xdp_chunk_size;
+    rx_chunks_.resize(chunk_count);
+    tx_chunks_.resize(chunk_count);
+    // bind to device queue
+    struct sockaddr_xdp addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sxdp_family = AF_XDP;
+    addr.sxdp_ifindex = if_index_;
+    addr.sxdp_queue_id = config_.queue_id;
+    addr.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    addr.sxdp_flags |= config_.bind_mode == def::xdp_bind_mode::zero_copy ? XDP_ZEROCOPY : XDP_COPY;
+    int result = bind(xsk_fd_, (struct sockaddr*)&addr, sizeof(addr));
+    if (result < 0 && config_.bind_mode == def::xdp_bind_mode::zero_copy) {
+        // driver may not support zero copy, like veth in generic mode
+        std::cout << "bind xdp socket in zero copy mode failed, fall back to copy mode, err: " << std::strerror(errno) << std::endl;
+        config_.bind_mode = def::xdp_bind_mode::copy;
+        addr.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        result = bind(xsk_fd_, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if (result < 0) {
+        std::cout << "bind xdp socket failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// map one ring
+bool xdp_device::map_ring(xdp_ring& ring, const struct xdp_ring_offset& offset, uint64_t page_offset, size_t desc_size) {
+    ring.map_size = offset.desc + config_.ring_size * desc_size;
+    ring.map = mmap(nullptr, ring.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd_, page_offset);
+    if (ring.map == MAP_FAILED) {
+        std::cout << "map xdp ring failed, err: " << std::strerror(errno) << std::endl;
+        ring.map = nullptr;
+        return false;
+    }
+    auto base = static_cast<char*>(ring.map);
+    ring.producer = reinterpret_cast<uint32_t*>(base + offset.producer);
+    ring.consumer = reinterpret_cast<uint32_t*>(base + offset.consumer);
+    ring.flags = reinterpret_cast<uint32_t*>(base + offset.flags);
+    ring.descs = base + offset.desc;
+    ring.size = config_.ring_size;
+    return true;
+}
+
+// load and attach program
+bool xdp_device::attach_program() {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = config_.queue_id + 1;
+    map_fd_ = utils::bpf::bpf_call(BPF_MAP_CREATE, attr);
+    if (map_fd_ < 0) {
+        std::cout << "create xsk map failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    uint32_t key = config_.queue_id;
+    uint32_t value = xsk_fd_;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd_;
+    attr.key = reinterpret_cast<uint64_t>(&key);
+    attr.value = reinterpret_cast<uint64_t>(&value);
+    if (utils::bpf::bpf_call(BPF_MAP_UPDATE_ELEM, attr) < 0) {
+        std::cout << "update xsk map failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    auto program = make_redirect_program(mac_address_, ip_address_, map_fd_);
+    char license[] = "GPL";
+    std::array<char, 4096> log;
+    log[0] = 0;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = reinterpret_cast<uint64_t>(program.data());
+    attr.insn_cnt = program.size();
+    attr.license = reinterpret_cast<uint64_t>(license);
+    attr.log_buf = reinterpret_cast<uint64_t>(log.data());
+    attr.log_size = log.size();
+    attr.log_level = 1;
+    prog_fd_ = utils::bpf::bpf_call(BPF_PROG_LOAD, attr);
+    if (prog_fd_ < 0) {
+        std::cout << "load xdp program failed, err: " << std::strerror(errno) << ", log: " << log.data() << std::endl;
+        return false;
+    }
+    // link keep program attached until it is closed, so crash never leave program behind
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = prog_fd_;
+    attr.link_create.target_ifindex = if_index_;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = config_.generic ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    link_fd_ = utils::bpf::bpf_call(BPF_LINK_CREATE, attr);
+    if (link_fd_ < 0) {
+        std::cout << "attach xdp program failed, err: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// read buffer from device
+flow::sk_buff::ptr xdp_device::read_from_device() {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    read_cond_.wait(lock, [this] { return !this->read_head_.empty(); });
+    auto buffer = std::move(read_head_.front());
+    read_head_.pop();
+    flow::skb_set_owner(buffer, def::skb_owner::stack);
+    return buffer;
+}
+
+// write buffer to device
+int xdp_device::write_to_device(const flow::sk_buff::ptr& buffer) {
+    make_ether_header(buffer);
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    write_head_.push(buffer);
+    write_cond_.notify_one();
+    return 0;
+}
+
+// read buffer batch from device
+size_t xdp_device::read_from_device(flow::skb_batch& batch) {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    read_cond_.wait(lock, [this] { return !this->read_head_.empty(); });
+    while (!read_head_.empty() && !batch.full()) {
+        flow::skb_set_owner(read_head_.front(), def::skb_owner::stack);
+        batch.push(std::move(read_head_.front()));
+        read_head_.pop();
+    }
+    return batch.size();
+}
+
+// write buffer batch to device
+int xdp_device::write_to_device(flow::skb_batch& batch) {
+    for (auto& buffer : batch)
+        make_ether_header(buffer);
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    for (auto& buffer : batch)
+        write_head_.push(buffer);
+    write_cond_.notify_one();
+    return batch.size();
+}
+
+// get xdp device mac
+uint8_t* xdp_device::get_device_mac() {
+    return mac_address_;
+}
+
+// get xdp device ip
+uint32_t xdp_device::get_device_ip() {
+    return ip_address_;
+}
+
+// get device index
+uint8_t xdp_device::get_device_ifindex() {
+    return if_index_;
+}
+
+void xdp_device::read_thread() {
+    // rx buffers are carved from umem, so kernel write frame into them
+    flow::skb_pool::bind_arena(umem_);
+    flow::skb_batch batch;
+    struct pollfd poll_fd;
+    poll_fd.fd = xsk_fd_;
+    poll_fd.events = POLLIN;
+    auto descs = static_cast<struct xdp_desc*>(rx_ring_.descs);
+    while (true) {
+        refill();
+        uint32_t consumer = *rx_ring_.consumer;
+        uint32_t available = __atomic_load_n(rx_ring_.producer, __ATOMIC_ACQUIRE) - consumer;
+        if (available == 0) {
+            flush_read_batch(batch);
+            if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) {
+                std::cout << "poll xdp socket failed, err: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+        for (uint32_t index = 0; index < available; index++) {
+            auto& desc = descs[(consumer + index) & (rx_ring_.size - 1)];
+            auto chunk = desc.addr / def::xdp_chunk_size;
+            auto skb = std::move(rx_chunks_[chunk]);
+            if (skb == nullptr)
+                continue;
+            // frame is written behind xdp headroom, it become buffer headroom
+            auto frame = umem_->get_memory() + desc.addr;
+            flow::skb_reserve(skb, frame - (skb->data + skb->data_begin));
+            flow::skb_rx_init(skb, if_index_, desc.len);
+            batch.push(std::move(skb));
+            if (batch.full())
+                flush_read_batch(batch);
+        }
+        __atomic_store_n(rx_ring_.consumer, consumer + available, __ATOMIC_RELEASE);
+    }
+}
+
+// post free chunks to fill ring
+void xdp_device::refill() {
+    uint32_t producer = *fill_ring_.producer;
+    uint32_t free = fill_ring_.size - (producer - __atomic_load_n(fill_ring_.consumer, __ATOMIC_ACQUIRE));
+    auto descs = static_cast<uint64_t*>(fill_ring_.descs);
+    // pool block header and sk buff header take one cache line each
+    size_t alloc_size = def::xdp_chunk_size - 2 * def::cache_line_size;
+    uint32_t filled = 0;
+    for (; filled < free; filled++) {
+        auto skb = flow::sk_buff::alloc(alloc_size);
+        if (skb == nullptr)
+            break;
+        // arena exhausted, pool fall back to malloc
+        if (!umem_->contains(skb.get())) {
+            std::cout << "xdp umem exhausted, in flight buffers: " << std::dec << filled << std::endl;
+            break;
+        }
+        auto chunk = get_chunk(skb.get());
+        descs[(producer + filled) & (fill_ring_.size - 1)] = uint64_t(chunk) * def::xdp_chunk_size;
+        rx_chunks_[chunk] = std::move(skb);
+    }
+    if (filled == 0)
+        return;
+    __atomic_store_n(fill_ring_.producer, producer + filled, __ATOMIC_RELEASE);
+}
+
+void xdp_device::write_thread() {
+    // copied tx frames are carved from umem too
+    flow::skb_pool::bind_arena(umem_);
+    std::vector<flow::sk_buff::ptr> buffers;
+    buffers.reserve(def::max_skb_batch);
+    while (true) {
+        {
+            // take up to one batch per lock
+            std::unique_lock<std::mutex> lock(write_mutex_);
+            write_cond_.wait(lock, [&] () { return !write_head_.empty(); });
+            while (!write_head_.empty() && buffers.size() < def::max_skb_batch) {
+                buffers.push_back(std::move(write_head_.front()));
+                write_head_.pop();
+            }
+        }
+        reclaim();
+        for (auto& buffer : buffers) {
+            transmit(buffer);
+            flow::skb_tx_done(buffer);
+        }
+        kick();
+        buffers.clear();
+    }
+}
+
+// put buffer to tx ring
+bool xdp_device::transmit(const flow::sk_buff::ptr& buffer) {
+    size_t len = flow::skb_len(buffer);
+    // wait kernel if tx ring is full
+    uint32_t producer = *tx_ring_.producer;
+    while (producer - __atomic_load_n(tx_ring_.consumer, __ATOMIC_ACQUIRE) >= tx_ring_.size) {
+        kick();
+        reclaim();
+    }
+    flow::sk_buff::ptr frame = buffer;
+    // buffer in umem is sent in place, like reply built in rx buffer
+    auto linear = buffer->get_data();
+    if (flow::skb_is_nonlinear(buffer) || !umem_->contains(linear) || get_chunk(linear) != get_chunk(linear + len - 1) ||
+        tx_chunks_[get_chunk(linear)] != nullptr) {
+        size_t alloc_size = def::xdp_chunk_size - 2 * def::cache_line_size;
+        if (len > alloc_size) {
+            std::cout << "drop xdp frame exceed chunk, size: " << std::dec << len << std::endl;
+            return false;
+        }
+        frame = flow::sk_buff::alloc(alloc_size);
+        if (frame == nullptr || !umem_->contains(frame.get())) {
+            std::cout << "alloc xdp tx frame failed" << std::endl;
+            return false;
+        }
+        frame->data_len = len;
+        flow::skb_copy_data(buffer, frame->data, len);
+    }
+    auto data = frame->data + frame->data_begin;
+    auto chunk = get_chunk(data);
+    auto& desc = static_cast<struct xdp_desc*>(tx_ring_.descs)[producer & (tx_ring_.size - 1)];
+    desc.addr = data - umem_->get_memory();
+    desc.len = len;
+    desc.options = 0;
+    // hold buffer until kernel complete it
+    tx_chunks_[chunk] = std::move(frame);
+    __atomic_store_n(tx_ring_.producer, producer + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// wake kernel to send
+void xdp_device::kick() {
+    if ((__atomic_load_n(tx_ring_.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) == 0)
+        return;
+    if (sendto(xsk_fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+        errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN) {
+        std::cout << "kick xdp socket failed, err: " << std::strerror(errno) << std::endl;
+    }
+}
+
+// release sent chunks
+void xdp_device::reclaim() {
+    uint32_t consumer = *comp_ring_.consumer;
+    uint32_t available = __atomic_load_n(comp_ring_.producer, __ATOMIC_ACQUIRE) - consumer;
+    auto descs = static_cast<uint64_t*>(comp_ring_.descs);
+    for (uint32_t index = 0; index < available; index++) {
+        auto addr = descs[(consumer + index) & (comp_ring_.size - 1)];
+        // buffer go back to pool if stack hold no reference
+        tx_chunks_[addr / def::xdp_chunk_size].reset();
+    }
+    if (available != 0)
+        __atomic_store_n(comp_ring_.consumer, consumer + available, __ATOMIC_RELEASE);
+}
+
+// get umem chunk
+uint32_t xdp_device::get_chunk(const void* ptr) {
+    return (static_cast<const char*>(ptr) - umem_->get_memory()) / def::xdp_chunk_size;
+}
+
+// move rx batch to read queue
+void xdp_device::flush_read_batch(flow::skb_batch& batch) {
+    if (batch.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(read_mutex_);
+        for (auto& buffer : batch)
+            read_head_.push(std::move(buffer));
+    }
+    read_cond_.notify_one();
+    batch.clear();
+}
+
+// make ether header
+void xdp_device::make_ether_header(const flow::sk_buff::ptr& buffer) {
+    flow::skb_push(buffer, sizeof(struct flow::ether_hdr));
+    struct flow::ether_hdr* ether_hdr = reinterpret_cast<struct flow::ether_hdr*>(buffer->get_data());
+    ether_hdr->protocol = htons(buffer->protocol);
+    memcpy(ether_hdr->src, mac_address_, def::mac_len);
+    memcpy(ether_hdr->dst, std::get<std::array<uint8_t, def::mac_len>>(buffer->dst).data(), def::mac_len);
+    // write thread hold reference from now on
+    flow::skb_set_shared(buffer);
+    flow::skb_set_owner(buffer, def::skb_owner::device_tx);
+}
+
+}
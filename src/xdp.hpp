@@ -0,0 +1,279 @@
+#ifndef __XDP_H__
+#define __XDP_H__
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "interface.hpp"
+#include "pool.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <linux/if_xdp.h>
+
+namespace driver {
+
+/**
+ * @file xdp.hpp
+ * @brief xdp_device config
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct xdp_device_config {
+    /// device queue bound to socket
+    uint32_t queue_id = 0;
+    /// descriptor count of each ring, power of 2
+    uint32_t ring_size = 2048;
+    /// umem size, it is the buffer arena of device threads
+    size_t umem_size = 16 << 20;
+    /// socket bind mode
+    def::xdp_bind_mode bind_mode = def::xdp_bind_mode::copy;
+    /// attach program in generic mode, work on any device like veth
+    bool generic = true;
+};
+
+/**
+ * @file xdp.hpp
+ * @brief mmapped af_xdp ring, producer and consumer are shared with kernel
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+struct xdp_ring {
+    /// producer index
+    uint32_t* producer = nullptr;
+    /// consumer index
+    uint32_t* consumer = nullptr;
+    /// ring flags, like need wakeup
+    uint32_t* flags = nullptr;
+    /// descriptors, addr for fill and completion ring, xdp_desc for rx and tx ring
+    void* descs = nullptr;
+    /// descriptor count
+    uint32_t size = 0;
+    /// mapped memory
+    void* map = nullptr;
+    /// mapped size
+    size_t map_size = 0;
+};
+
+/**
+ * @file xdp.hpp
+ * @brief read and write skbuf to af_xdp socket, umem is shared with sk buff pool
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+class xdp_device: public interface::net_device, public std::enable_shared_from_this<xdp_device> {
+public:
+    typedef std::shared_ptr<xdp_device> ptr;
+
+    /**
+     * @brief Construct a new xdp device object
+     * @param[in] dev_name kernel device name
+     * @param[in] ip_address stack ip, arp for it is redirected to socket
+     * @param[in] mac_address stack mac, frames to it are redirected to socket
+     * @param[in] config socket and umem config
+     */
+    xdp_device(const std::string& dev_name, const std::string& ip_address, const std::string& mac_address,
+        const xdp_device_config& config = {});
+
+    /**
+     * @brief Destroy the xdp device object
+     */
+    virtual ~xdp_device();
+
+    /**
+     * @brief create umem and socket, then attach redirect program
+     * @return true if success
+     */
+    virtual bool up();
+
+    /**
+     * @brief detach program and close socket
+     * @return true if success
+     */
+    virtual bool down();
+
+    /**
+     * @brief read from xdp device
+     * @return read buffer
+     */
+    virtual flow::sk_buff::ptr read_from_device();
+
+    /**
+     * @brief write to xdp device
+     * @param[in] buffer write buffer
+     * @return 0 success
+     */
+    virtual int write_to_device(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief read buffers from xdp device, block until one buffer is ready
+     * @param[out] batch buffers are appended
+     * @return buffer count in batch
+     */
+    virtual size_t read_from_device(flow::skb_batch& batch);
+
+    /**
+     * @brief write buffers to xdp device, queue lock is taken once
+     * @param[in] batch write buffers
+     * @return write buffer count
+     */
+    virtual int write_to_device(flow::skb_batch& batch);
+
+    /**
+     * @brief get net_device mac
+     * @return device mac
+     */
+    virtual uint8_t* get_device_mac();
+
+    /**
+     * @brief get net_device ip
+     * @return device ip
+     */
+    virtual uint32_t get_device_ip();
+
+    /**
+     * @brief get net_device ifindex
+     * @return device ifindex
+     */
+    virtual uint8_t get_device_ifindex();
+
+public:
+    /**
+     * @brief fill umem chunks to kernel and read rx ring
+     */
+    virtual void read_thread();
+
+    /**
+     * @brief write tx ring and reclaim completed chunks
+     */
+    virtual void write_thread();
+
+    /**
+     * @brief get xdp device status from kernel status
+     * @return bool xdp device status
+     */
+    virtual bool kernel_device_status() { return false; };
+
+    /**
+     * @brief get xdp device status from user status
+     * @return bool xdp device status
+     */
+    virtual bool user_device_status() { return false; };
+
+private:
+    /**
+     * @brief register umem and map rings
+     * @return false if socket not supported
+     */
+    bool setup_socket();
+
+    /**
+     * @brief map one ring
+     * @param[in] ring ring
+     * @param[in] offset ring offsets from kernel
+     * @param[in] page_offset ring page offset
+     * @param[in] desc_size descriptor size
+     * @return false if map failed
+     */
+    bool map_ring(xdp_ring& ring, const struct xdp_ring_offset& offset, uint64_t page_offset, size_t desc_size);
+
+    /**
+     * @brief load redirect program and attach it to device
+     * @return false if program rejected
+     */
+    bool attach_program();
+
+    /**
+     * @brief post free chunks to fill ring
+     */
+    void refill();
+
+    /**
+     * @brief release chunks sent by kernel
+     */
+    void reclaim();
+
+    /**
+     * @brief put buffer to tx ring, umem buffer is sent in place
+     * @param[in] buffer buffer
+     * @return false if buffer dropped
+     */
+    bool transmit(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief wake kernel to send tx ring
+     */
+    void kick();
+
+    /**
+     * @brief get umem chunk of memory
+     * @param[in] ptr memory in umem
+     * @return chunk index
+     */
+    uint32_t get_chunk(const void* ptr);
+
+    /**
+     * @brief push ether header before buffer is queued
+     * @param[in] buffer buffer
+     */
+    void make_ether_header(const flow::sk_buff::ptr& buffer);
+
+    /**
+     * @brief move rx batch to read queue
+     * @param[in] batch rx buffers
+     */
+    void flush_read_batch(flow::skb_batch& batch);
+
+private:
+    /// device name
+    std::string dev_name_;
+    /// stack address
+    uint32_t ip_address_;
+    /// stack mac
+    uint8_t mac_address_[def::mac_len];
+    /// device index
+    uint32_t if_index_;
+    /// socket and umem config
+    xdp_device_config config_;
+    /// umem, also buffer arena of device threads
+    flow::skb_arena::ptr umem_;
+    /// af_xdp socket
+    int xsk_fd_;
+    /// xsk map, queue id to socket
+    int map_fd_;
+    /// redirect program
+    int prog_fd_;
+    /// program link, program is detached when it is closed
+    int link_fd_;
+    /// fill ring
+    xdp_ring fill_ring_;
+    /// completion ring
+    xdp_ring comp_ring_;
+    /// rx ring
+    xdp_ring rx_ring_;
+    /// tx ring
+    xdp_ring tx_ring_;
+    /// buffers owned by kernel in fill ring, index by chunk, only read thread access it
+    std::vector<flow::sk_buff::ptr> rx_chunks_;
+    /// buffers owned by kernel in tx ring, index by chunk, only write thread access it
+    std::vector<flow::sk_buff::ptr> tx_chunks_;
+    /// read buffer head
+    flow::skb_queue read_head_;
+    /// read share mutex
+    std::mutex read_mutex_;
+    /// read share condition
+    std::condition_variable read_cond_;
+    /// write buffer head
+    flow::skb_queue write_head_;
+    /// write share mutex
+    std::mutex write_mutex_;
+    /// write share condition
+    std::condition_variable write_cond_;
+};
+
+}
+
+#endif // __XDP_H__
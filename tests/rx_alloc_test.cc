@@ -0,0 +1,327 @@
+/**
+ * @file rx_alloc_test.cc
+ * @brief steady state receive path must not touch heap, operator new and malloc are counted
+ *
+ * two stacks are connected by pair devices, traffic is established tcp, bound udp and icmp echo.
+ * allocations of the test thread driving the sending side are not counted, every other thread is,
+ * so stack threads of both sides, device threads and the reading application thread are covered.
+ *
+ * @author ArisAachen
+ * @copyright Copyright (c) 2024 aris All rights reserved
+ */
+
+#include "def.hpp"
+#include "flow.hpp"
+#include "pair.hpp"
+#include "raw_stack.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <execinfo.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+const char* client_ip = "172.17.0.253";
+const char* client_mac = "02:00:00:00:99:01";
+const char* server_ip = "172.17.0.2";
+const char* server_mac = "02:00:00:00:99:02";
+const uint16_t udp_port = 9000;
+const uint16_t udp_client_port = 9001;
+const uint16_t tcp_port = 8000;
+const size_t message_size = 64;
+/// rounds before counting, pools, tables and queues reach their steady size
+const int warmup_rounds = 2000;
+/// rounds counted, each round is one udp datagram, one tcp segment and one icmp echo
+const int counted_rounds = 5000;
+/// allocation call stacks printed on failure
+const int max_traces = 4;
+const int max_trace_depth = 24;
+
+/// count allocations after armed
+std::atomic<bool> armed {false};
+/// allocations while armed
+std::atomic<uint64_t> allocations {0};
+/// thread sending traffic, its allocations belong to sending side api
+thread_local bool source_thread = false;
+/// backtrace itself may allocate on first use
+thread_local bool in_trace = false;
+/// first allocation stacks
+void* traces[max_traces][max_trace_depth];
+int trace_depths[max_traces];
+std::atomic<int> trace_count {0};
+
+// count allocation if armed
+void count_allocation() {
+    if (!armed.load(std::memory_order_relaxed) || source_thread || in_trace)
+        return;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    int index = trace_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= max_traces)
+        return;
+    in_trace = true;
+    trace_depths[index] = backtrace(traces[index], max_trace_depth);
+    in_trace = false;
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    count_allocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr == nullptr ? ENOMEM : 0;
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+}
+
+void* operator new(size_t size) {
+    count_allocation();
+    void* ptr = __libc_malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    count_allocation();
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    __libc_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    __libc_free(ptr);
+}
+
+// fail test
+[[noreturn]] void fail(const char* message) {
+    std::cerr << "FAIL: " << message << std::endl;
+    _exit(1);
+}
+
+// make sockaddr
+struct sockaddr_in make_addr(const char* ip, uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (ip != nullptr)
+        inet_pton(AF_INET, ip, &addr.sin_addr);
+    return addr;
+}
+
+// add static neighbor, like ip neigh replace
+void add_neighbor(const stack::raw_stack::ptr& stack, const driver::pair_device::ptr& device, const driver::pair_device::ptr& peer) {
+    struct flow::arp_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.operator_code = htons(uint16_t(def::arp_op_code::reply));
+    hdr.src_ip = htonl(peer->get_device_ip());
+    memcpy(hdr.src_mac, peer->get_device_mac(), def::mac_len);
+    stack->update_neighbor(&hdr, device.get());
+}
+
+// make icmp echo request frame, device push ether header
+flow::sk_buff::ptr make_echo_request(const driver::pair_device::ptr& source, const driver::pair_device::ptr& target, uint16_t sequence) {
+    size_t icmp_size = sizeof(struct flow::icmp_hdr) + sizeof(struct flow::icmp_echo_body) + message_size;
+    size_t ip_size = sizeof(struct flow::ip_hdr) + icmp_size;
+    auto buffer = flow::sk_buff::alloc(def::max_ether_header + ip_size);
+    if (buffer == nullptr)
+        return nullptr;
+    buffer->data_len = def::max_ether_header + ip_size;
+    flow::skb_reserve(buffer, def::max_ether_header);
+    flow::skb_put(buffer, ip_size);
+    auto ip = reinterpret_cast<struct flow::ip_hdr*>(buffer->get_data());
+    memset(ip, 0, ip_size);
+    ip->version_and_head_len = 0x45;
+    ip->total_len = htons(ip_size);
+    ip->time_to_live = def::ip_time_to_live;
+    ip->protocol = uint8_t(def::network_protocol::icmp);
+    ip->src_ip = htonl(source->get_device_ip());
+    ip->dst_ip = htonl(target->get_device_ip());
+    ip->head_checksum = htons(flow::compute_checksum(reinterpret_cast<char*>(ip), sizeof(struct flow::ip_hdr)));
+    auto icmp = reinterpret_cast<struct flow::icmp_hdr*>(ip + 1);
+    icmp->icmp_type = uint8_t(def::icmp_type::request);
+    auto body = reinterpret_cast<struct flow::icmp_echo_body*>(icmp + 1);
+    body->identifier = htons(1);
+    body->sequence_number = htons(sequence);
+    icmp->icmp_checksum = htons(flow::compute_checksum(reinterpret_cast<char*>(icmp), icmp_size));
+    buffer->protocol = uint16_t(def::network_protocol::ip);
+    std::array<uint8_t, def::mac_len> mac;
+    memcpy(mac.data(), target->get_device_mac(), def::mac_len);
+    buffer->dst = mac;
+    return buffer;
+}
+
+int main() {
+    source_thread = true;
+    // stack log every packet, keep test output readable
+    auto log = std::cout.rdbuf(nullptr);
+    // load unwinder before armed
+    void* warm_trace[1];
+    backtrace(warm_trace, 1);
+
+    auto client_device = std::make_shared<driver::pair_device>("alloc0", 201, client_ip, client_mac);
+    auto server_device = std::make_shared<driver::pair_device>("alloc1", 202, server_ip, server_mac);
+    driver::pair_device::connect(client_device, server_device);
+    auto client = stack::raw_stack::create();
+    client->register_device(client_device);
+    client->register_handlers();
+    client->run();
+    auto server = stack::raw_stack::create();
+    server->register_device(server_device);
+    server->register_handlers();
+    server->run();
+    add_neighbor(client, client_device, server_device);
+    add_neighbor(server, server_device, client_device);
+
+    // bound udp
+    uint32_t udp_server = server->sock_create(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    auto udp_server_addr = make_addr(nullptr, udp_port);
+    if (!server->bind(udp_server, reinterpret_cast<struct sockaddr*>(&udp_server_addr), sizeof(udp_server_addr)))
+        fail("bind udp server");
+    uint32_t udp_client = client->sock_create(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    auto udp_client_addr = make_addr(client_ip, udp_client_port);
+    if (!client->bind(udp_client, reinterpret_cast<struct sockaddr*>(&udp_client_addr), sizeof(udp_client_addr)))
+        fail("bind udp client");
+    auto udp_dst = make_addr(server_ip, udp_port);
+
+    // established tcp
+    uint32_t tcp_listen = server->sock_create(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    auto tcp_server_addr = make_addr(nullptr, tcp_port);
+    if (!server->bind(tcp_listen, reinterpret_cast<struct sockaddr*>(&tcp_server_addr), sizeof(tcp_server_addr)))
+        fail("bind tcp server");
+    server->listen(tcp_listen, 4);
+    std::atomic<int> udp_received {0};
+    std::atomic<int> tcp_received {0};
+    std::atomic<bool> accepted {false};
+    std::thread udp_reader([&] {
+        char buf[def::default_mtu];
+        while (true) {
+            struct sockaddr_in remote;
+            socklen_t len = sizeof(remote);
+            auto size = server->readfrom(udp_server, buf, sizeof(buf), reinterpret_cast<struct sockaddr*>(&remote), &len);
+            if (size == message_size)
+                udp_received.fetch_add(1);
+        }
+    });
+    std::thread tcp_reader([&] {
+        struct sockaddr_in remote;
+        socklen_t len = sizeof(remote);
+        uint32_t fd = server->accept(tcp_listen, reinterpret_cast<struct sockaddr*>(&remote), &len);
+        accepted.store(true);
+        char buf[message_size];
+        size_t total = 0;
+        while (true) {
+            auto size = server->read(fd, buf, sizeof(buf));
+            if (size == 0 || size > sizeof(buf))
+                continue;
+            total += size;
+            tcp_received.store(total / message_size);
+        }
+    });
+    uint32_t tcp_client = client->sock_create(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    auto tcp_dst = make_addr(server_ip, tcp_port);
+    if (!client->connect(tcp_client, reinterpret_cast<struct sockaddr*>(&tcp_dst), sizeof(tcp_dst)))
+        fail("connect tcp");
+    while (!accepted.load())
+        std::this_thread::yield();
+
+    // one round, wait until all are read so queues never grow past steady size
+    char message[message_size];
+    memset(message, 'x', sizeof(message));
+    auto round = [&] (int index) {
+        auto server_tx = server_device->get_stats().tx;
+        flow::skb_batch batch;
+        batch.push(make_echo_request(client_device, server_device, index));
+        client_device->write_to_device(batch);
+        client->writeto(udp_client, message, sizeof(message), reinterpret_cast<struct sockaddr*>(&udp_dst), sizeof(udp_dst));
+        client->write(tcp_client, message, sizeof(message));
+        while (udp_received.load() <= index || tcp_received.load() <= index || server_device->get_stats().tx == server_tx)
+            std::this_thread::yield();
+    };
+    for (int index = 0; index < warmup_rounds; index++)
+        round(index);
+    armed.store(true);
+    for (int index = warmup_rounds; index < warmup_rounds + counted_rounds; index++)
+        round(index);
+    armed.store(false);
+
+    std::cout.rdbuf(log);
+    uint64_t count = allocations.load();
+    std::cerr << "allocations in " << counted_rounds << " rounds: " << count << std::endl;
+    if (count != 0) {
+        int traced = std::min(trace_count.load(), max_traces);
+        for (int index = 0; index < traced; index++) {
+            std::cerr << "allocation " << index << ":" << std::endl;
+            backtrace_symbols_fd(traces[index], trace_depths[index], STDERR_FILENO);
+        }
+        fail("steady state receive path allocated");
+    }
+    std::cerr << "PASS" << std::endl;
+    // stack threads run forever, skip their destructors
+    _exit(0);
+}